@@ -159,6 +159,7 @@ testScripts = [
 ]
 if ENABLE_ZMQ:
     testScripts.append('zmq_test.py')
+    testScripts.append('zmq_rawblock.py')
 
 testScriptsExt = [
     'pruning.py',
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the ZMQ rawblock and rawtx notifications
+#
+# Blocks that just extended the tip are published from memory, others are
+# read back from disk. Either way, the payload must be the serialized block.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+import zmq
+import struct
+
+class ZMQRawBlockTest (BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    port = 28334
+
+    def setup_network(self):
+        self.zmqContext = zmq.Context()
+        self.zmqSubSocket = self.zmqContext.socket(zmq.SUB)
+        self.zmqSubSocket.set(zmq.RCVTIMEO, 60000)
+        self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawblock")
+        self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"rawtx")
+        self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        address = 'tcp://127.0.0.1:' + str(self.port)
+        self.nodes = [start_node(0, self.options.tmpdir, ['-zmqpubrawblock=' + address, '-zmqpubrawtx=' + address])]
+        self.is_network_split = False
+        self.sequence = {b"rawblock": 0, b"rawtx": 0}
+
+    def receive(self, topic):
+        # Messages of both kinds arrive interleaved; check the sequence
+        # number of each kind, and return the body of the next one of topic
+        while True:
+            msg = self.zmqSubSocket.recv_multipart()
+            assert_equal(len(msg), 3)
+            msgSequence = struct.unpack('<I', msg[2])[-1]
+            assert_equal(msgSequence, self.sequence[msg[0]])
+            self.sequence[msg[0]] += 1
+            if msg[0] == topic:
+                return msg[1]
+
+    def check_block(self, blockhash):
+        body = self.receive(b"rawblock")
+        assert_equal(bytes_to_hex_str(body), self.nodes[0].getblock(blockhash, False))
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        print("Blocks that extend the tip are published from memory...")
+        blockhashes = node.generate(3)
+        for blockhash in blockhashes:
+            coinbase = node.getblock(blockhash)["tx"][0]
+            body = self.receive(b"rawtx")
+            assert_equal(node.decoderawtransaction(bytes_to_hex_str(body))["txid"], coinbase)
+            self.check_block(blockhash)
+
+        print("...and those a reorg returns to are read from disk")
+        node.invalidateblock(blockhashes[1])
+        forkhashes = node.generate(3)
+        for blockhash in forkhashes:
+            self.check_block(blockhash)
+        node.invalidateblock(forkhashes[0])
+        node.reconsiderblock(blockhashes[1])
+        assert_equal(node.getbestblockhash(), blockhashes[-1])
+        self.check_block(blockhashes[-1])
+
+if __name__ == '__main__':
+    ZMQRawBlockTest ().main ()
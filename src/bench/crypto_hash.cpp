@@ -7,6 +7,7 @@
 #include "bench.h"
 #include "bloom.h"
 #include "hash.h"
+#include "primitives/block.h"
 #include "uint256.h"
 #include "utiltime.h"
 #include "crypto/ripemd160.h"
@@ -51,6 +52,14 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -69,10 +78,34 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void Scrypt_Header(benchmark::State& state)
+{
+    CBlockHeader header;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100; i++) {
+            header.nNonce = i;
+            header.GetPoWHash();
+        }
+    }
+}
+
+static void Scrypt_HeaderGrind(benchmark::State& state)
+{
+    CPoWGrindContext context((CBlockHeader()));
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100; i++)
+            context.GetPoWHash(i);
+    }
+}
+
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
 BENCHMARK(SipHash_32b);
+
+BENCHMARK(Scrypt_Header);
+BENCHMARK(Scrypt_HeaderGrind);
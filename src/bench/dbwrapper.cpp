@@ -0,0 +1,82 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "dbwrapper.h"
+#include "hash.h"
+#include "random.h"
+#include "txdb.h"
+#include "uint256.h"
+
+#include <boost/filesystem.hpp>
+
+// New coins entries written per simulated block
+static const unsigned int COINS_BENCH_CREATED = 1000;
+// Existing coins entries read, and then rewritten or erased, per simulated block
+static const unsigned int COINS_BENCH_SPENT = 800;
+
+// Replays an IBD-like load on a chainstate database opened with the given
+// profile: every block adds entries under random txids, and spends entries
+// spread over the whole history, each block being flushed as one batch. The
+// database lives in the temporary directory, so point that at the disk the
+// profile is meant for.
+static void ReplayCoinsWorkload(benchmark::State& state, const std::string& strProfile)
+{
+    std::string strError;
+    std::set<std::string> setDBNames;
+    setDBNames.insert(DB_NAME_CHAINSTATE);
+    SetDBProfiles(std::vector<std::string>(1, strProfile), setDBNames, strError);
+
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        CDBWrapper db(path, nMaxCoinsDBCache << 20, false, true, true, DB_NAME_CHAINSTATE);
+        FastRandomContext rand(true);
+        std::vector<uint256> vTxid;
+        std::vector<unsigned char> vchCoins(60);
+        uint64_t nCreated = 0;
+
+        while (state.KeepRunning()) {
+            CDBBatch batch(db);
+            for (unsigned int i = 0; i < COINS_BENCH_CREATED; i++) {
+                nCreated++;
+                vTxid.push_back(Hash(BEGIN(nCreated), END(nCreated)));
+                batch.Write(std::make_pair('c', vTxid.back()), vchCoins);
+            }
+            for (unsigned int i = 0; i < COINS_BENCH_SPENT && vTxid.size() > COINS_BENCH_CREATED; i++) {
+                size_t nPos = rand.rand32() % (vTxid.size() - COINS_BENCH_CREATED);
+                std::vector<unsigned char> vchRead;
+                db.Read(std::make_pair('c', vTxid[nPos]), vchRead);
+                if (rand.rand32() & 1) {
+                    batch.Erase(std::make_pair('c', vTxid[nPos]));
+                    vTxid[nPos] = vTxid.back();
+                    vTxid.pop_back();
+                } else {
+                    batch.Write(std::make_pair('c', vTxid[nPos]), vchCoins);
+                }
+            }
+            db.WriteBatch(batch);
+        }
+    }
+    boost::filesystem::remove_all(path);
+    SetDBProfiles(std::vector<std::string>(), setDBNames, strError);
+}
+
+static void CoinsDB_Default(benchmark::State& state)
+{
+    ReplayCoinsWorkload(state, "default");
+}
+
+static void CoinsDB_SSD(benchmark::State& state)
+{
+    ReplayCoinsWorkload(state, "ssd");
+}
+
+static void CoinsDB_HDD(benchmark::State& state)
+{
+    ReplayCoinsWorkload(state, "hdd");
+}
+
+BENCHMARK(CoinsDB_Default);
+BENCHMARK(CoinsDB_SSD);
+BENCHMARK(CoinsDB_HDD);
@@ -112,4 +112,47 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+// Every transaction added to a chain walks all its ancestors, and removing
+// the chain root walks all its descendants, so this measures the ancestor
+// and descendant bookkeeping done while accepting and evicting packages.
+static void MempoolChains(benchmark::State& state)
+{
+    const int nChains = 40;
+    const int nChainLength = 25;
+
+    std::vector<CTransactionRef> vRoots;
+    std::vector<CTransactionRef> vTxs;
+    for (int nChain = 0; nChain < nChains; nChain++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << nChain;
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx.vout[1].nValue = 10 * COIN;
+        vRoots.push_back(MakeTransactionRef(tx));
+        vTxs.push_back(vRoots.back());
+        for (int i = 1; i < nChainLength; i++) {
+            // Each link spends both outputs of its parent
+            tx.vin.resize(2);
+            tx.vin[0].prevout = COutPoint(vTxs.back()->GetHash(), 0);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            tx.vin[1].prevout = COutPoint(vTxs.back()->GetHash(), 1);
+            tx.vin[1].scriptSig = CScript() << OP_2;
+            vTxs.push_back(MakeTransactionRef(tx));
+        }
+    }
+
+    CTxMemPool pool(CFeeRate(1000));
+
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : vTxs)
+            AddTx(*tx, 1000LL, pool);
+        for (const CTransactionRef& tx : vRoots)
+            pool.removeRecursive(*tx);
+    }
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolChains);
@@ -0,0 +1,278 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/** Protocol version used to serialize parameters in GCS filter encoding */
+static const int GCS_SER_VERSION = 0;
+
+template <typename OStream>
+static void GolombRiceEncode(BitStreamWriter<OStream>& bitwriter, uint8_t nP, uint64_t x)
+{
+    // Write quotient as unary-encoded: q 1's followed by one 0
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nBits = q <= 64 ? static_cast<int>(q) : 64;
+        bitwriter.Write(~0ULL, nBits);
+        q -= nBits;
+    }
+    bitwriter.Write(0, 1);
+
+    // Write the remainder in nP bits. Since the remainder is just the bottom
+    // nP bits of x, there is no need to mask first.
+    bitwriter.Write(x, nP);
+}
+
+template <typename IStream>
+static uint64_t GolombRiceDecode(BitStreamReader<IStream>& bitreader, uint8_t nP)
+{
+    // Read unary-encoded quotient: q 1's followed by one 0
+    uint64_t q = 0;
+    while (bitreader.Read(1) == 1)
+        ++q;
+
+    uint64_t r = bitreader.Read(nP);
+
+    return (q << nP) + r;
+}
+
+/**
+ * Map a value x that is uniformly distributed in the range [0, 2^64) to a
+ * value uniformly distributed in [0, n) by returning the upper 64 bits of
+ * x * n. This is cheaper than a modulo reduction.
+ */
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) * static_cast<unsigned __int128>(n)) >> 64;
+#else
+    // To perform the calculation on 64-bit numbers without losing the
+    // result to overflow, split the numbers into the most significant and
+    // least significant 32 bits and perform multiplication piece-wise.
+    uint64_t x_hi = x >> 32;
+    uint64_t x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32;
+    uint64_t n_lo = n & 0xFFFFFFFF;
+
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    uint64_t upper64 = ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+    return upper64;
+#endif
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = CSipHasher(params.nSipHashK0, params.nSipHashK1)
+        .Write(element.data(), element.size())
+        .Finalize();
+    return MapIntoRange(hash, nRange);
+}
+
+std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    for (const Element& element : elements)
+        vHashed.push_back(HashToRange(element));
+    std::sort(vHashed.begin(), vHashed.end());
+    return vHashed;
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn)
+    : params(paramsIn), nElements(0), nRange(0), vchEncoded(1, 0)
+{
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn, std::vector<unsigned char> vchEncodedIn)
+    : params(paramsIn), vchEncoded(std::move(vchEncodedIn))
+{
+    CVectorReader stream(SER_NETWORK, GCS_SER_VERSION, vchEncoded, 0);
+
+    uint64_t nCount = ReadCompactSize(stream);
+    nElements = static_cast<uint32_t>(nCount);
+    if (nElements != nCount)
+        throw std::ios_base::failure("N must be <2^32");
+    nRange = static_cast<uint64_t>(nElements) * params.nM;
+
+    // Verify that the encoded filter contains exactly N elements. If it has
+    // too much or too little data, a std::ios_base::failure exception will
+    // be raised.
+    BitStreamReader<CVectorReader> bitreader(stream);
+    for (uint64_t i = 0; i < nElements; ++i)
+        GolombRiceDecode(bitreader, params.nP);
+    if (!stream.empty())
+        throw std::ios_base::failure("encoded filter contains excess data");
+}
+
+GCSFilter::GCSFilter(const Params& paramsIn, const ElementSet& elements)
+    : params(paramsIn)
+{
+    size_t nCount = elements.size();
+    nElements = static_cast<uint32_t>(nCount);
+    if (nElements != nCount)
+        throw std::invalid_argument("N must be <2^32");
+    nRange = static_cast<uint64_t>(nElements) * params.nM;
+
+    CVectorWriter stream(SER_NETWORK, GCS_SER_VERSION, vchEncoded, 0);
+
+    WriteCompactSize(stream, nElements);
+
+    if (elements.empty())
+        return;
+
+    BitStreamWriter<CVectorWriter> bitwriter(stream);
+
+    uint64_t nLast = 0;
+    for (uint64_t nValue : BuildHashedSet(elements)) {
+        uint64_t nDelta = nValue - nLast;
+        GolombRiceEncode(bitwriter, params.nP, nDelta);
+        nLast = nValue;
+    }
+
+    bitwriter.Flush();
+}
+
+bool GCSFilter::MatchInternal(const uint64_t* pElementHashes, size_t nSize) const
+{
+    CVectorReader stream(SER_NETWORK, GCS_SER_VERSION, vchEncoded, 0);
+
+    // Seek forward by size of N
+    uint64_t nCount = ReadCompactSize(stream);
+    assert(nCount == nElements);
+
+    BitStreamReader<CVectorReader> bitreader(stream);
+
+    // Both the filter and the queried hashes are sorted, so they are walked
+    // in step and the filter is decoded at most once
+    uint64_t nValue = 0;
+    size_t nHashIndex = 0;
+    for (uint32_t i = 0; i < nElements; ++i) {
+        uint64_t nDelta = GolombRiceDecode(bitreader, params.nP);
+        nValue += nDelta;
+
+        while (true) {
+            if (nHashIndex == nSize)
+                return false;
+            else if (pElementHashes[nHashIndex] == nValue)
+                return true;
+            else if (pElementHashes[nHashIndex] > nValue)
+                break;
+            nHashIndex++;
+        }
+    }
+
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    uint64_t nQuery = HashToRange(element);
+    return MatchInternal(&nQuery, 1);
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    const std::vector<uint64_t> vQueries = BuildHashedSet(elements);
+    return MatchInternal(vQueries.data(), vQueries.size());
+}
+
+std::string BlockFilterTypeName(BlockFilterType filterType)
+{
+    switch (filterType) {
+    case BLOCK_FILTER_BASIC: return "basic";
+    default: return "";
+    }
+}
+
+bool BlockFilterTypeByName(const std::string& strName, BlockFilterType& filterType)
+{
+    if (strName == "basic") {
+        filterType = BLOCK_FILTER_BASIC;
+        return true;
+    }
+    return false;
+}
+
+static void AddFilterElement(const CScript& script, GCSFilter::ElementSet& elements)
+{
+    if (script.empty() || script[0] == OP_RETURN)
+        return;
+    elements.insert(GCSFilter::Element(script.begin(), script.end()));
+}
+
+static GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockUndo)
+{
+    GCSFilter::ElementSet elements;
+
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const CTxOut& txout : tx->vout)
+            AddFilterElement(txout.scriptPubKey, elements);
+    }
+
+    for (const CTxUndo& txundo : blockUndo.vtxundo) {
+        for (const CTxInUndo& prevout : txundo.vprevout)
+            AddFilterElement(prevout.txout.scriptPubKey, elements);
+    }
+
+    return elements;
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, std::vector<unsigned char> vchFilter)
+    : filterType(filterTypeIn), blockHash(blockHashIn)
+{
+    GCSFilter::Params paramsNew;
+    if (!BuildParams(paramsNew))
+        throw std::invalid_argument("unknown filter_type");
+    filter = GCSFilter(paramsNew, std::move(vchFilter));
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo)
+    : filterType(filterTypeIn), blockHash(block.GetHash())
+{
+    GCSFilter::Params paramsNew;
+    if (!BuildParams(paramsNew))
+        throw std::invalid_argument("unknown filter_type");
+    filter = GCSFilter(paramsNew, BasicFilterElements(block, blockUndo));
+}
+
+bool BlockFilter::BuildParams(GCSFilter::Params& paramsOut) const
+{
+    switch (filterType) {
+    case BLOCK_FILTER_BASIC:
+        // The filter of a block is keyed by the first 16 bytes of its hash
+        paramsOut.nSipHashK0 = blockHash.GetUint64(0);
+        paramsOut.nSipHashK1 = blockHash.GetUint64(1);
+        paramsOut.nP = BASIC_FILTER_P;
+        paramsOut.nM = BASIC_FILTER_M;
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vchData = GetEncodedFilter();
+    return Hash(vchData.begin(), vchData.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    const uint256& filterHash = GetHash();
+    return Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end());
+}
@@ -0,0 +1,151 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-coded set: a compact probabilistic set of byte strings, as
+ * specified by BIP 158. The elements are hashed with SipHash into the range
+ * [0, N * M), sorted, and the differences between them are Golomb-Rice
+ * coded with parameter P. Elements that are in the set always match;
+ * others match with a probability of about 1 / M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params
+    {
+        uint64_t nSipHashK0;
+        uint64_t nSipHashK1;
+        /** Golomb-Rice coding parameter */
+        uint8_t nP;
+        /** Inverse false positive rate */
+        uint32_t nM;
+
+        Params(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0, uint8_t nPIn = 0, uint32_t nMIn = 1)
+            : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn) {}
+    };
+
+private:
+    Params params;
+    /** Number of elements in the filter */
+    uint32_t nElements;
+    /** Range of element hashes, nElements * nM */
+    uint64_t nRange;
+    std::vector<unsigned char> vchEncoded;
+
+    /** Hash a data element to an integer in the range [0, nRange) */
+    uint64_t HashToRange(const Element& element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+    /** Helper for Match and MatchAny; the hashes must be sorted */
+    bool MatchInternal(const uint64_t* pElementHashes, size_t nSize) const;
+
+public:
+    /** Construct an empty filter */
+    explicit GCSFilter(const Params& paramsIn = Params());
+    /** Reconstruct a filter from its encoding. Throws std::ios_base::failure if it is malformed. */
+    GCSFilter(const Params& paramsIn, std::vector<unsigned char> vchEncodedIn);
+    /** Build a new filter from a set of elements */
+    GCSFilter(const Params& paramsIn, const ElementSet& elements);
+
+    uint32_t GetN() const { return nElements; }
+    const Params& GetParams() const { return params; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    /** Checks if the element may be in the set. False positives are possible. */
+    bool Match(const Element& element) const;
+    /** Checks if any of the given elements may be in the set. Faster than checking them one by one. */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+/** Golomb-Rice parameter and false positive rate of basic block filters (BIP 158) */
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+enum BlockFilterType : uint8_t
+{
+    BLOCK_FILTER_BASIC = 0,
+    BLOCK_FILTER_INVALID = 255,
+};
+
+/** Get the name of a filter type, or "" if it is unknown */
+std::string BlockFilterTypeName(BlockFilterType filterType);
+/** Find a filter type by name */
+bool BlockFilterTypeByName(const std::string& strName, BlockFilterType& filterType);
+
+/**
+ * Complete block filter struct as defined in BIP 157. The basic filter of a
+ * block holds every output script it creates and every output script it
+ * spends, so a light client can tell whether a block concerns any of its
+ * scripts without downloading it. Empty scripts, such as the first output of
+ * a coinstake, and OP_RETURN outputs are left out.
+ */
+class BlockFilter
+{
+private:
+    BlockFilterType filterType;
+    uint256 blockHash;
+    GCSFilter filter;
+
+    bool BuildParams(GCSFilter::Params& paramsOut) const;
+
+public:
+    BlockFilter() : filterType(BLOCK_FILTER_INVALID) {}
+
+    /** Reconstruct a filter from its parts. Throws std::invalid_argument if the type is unknown. */
+    BlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, std::vector<unsigned char> vchFilter);
+    /** Construct a new filter of a block, using its undo data for the spent outputs */
+    BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return blockHash; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Compute the filter hash */
+    uint256 GetHash() const;
+    /** Compute the filter header given the previous one, which is zero for the genesis block */
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        s << (uint8_t)filterType
+          << blockHash
+          << filter.GetEncoded();
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        std::vector<unsigned char> vchEncoded;
+        uint8_t nFilterType;
+
+        s >> nFilterType
+          >> blockHash
+          >> vchEncoded;
+
+        filterType = static_cast<BlockFilterType>(nFilterType);
+
+        GCSFilter::Params paramsNew;
+        if (!BuildParams(paramsNew))
+            throw std::ios_base::failure("unknown filter_type");
+        filter = GCSFilter(paramsNew, std::move(vchEncoded));
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -47,6 +47,13 @@
 #include <unistd.h>
 #endif
 
+// poll() and epoll are not limited to FD_SETSIZE sockets like select()
+#if defined(__linux__)
+#define USE_POLL
+#define USE_EPOLL
+#include <poll.h>
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT        0
 #else
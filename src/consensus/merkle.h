@@ -12,10 +12,19 @@
 #include "primitives/block.h"
 #include "uint256.h"
 
-uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated = NULL);
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = NULL);
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
 
+/*
+ * Compute every level of the merkle tree over leaves, starting with the
+ * leaves themselves and ending with the root. The tree of no leaves is empty.
+ */
+std::vector<std::vector<uint256> > ComputeMerkleTree(std::vector<uint256> leaves);
+
+/* Extract the merkle branch for a position from a tree built by ComputeMerkleTree. */
+std::vector<uint256> ComputeMerkleBranch(const std::vector<std::vector<uint256> >& tree, uint32_t position);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
@@ -253,17 +253,14 @@ static inline void xor_salsa8(uint32_t B[16], const uint32_t Bx[16])
 	B[15] += x15;
 }
 
-void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+void scrypt_core_generic(uint8_t B[128], char *scratchpad)
 {
-	uint8_t B[128];
 	uint32_t X[32];
 	uint32_t *V;
 	uint32_t i, j, k;
 
 	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
 
-	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
-
 	for (k = 0; k < 32; k++)
 		X[k] = le32dec(&B[4 * k]);
 
@@ -282,7 +279,14 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 
 	for (k = 0; k < 32; k++)
 		le32enc(&B[4 * k], X[k]);
+}
 
+void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+
+	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
+	scrypt_core_generic(B, scratchpad);
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
@@ -329,3 +333,76 @@ void scrypt_1024_1_1_256(const char *input, char *output)
 	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
     scrypt_1024_1_1_256_sp(input, output, scratchpad);
 }
+
+/**
+ * PBKDF2_SHA256 with a single iteration, for a password whose HMAC-SHA256
+ * key has already been set up in keyctx.
+ */
+static void
+PBKDF2_SHA256_keyed(const HMAC_SHA256_CTX *keyctx, const uint8_t *salt,
+    size_t saltlen, uint8_t *buf, size_t dkLen)
+{
+	HMAC_SHA256_CTX PShctx, hctx;
+	size_t i;
+	uint8_t ivec[4];
+	uint8_t U[32];
+	size_t clen;
+
+	memcpy(&PShctx, keyctx, sizeof(HMAC_SHA256_CTX));
+	HMAC_SHA256_Update(&PShctx, salt, saltlen);
+
+	for (i = 0; i * 32 < dkLen; i++) {
+		be32enc(ivec, (uint32_t)(i + 1));
+		memcpy(&hctx, &PShctx, sizeof(HMAC_SHA256_CTX));
+		HMAC_SHA256_Update(&hctx, ivec, 4);
+		HMAC_SHA256_Final(U, &hctx);
+
+		clen = dkLen - i * 32;
+		if (clen > 32)
+			clen = 32;
+		memcpy(&buf[i * 32], U, clen);
+	}
+
+	memset(&PShctx, 0, sizeof(HMAC_SHA256_CTX));
+}
+
+static void scrypt_core(uint8_t B[128], char *scratchpad)
+{
+#if defined(USE_SSE2_ALWAYS)
+	scrypt_core_sse2(B, scratchpad);
+#elif defined(USE_SSE2)
+	if (scrypt_1024_1_1_256_sp_detected == &scrypt_1024_1_1_256_sp_sse2)
+		scrypt_core_sse2(B, scratchpad);
+	else
+		scrypt_core_generic(B, scratchpad);
+#else
+	scrypt_core_generic(B, scratchpad);
+#endif
+}
+
+void scrypt_midstate_init(scrypt_midstate *midstate, const char *input)
+{
+	midstate->keyhash.Reset().Write((const unsigned char *)input, 64);
+}
+
+void scrypt_1024_1_1_256_sp_midstate(const scrypt_midstate *midstate, const char *input, char *output, char *scratchpad)
+{
+	HMAC_SHA256_CTX keyctx;
+	uint8_t key[32];
+	uint8_t B[128];
+
+	/*
+	 * The 80 byte password is longer than a SHA256 block, so HMAC keys
+	 * with its hash. Both PBKDF2 passes use the same password, so the key
+	 * is only set up once.
+	 */
+	CSHA256 keyhash(midstate->keyhash);
+	keyhash.Write((const unsigned char *)input + 64, 16).Finalize(key);
+	HMAC_SHA256_Init(&keyctx, key, 32);
+
+	PBKDF2_SHA256_keyed(&keyctx, (const uint8_t *)input, 80, B, 128);
+	scrypt_core(B, scratchpad);
+	PBKDF2_SHA256_keyed(&keyctx, B, 128, (uint8_t *)output, 32);
+
+	memset(&keyctx, 0, sizeof(HMAC_SHA256_CTX));
+}
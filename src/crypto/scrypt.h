@@ -3,11 +3,31 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "crypto/sha256.h"
+
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
+/**
+ * The part of scrypt_1024_1_1_256 over an 80 byte input that only depends on
+ * the first 64 bytes, for hashing inputs that differ in their last 16 bytes,
+ * like block headers with different nonces.
+ */
+struct scrypt_midstate
+{
+    /* SHA256 of the PBKDF2 password, which HMAC uses as its key, after the first 64 bytes */
+    CSHA256 keyhash;
+};
+
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+void scrypt_midstate_init(scrypt_midstate *midstate, const char *input);
+/* scrypt_1024_1_1_256 of input, whose first 64 bytes midstate was initialized with */
+void scrypt_1024_1_1_256_sp_midstate(const scrypt_midstate *midstate, const char *input, char *output, char *scratchpad);
+
+/* The sequential memory-hard mixing of scrypt between the two PBKDF2 passes */
+void scrypt_core_generic(uint8_t B[128], char *scratchpad);
+
 #if defined(USE_SSE2)
 #include <string>
 #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
@@ -19,6 +39,7 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 
 std::string scrypt_detect_sse2();
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
+void scrypt_core_sse2(uint8_t B[128], char *scratchpad);
 extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
 #else
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
@@ -6,8 +6,10 @@
 
 #include "util.h"
 #include "random.h"
+#include "sync.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -15,14 +17,115 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/**
+ * The built-in profiles. "default" keeps the settings every database used to
+ * be opened with. "ssd" spends more of the budget on write buffers, as random
+ * reads are cheap but every flush to level 0 adds compaction writes. "hdd"
+ * trades CPU for fewer seeks: a larger block cache, more open tables, larger
+ * compressed blocks and bloom filters with fewer false positives.
+ */
+static const CDBProfile dbProfiles[] = {
+    // name       cache  buffer  files  compression  bloom  block size
+    {"default",   50,    25,     64,    false,       10,    4 << 10},
+    {"ssd",       30,    35,     64,    false,       10,    4 << 10},
+    {"hdd",       60,    20,     256,   true,        16,    16 << 10},
+};
+
+bool GetDBProfile(const std::string& strName, CDBProfile& profile)
+{
+    for (unsigned int i = 0; i < ARRAYLEN(dbProfiles); i++) {
+        if (dbProfiles[i].strName == strName) {
+            profile = dbProfiles[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string ListDBProfiles()
+{
+    std::string strList;
+    for (unsigned int i = 0; i < ARRAYLEN(dbProfiles); i++) {
+        if (i > 0)
+            strList += ", ";
+        strList += dbProfiles[i].strName;
+    }
+    return strList;
+}
+
+namespace {
+
+CCriticalSection cs_dbwrapper;
+//! Selected profile names by database name, the empty name applying to all
+std::map<std::string, std::string> mapDBProfiles;
+//! Every open database, for getdbinfo
+std::set<const CDBWrapper*> setOpenDatabases;
+
+} // anon namespace
+
+bool SetDBProfiles(const std::vector<std::string>& vArgs, const std::set<std::string>& setDBNames, std::string& strError)
+{
+    std::map<std::string, std::string> mapProfiles;
+    BOOST_FOREACH(const std::string& strArg, vArgs) {
+        std::string strDBName, strProfile = strArg;
+        size_t nSep = strArg.find(':');
+        if (nSep != std::string::npos) {
+            strDBName = strArg.substr(0, nSep);
+            strProfile = strArg.substr(nSep + 1);
+            if (!setDBNames.count(strDBName)) {
+                strError = strprintf("Unknown database '%s' in -dbprofile=%s", strDBName, strArg);
+                return false;
+            }
+        }
+        CDBProfile profile;
+        if (!GetDBProfile(strProfile, profile)) {
+            strError = strprintf("Unknown database profile '%s' in -dbprofile=%s (available: %s)", strProfile, strArg, ListDBProfiles());
+            return false;
+        }
+        mapProfiles[strDBName] = strProfile;
+    }
+    LOCK(cs_dbwrapper);
+    mapDBProfiles.swap(mapProfiles);
+    return true;
+}
+
+CDBProfile GetSelectedDBProfile(const std::string& strDBName)
+{
+    std::string strProfile = DEFAULT_DB_PROFILE;
+    {
+        LOCK(cs_dbwrapper);
+        std::map<std::string, std::string>::const_iterator it = mapDBProfiles.find(strDBName);
+        if (it == mapDBProfiles.end())
+            it = mapDBProfiles.find("");
+        if (it != mapDBProfiles.end())
+            strProfile = it->second;
+    }
+    CDBProfile profile;
+    bool fFound = GetDBProfile(strProfile, profile);
+    assert(fFound);
+    return profile;
+}
+
+static size_t GetBlockCacheSize(const CDBProfile& profile, size_t nCacheSize)
+{
+    return nCacheSize / 100 * profile.nBlockCachePercent;
+}
+
+static size_t GetWriteBufferSize(const CDBProfile& profile, size_t nCacheSize)
+{
+    return nCacheSize / 100 * profile.nWriteBufferPercent;
+}
+
+static leveldb::Options GetOptions(const CDBProfile& profile, size_t nCacheSize)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = leveldb::NewLRUCache(GetBlockCacheSize(profile, nCacheSize));
+    options.write_buffer_size = GetWriteBufferSize(profile, nCacheSize); // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = profile.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    // Without Snappy, LevelDB stores blocks uncompressed regardless
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = profile.nMaxOpenFiles;
+    options.block_size = profile.nBlockSize;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -31,14 +134,37 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+std::vector<CDBWrapperInfo> ListOpenDatabases()
+{
+    std::vector<CDBWrapperInfo> vInfo;
+    LOCK(cs_dbwrapper);
+    BOOST_FOREACH(const CDBWrapper* pdbw, setOpenDatabases) {
+        CDBWrapperInfo info;
+        info.strName = pdbw->strName;
+        info.strPath = pdbw->path.string();
+        info.fMemory = pdbw->fMemory;
+        info.profile = pdbw->profile;
+        info.nCacheSize = pdbw->nCacheSize;
+        info.nBlockCacheSize = GetBlockCacheSize(pdbw->profile, pdbw->nCacheSize);
+        info.nWriteBufferSize = GetWriteBufferSize(pdbw->profile, pdbw->nCacheSize);
+        std::string strUsage;
+        info.nMemoryUsage = 0;
+        if (pdbw->pdb->GetProperty("leveldb.approximate-memory-usage", &strUsage))
+            info.nMemoryUsage = atoi64(strUsage);
+        vInfo.push_back(info);
+    }
+    return vInfo;
+}
+
+CDBWrapper::CDBWrapper(const boost::filesystem::path& pathIn, size_t nCacheSizeIn, bool fMemoryIn, bool fWipe, bool obfuscate, const std::string& strNameIn)
+    : strName(strNameIn), path(pathIn), fMemory(fMemoryIn), profile(GetSelectedDBProfile(strNameIn)), nCacheSize(nCacheSizeIn)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(profile, nCacheSize);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -50,7 +176,7 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectory(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (profile %s)\n", path.string(), profile.strName);
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -74,10 +200,17 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(cs_dbwrapper);
+    setOpenDatabases.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(cs_dbwrapper);
+        setOpenDatabases.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -12,6 +12,10 @@
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <set>
+#include <string>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
@@ -26,8 +30,64 @@ public:
     dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+/** Default for -dbprofile */
+static const char* const DEFAULT_DB_PROFILE = "default";
+
+/**
+ * Tuning of a LevelDB database. The cache budget a database is opened with
+ * is split into the block cache and the write buffers, of which LevelDB may
+ * hold two in memory at once.
+ */
+struct CDBProfile
+{
+    std::string strName;
+    //! Share of the cache budget used for the block cache, in percent
+    int nBlockCachePercent;
+    //! Share of the cache budget used for each write buffer, in percent
+    int nWriteBufferPercent;
+    int nMaxOpenFiles;
+    //! Compress tables with Snappy, if LevelDB was built with it
+    bool fCompression;
+    //! Bits per key of the bloom filter, 0 for no filter
+    int nBloomBits;
+    //! Approximate size of the uncompressed data in a table block
+    size_t nBlockSize;
+};
+
+/** Look up a built-in profile by name */
+bool GetDBProfile(const std::string& strName, CDBProfile& profile);
+
+/** Names of the built-in profiles, comma separated, for help messages */
+std::string ListDBProfiles();
+
+/**
+ * Select the profiles databases are opened with, from -dbprofile arguments of
+ * the form <profile> (all databases) or <database>:<profile>. Returns false
+ * and sets strError if an argument names an unknown database or profile.
+ */
+bool SetDBProfiles(const std::vector<std::string>& vArgs, const std::set<std::string>& setDBNames, std::string& strError);
+
+/** The profile a database of the given name is opened with */
+CDBProfile GetSelectedDBProfile(const std::string& strDBName);
+
 class CDBWrapper;
 
+/** Settings and usage of an open database, as reported by getdbinfo */
+struct CDBWrapperInfo
+{
+    std::string strName;
+    std::string strPath;
+    bool fMemory;
+    CDBProfile profile;
+    size_t nCacheSize;
+    size_t nBlockCacheSize;
+    size_t nWriteBufferSize;
+    uint64_t nMemoryUsage;
+};
+
+/** Describe every database that is currently open */
+std::vector<CDBWrapperInfo> ListOpenDatabases();
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -157,7 +217,23 @@ public:
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend std::vector<CDBWrapperInfo> ListOpenDatabases();
 private:
+    //! name the database's profile is selected by
+    std::string strName;
+
+    //! location of the database, for reporting
+    boost::filesystem::path path;
+
+    //! whether leveldb's memory environment is used
+    bool fMemory;
+
+    //! the profile the database was opened with
+    CDBProfile profile;
+
+    //! the cache budget the database was opened with
+    size_t nCacheSize;
+
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
 
@@ -198,8 +274,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] strName     Name used to select the database's profile with -dbprofile.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const std::string& strName = "");
     ~CDBWrapper();
 
     template <typename K, typename V>
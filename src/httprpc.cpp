@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -65,6 +66,8 @@ private:
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static HTTPRPCTimerInterface* httpRPCTimerInterface = 0;
+/* Number of requests of a batch to execute at once */
+static int nRPCBatchParallel = DEFAULT_RPC_BATCH_PARALLEL;
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -147,6 +150,94 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+/** Bytes of a JSON-RPC request looked at to find its method */
+static const size_t RPC_CLASSIFY_PEEK_SIZE = 256;
+
+/** Methods queued apart from the others, by what they cost */
+static const struct {
+    const char* name;
+    HTTPWorkLane lane;
+} rpcMethodLanes[] = {
+    {"getbestblockhash", HTTP_LANE_CHEAP},
+    {"getblockchaininfo", HTTP_LANE_CHEAP},
+    {"getblockcount", HTTP_LANE_CHEAP},
+    {"getblockhash", HTTP_LANE_CHEAP},
+    {"getconnectioncount", HTTP_LANE_CHEAP},
+    {"getdifficulty", HTTP_LANE_CHEAP},
+    {"getinfo", HTTP_LANE_CHEAP},
+    {"getmemoryinfo", HTTP_LANE_CHEAP},
+    {"getmempoolinfo", HTTP_LANE_CHEAP},
+    {"getmininginfo", HTTP_LANE_CHEAP},
+    {"getnettotals", HTTP_LANE_CHEAP},
+    {"getnetworkinfo", HTTP_LANE_CHEAP},
+    {"getrpcqueueinfo", HTTP_LANE_CHEAP},
+    {"help", HTTP_LANE_CHEAP},
+    {"ping", HTTP_LANE_CHEAP},
+    {"stop", HTTP_LANE_CHEAP},
+    {"dumpwallet", HTTP_LANE_EXPENSIVE},
+    {"generate", HTTP_LANE_EXPENSIVE},
+    {"generatetoaddress", HTTP_LANE_EXPENSIVE},
+    {"getaddressbalance", HTTP_LANE_EXPENSIVE},
+    {"getaddressdeltas", HTTP_LANE_EXPENSIVE},
+    {"getaddressutxos", HTTP_LANE_EXPENSIVE},
+    {"getblock", HTTP_LANE_EXPENSIVE},
+    {"getblocktemplate", HTTP_LANE_EXPENSIVE},
+    {"getchaintips", HTTP_LANE_EXPENSIVE},
+    {"getrawmempool", HTTP_LANE_EXPENSIVE},
+    {"gettxoutsetinfo", HTTP_LANE_EXPENSIVE},
+    {"importaddress", HTTP_LANE_EXPENSIVE},
+    {"importmulti", HTTP_LANE_EXPENSIVE},
+    {"importprivkey", HTTP_LANE_EXPENSIVE},
+    {"importpubkey", HTTP_LANE_EXPENSIVE},
+    {"importwallet", HTTP_LANE_EXPENSIVE},
+    {"listsinceblock", HTTP_LANE_EXPENSIVE},
+    {"listtransactions", HTTP_LANE_EXPENSIVE},
+    {"listtxcomments", HTTP_LANE_EXPENSIVE},
+    {"listunspent", HTTP_LANE_EXPENSIVE},
+    {"searchtxcomments", HTTP_LANE_EXPENSIVE},
+    {"verifychain", HTTP_LANE_EXPENSIVE},
+    {"waitforblock", HTTP_LANE_WAIT},
+    {"waitforblockheight", HTTP_LANE_WAIT},
+    {"waitfornewblock", HTTP_LANE_WAIT},
+};
+
+/**
+ * Queue JSON-RPC requests by the cost of their method, found without parsing
+ * the body as this runs on the event loop thread. Batches may hold any number
+ * of calls, so they count as expensive. The body of a request that is not
+ * authorized is not looked at; HTTPReq_JSONRPC rejects it.
+ */
+static HTTPWorkLane ClassifyJSONRPC(HTTPRequest* req, const std::string &)
+{
+    std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
+    std::string strAuthUser;
+    if (req->GetRequestMethod() != HTTPRequest::POST || !authHeader.first || !RPCAuthorized(authHeader.second, strAuthUser))
+        return HTTP_LANE_DEFAULT;
+
+    std::string strBody = req->PeekBody(RPC_CLASSIFY_PEEK_SIZE);
+    size_t nPos = strBody.find_first_not_of(" \t\r\n");
+    if (nPos != std::string::npos && strBody[nPos] == '[')
+        return HTTP_LANE_EXPENSIVE;
+    nPos = strBody.find("\"method\"");
+    if (nPos == std::string::npos)
+        return HTTP_LANE_DEFAULT;
+    nPos = strBody.find_first_not_of(" \t\r\n:", nPos + 8);
+    if (nPos == std::string::npos || strBody[nPos] != '"')
+        return HTTP_LANE_DEFAULT;
+    size_t nEnd = strBody.find('"', nPos + 1);
+    if (nEnd == std::string::npos)
+        return HTTP_LANE_DEFAULT;
+    std::string strMethod = strBody.substr(nPos + 1, nEnd - nPos - 1);
+    // getblocktemplate long polls when given the template it already has
+    if (strMethod == "getblocktemplate" && strBody.find("\"longpollid\"") != std::string::npos)
+        return HTTP_LANE_WAIT;
+    for (unsigned int i = 0; i < ARRAYLEN(rpcMethodLanes); i++) {
+        if (strMethod == rpcMethodLanes[i].name)
+            return rpcMethodLanes[i].lane;
+    }
+    return HTTP_LANE_DEFAULT;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -176,6 +267,9 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
+    // Whether part of a streamed result was sent, after which an error can only
+    // close the connection
+    bool fStreaming = false;
     try {
         // Parse request
         UniValue valRequest;
@@ -190,29 +284,107 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            // Methods with large results send them as they produce them,
+            // within the same reply object as other results
+            CJSONStreamWriter writer([req, &fStreaming](const std::string& strChunk) {
+                if (!fStreaming) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->WriteReplyStart(HTTP_OK);
+                    req->WriteReplyChunk("{\"result\":");
+                    fStreaming = true;
+                }
+                req->WriteReplyChunk(strChunk);
+            });
+            jreq.resultWriter = &writer;
             UniValue result = tableRPC.execute(jreq);
+            if (writer.IsUsed()) {
+                writer.Flush();
+                req->WriteReplyChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                req->WriteReplyEnd();
+                return true;
+            }
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), std::bind(&QueueHTTPWorkIfIdle, std::placeholders::_1, HTTP_LANE_EXPENSIVE), nRPCBatchParallel);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
-        JSONErrorReply(req, objError, jreq.id);
+        if (!fStreaming)
+            JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (const std::exception& e) {
-        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        if (!fStreaming)
+            JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
     return true;
 }
 
+static UniValue getrpcqueueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getrpcqueueinfo\n"
+            "Returns information about the lanes of the queue of RPC and REST requests.\n"
+            "Requests are put in a lane by what they cost, and cheaper lanes are served first.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lane\": \"xxxx\",          (string) The lane: cheap, default, expensive or wait\n"
+            "    \"depth\": n,              (numeric) Number of requests waiting\n"
+            "    \"maxdepth\": n,           (numeric) Number of waiting requests above which new ones are rejected\n"
+            "    \"running\": n,            (numeric) Number of requests being executed\n"
+            "    \"maxrunning\": n,         (numeric) Number of threads the lane may occupy\n"
+            "    \"processed\": n,          (numeric) Number of requests executed\n"
+            "    \"rejected\": n,           (numeric) Number of requests rejected as the lane was full\n"
+            "    \"avgwaittime\": x.xxx,    (numeric) Average time requests waited in the queue, in milliseconds\n"
+            "    \"avgruntime\": x.xxx      (numeric) Average time requests took to execute, in milliseconds\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcqueueinfo", "")
+            + HelpExampleRpc("getrpcqueueinfo", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    std::vector<HTTPWorkLaneStats> vStats = GetHTTPWorkQueueStats();
+    for (unsigned int lane = 0; lane < vStats.size(); lane++) {
+        const HTTPWorkLaneStats& stats = vStats[lane];
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lane", GetHTTPWorkLaneName((HTTPWorkLane)lane)));
+        obj.push_back(Pair("depth", (uint64_t)stats.depth));
+        obj.push_back(Pair("maxdepth", (uint64_t)stats.maxDepth));
+        obj.push_back(Pair("running", stats.running));
+        obj.push_back(Pair("maxrunning", stats.maxRunning));
+        obj.push_back(Pair("processed", stats.processed));
+        obj.push_back(Pair("rejected", stats.rejected));
+        obj.push_back(Pair("avgwaittime", stats.processed ? stats.totalWaitMicros / 1000.0 / stats.processed : 0.0));
+        obj.push_back(Pair("avgruntime", stats.processed ? stats.totalRunMicros / 1000.0 / stats.processed : 0.0));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static const CRPCCommand commands[] =
+{ //  category              name                      actor (function)         okSafeMode
+  //  --------------------- ------------------------  -----------------------  ----------
+    { "control",            "getrpcqueueinfo",        &getrpcqueueinfo,        true,  {} },
+};
+
+void RegisterHTTPRPCCommands(CRPCTable &t)
+{
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
+        t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+}
+
 static bool InitRPCAuthentication()
 {
     if (GetArg("-rpcpassword", "") == "")
@@ -237,7 +409,8 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    nRPCBatchParallel = std::max((int)GetArg("-rpcbatchparallel", DEFAULT_RPC_BATCH_PARALLEL), 1);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, ClassifyJSONRPC);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
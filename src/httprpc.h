@@ -8,8 +8,17 @@
 #include <string>
 #include <map>
 
+class CRPCTable;
 class HTTPRequest;
 
+/** Default for -rpcbatchparallel, the number of read-only requests of a JSON-RPC batch executed at once */
+static const int DEFAULT_RPC_BATCH_PARALLEL = 1;
+
+/** Register the RPC commands reporting on the HTTP server.
+ * Precondition; RPC has not been started yet.
+ */
+void RegisterHTTPRPCCommands(CRPCTable &t);
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "httpserver.h"
+#include "httpworkqueue.h"
 
 #include "chainparamsbase.h"
 #include "compat.h"
@@ -19,12 +20,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <atomic>
 #include <future>
 
 #include <event2/event.h>
 #include <event2/http.h>
 #include <event2/thread.h>
 #include <event2/buffer.h>
+#include <event2/bufferevent.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
 
@@ -58,113 +61,33 @@ private:
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
- */
-template <typename WorkItem>
-class WorkQueue
+/** Work item running an arbitrary function */
+class HTTPFunctionWorkItem : public HTTPClosure
 {
-private:
-    /** Mutex protects entire object */
-    std::mutex cs;
-    std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
-    bool running;
-    size_t maxDepth;
-    int numThreads;
-
-    /** RAII object to keep track of number of running worker threads */
-    class ThreadCounter
-    {
-    public:
-        WorkQueue &wq;
-        ThreadCounter(WorkQueue &w): wq(w)
-        {
-            std::lock_guard<std::mutex> lock(wq.cs);
-            wq.numThreads += 1;
-        }
-        ~ThreadCounter()
-        {
-            std::lock_guard<std::mutex> lock(wq.cs);
-            wq.numThreads -= 1;
-            wq.cond.notify_all();
-        }
-    };
-
 public:
-    WorkQueue(size_t _maxDepth) : running(true),
-                                 maxDepth(_maxDepth),
-                                 numThreads(0)
-    {
-    }
-    /** Precondition: worker threads have all stopped
-     * (call WaitExit)
-     */
-    ~WorkQueue()
-    {
-    }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    HTTPFunctionWorkItem(const std::function<void(void)>& _func): func(_func)
     {
-        std::unique_lock<std::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
-            return false;
-        }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
-        cond.notify_one();
-        return true;
-    }
-    /** Thread function */
-    void Run()
-    {
-        ThreadCounter count(*this);
-        while (true) {
-            std::unique_ptr<WorkItem> i;
-            {
-                std::unique_lock<std::mutex> lock(cs);
-                while (running && queue.empty())
-                    cond.wait(lock);
-                if (!running)
-                    break;
-                i = std::move(queue.front());
-                queue.pop_front();
-            }
-            (*i)();
-        }
-    }
-    /** Interrupt and exit loops */
-    void Interrupt()
-    {
-        std::unique_lock<std::mutex> lock(cs);
-        running = false;
-        cond.notify_all();
     }
-    /** Wait for worker threads to exit */
-    void WaitExit()
+    void operator()()
     {
-        std::unique_lock<std::mutex> lock(cs);
-        while (numThreads > 0)
-            cond.wait(lock);
+        func();
     }
 
-    /** Return current depth of queue */
-    size_t Depth()
-    {
-        std::unique_lock<std::mutex> lock(cs);
-        return queue.size();
-    }
+private:
+    std::function<void(void)> func;
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler):
-        prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler, HTTPRequestClassifier _classifier):
+        prefix(_prefix), exactMatch(_exactMatch), handler(_handler), classifier(_classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
 };
 
 /** HTTP module state */
@@ -284,12 +207,13 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkLane lane = i->classifier ? i->classifier(hreq.get(), path) : HTTP_LANE_DEFAULT;
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (workQueue->Enqueue(item.get(), lane))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            LogPrintf("WARNING: request rejected because http work queue depth exceeded for %s requests, it can be increased with the -rpcworkqueue= setting\n", GetHTTPWorkLaneName(lane));
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
     } else {
@@ -297,6 +221,38 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
     }
 }
 
+bool QueueHTTPWorkIfIdle(const std::function<void(void)>& func, HTTPWorkLane lane)
+{
+    if (!workQueue)
+        return false;
+    std::unique_ptr<HTTPFunctionWorkItem> item(new HTTPFunctionWorkItem(func));
+    if (!workQueue->EnqueueIfIdle(item.get(), lane))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
+std::string GetHTTPWorkLaneName(HTTPWorkLane lane)
+{
+    switch (lane) {
+    case HTTP_LANE_CHEAP: return "cheap";
+    case HTTP_LANE_DEFAULT: return "default";
+    case HTTP_LANE_EXPENSIVE: return "expensive";
+    case HTTP_LANE_WAIT: return "wait";
+    default: return "unknown";
+    }
+}
+
+std::vector<HTTPWorkLaneStats> GetHTTPWorkQueueStats()
+{
+    std::vector<HTTPWorkLaneStats> vStats;
+    if (!workQueue)
+        return vStats;
+    for (int lane = 0; lane < HTTP_LANE_COUNT; lane++)
+        vStats.push_back(workQueue->GetStats((HTTPWorkLane)lane));
+    return vStats;
+}
+
 /** Callback to reject HTTP requests after shutdown. */
 static void http_reject_request_cb(struct evhttp_request* req, void*)
 {
@@ -539,13 +495,63 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+
+/** Progress of a chunked reply, shared by the worker producing it and the http thread sending it */
+struct HTTPReplyStream
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Bytes passed to the http thread (guarded by cs)
+    uint64_t nQueued;
+    //! Bytes the http thread handed to the connection (http thread only)
+    uint64_t nHanded;
+    //! Bytes written out to the client (guarded by cs)
+    uint64_t nWritten;
+    //! Whether the connection went away (guarded by cs)
+    bool fClosed;
+
+    HTTPReplyStream() : nQueued(0), nHanded(0), nWritten(0), fClosed(false) {}
+
+    void SetWritten()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        nWritten = nHanded;
+        cond.notify_all();
+    }
+
+    void SetClosed()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fClosed = true;
+        cond.notify_all();
+    }
+};
+
+/** Called by libevent once the output buffer of a connection has been written out */
+static void http_reply_chunk_written(struct evhttp_connection* evcon, void* arg)
+{
+    ((HTTPReplyStream*)arg)->SetWritten();
+}
+
+static void http_reply_stream_closed(struct evhttp_connection* evcon, void* arg)
+{
+    ((HTTPReplyStream*)arg)->SetClosed();
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyStarted(false),
+                                                       replyStatus(0)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyStream && !replySent) {
+        // The handler failed halfway. Ending the body would make the part
+        // sent look complete, so drop the connection instead.
+        LogPrintf("%s: Unfinished reply, closing connection\n", __func__);
+        WriteReplyAbort();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -553,6 +559,17 @@ HTTPRequest::~HTTPRequest()
     // evhttpd cleans up the request, as long as a reply was sent.
 }
 
+std::string HTTPRequest::PeekBody(size_t nMaxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    std::string strBody(std::min(evbuffer_get_length(buf), nMaxSize), '\0');
+    if (!strBody.empty())
+        evbuffer_copyout(buf, &strBody[0], strBody.size());
+    return strBody;
+}
+
 std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string& hdr)
 {
     const struct evkeyvalq* headers = evhttp_request_get_input_headers(req);
@@ -598,7 +615,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyStream && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -610,6 +627,119 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !replyStarted && req);
+    replyStatus = nStatus;
+    replyStarted = true;
+}
+
+static void http_send_reply_start(std::shared_ptr<HTTPReplyStream> stream, struct evhttp_request* req, int nStatus)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (!evcon) {
+        stream->SetClosed();
+        return;
+    }
+    // Unblock the worker if the client goes away before the body is complete
+    evhttp_connection_set_closecb(evcon, http_reply_stream_closed, stream.get());
+    evhttp_send_reply_start(req, nStatus, (const char*)NULL);
+}
+
+void HTTPRequest::SendReplyStart()
+{
+    if (replyStream)
+        return;
+    replyStream = std::make_shared<HTTPReplyStream>();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_send_reply_start, replyStream, req, replyStatus));
+    ev->trigger(0);
+}
+
+static void http_send_reply_chunk(std::shared_ptr<HTTPReplyStream> stream, struct evhttp_request* req, struct evbuffer* evb)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (!evcon) {
+        evbuffer_free(evb);
+        stream->SetClosed();
+        return;
+    }
+    stream->nHanded += evbuffer_get_length(evb);
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+    evhttp_send_reply_chunk_with_cb(req, evb, http_reply_chunk_written, stream.get());
+    // Nothing was queued if the reply has no body, as for HEAD requests
+    if (evbuffer_get_length(bufferevent_get_output(evhttp_connection_get_bufferevent(evcon))) == 0)
+        stream->SetWritten();
+#else
+    // No notification when the data is written out, so no flow control
+    evhttp_send_reply_chunk(req, evb);
+    stream->SetWritten();
+#endif
+    evbuffer_free(evb);
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(replyStarted && !replySent && req);
+    if (strChunk.empty())
+        return; // An empty chunk would end the body
+    SendReplyStart();
+    {
+        std::unique_lock<std::mutex> lock(replyStream->cs);
+        while (!replyStream->fClosed && replyStream->nQueued - replyStream->nWritten > HTTP_REPLY_STREAM_WINDOW)
+            replyStream->cond.wait(lock);
+        if (replyStream->fClosed)
+            return; // Nobody to send it to
+        replyStream->nQueued += strChunk.size();
+    }
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    // Events triggered from this thread run in order on the main http thread
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_send_reply_chunk, replyStream, req, evb));
+    ev->trigger(0);
+}
+
+static void http_send_reply_end(std::shared_ptr<HTTPReplyStream> stream, struct evhttp_request* req)
+{
+    // The stream goes away with this event
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon)
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+    evhttp_send_reply_end(req);
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(replyStarted && !replySent && req);
+    SendReplyStart();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_send_reply_end, replyStream, req));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+static void http_abort_reply(std::shared_ptr<HTTPReplyStream> stream, struct evhttp_request* req)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon) {
+        // Frees the request along with the connection
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+        evhttp_connection_free(evcon);
+    } else {
+        // Only frees the request, which outlived its connection
+        evhttp_send_reply_end(req);
+    }
+}
+
+void HTTPRequest::WriteReplyAbort()
+{
+    assert(replyStream && !replySent && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_abort_reply, replyStream, req));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -650,10 +780,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -8,15 +8,20 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
+#include <vector>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Bytes of a chunked reply that may wait to be written to a client before WriteReplyChunk blocks */
+static const size_t HTTP_REPLY_STREAM_WINDOW = 256 * 1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyStream;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -32,16 +37,57 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Lanes of the HTTP work queue, from the first served to the last */
+enum HTTPWorkLane
+{
+    HTTP_LANE_CHEAP,
+    HTTP_LANE_DEFAULT,
+    HTTP_LANE_EXPENSIVE,
+    //! Requests that block until an event, such as long polls
+    HTTP_LANE_WAIT,
+    HTTP_LANE_COUNT
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Returns the work queue lane for a request to a handler's path. It runs
+ * on the event loop thread, so it must be quick and not consume the body.
+ */
+typedef std::function<HTTPWorkLane(HTTPRequest* req, const std::string &)> HTTPRequestClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Requests are queued in the lane chosen by classifier, or
+ * HTTP_LANE_DEFAULT without one.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier = HTTPRequestClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Queue func to run on an HTTP worker thread, in lane, provided one is idle
+ * so that it neither waits nor holds up requests. Returns whether func was
+ * queued.
+ */
+bool QueueHTTPWorkIfIdle(const std::function<void(void)>& func, HTTPWorkLane lane);
+
+/** Counters of a lane of the HTTP work queue */
+struct HTTPWorkLaneStats
+{
+    size_t depth;
+    size_t maxDepth;
+    int running;
+    int maxRunning;
+    uint64_t processed;
+    uint64_t rejected;
+    int64_t totalWaitMicros;
+    int64_t totalRunMicros;
+};
+
+std::string GetHTTPWorkLaneName(HTTPWorkLane lane);
+/** Return the counters of each lane of the HTTP work queue, or nothing if
+ * the HTTP server is not running.
+ */
+std::vector<HTTPWorkLaneStats> GetHTTPWorkQueueStats();
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -55,6 +101,15 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyStarted;
+    //! Status of a chunked reply, sent along with its first chunk
+    int replyStatus;
+    //! Flow control of a chunked reply once it is being sent
+    std::shared_ptr<HTTPReplyStream> replyStream;
+
+    void SendReplyStart();
+    /** Give up a chunked reply that was not completed */
+    void WriteReplyAbort();
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -86,6 +141,11 @@ public:
      */
     std::pair<bool, std::string> GetHeader(const std::string& hdr);
 
+    /**
+     * Get up to nMaxSize bytes of the request body, leaving it to be read.
+     */
+    std::string PeekBody(size_t nMaxSize);
+
     /**
      * Read request body.
      *
@@ -110,6 +170,36 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for a body produced piece by piece.
+     * nStatus is the HTTP status code to send. The body is then sent with
+     * WriteReplyChunk and completed with WriteReplyEnd. Nothing is sent
+     * before the first chunk, so until then a failure can still be answered
+     * with WriteReply.
+     *
+     * If the request is destroyed after the first chunk but before
+     * WriteReplyEnd, the connection is closed rather than the body ended, so
+     * that the client cannot take a truncated body for a complete one.
+     *
+     * @note call WriteHeader before, and not after.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Send the next piece of a reply started with WriteReplyStart. Blocks
+     * while more than HTTP_REPLY_STREAM_WINDOW bytes sent before are still
+     * waiting to be written to the client.
+     */
+    void WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Complete a reply started with WriteReplyStart.
+     *
+     * @note As this will give the request back to the main thread, do not
+     * call any other HTTPRequest methods after calling this.
+     */
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
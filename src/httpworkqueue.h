@@ -0,0 +1,277 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_HTTPWORKQUEUE_H
+#define BITCOIN_HTTPWORKQUEUE_H
+
+#include "httpserver.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+/** Work queue for distributing work over multiple threads.
+ * Work items are simply callable objects, queued in one lane per
+ * HTTPWorkLane. Each lane has its own lock and depth limit, and workers take
+ * items from the cheapest lane first. All lanes but the cheap one may
+ * together only occupy all threads but one, so that no number of expensive
+ * or blocking requests can hold up cheap ones, and expensive requests are
+ * held to half of the threads.
+ */
+template <typename WorkItem>
+class WorkQueue
+{
+private:
+    struct Lane
+    {
+        /** Mutex protects queue, and changes to depth and numRunning */
+        std::mutex cs;
+        /** Items with the time they were queued, in microseconds */
+        std::deque<std::pair<std::unique_ptr<WorkItem>, int64_t>> queue;
+        std::atomic<size_t> depth;
+        std::atomic<int> numRunning;
+        std::atomic<uint64_t> numProcessed;
+        std::atomic<uint64_t> numRejected;
+        std::atomic<int64_t> totalWaitMicros;
+        std::atomic<int64_t> totalRunMicros;
+
+        Lane(): depth(0), numRunning(0), numProcessed(0), numRejected(0), totalWaitMicros(0), totalRunMicros(0)
+        {
+        }
+    };
+
+    Lane lanes[HTTP_LANE_COUNT];
+    size_t maxDepth;
+    std::atomic<bool> running;
+    std::atomic<int> numThreads;
+    /** Number of threads executing an item */
+    std::atomic<int> numBusy;
+    /** Number of threads executing an item of any lane but the cheap one */
+    std::atomic<int> numBusyShared;
+    /** Mutex lets idle threads wait for items without missing any */
+    std::mutex csWake;
+    std::condition_variable cond;
+
+    /** RAII object to keep track of number of running worker threads */
+    class ThreadCounter
+    {
+    public:
+        WorkQueue &wq;
+        ThreadCounter(WorkQueue &w): wq(w)
+        {
+            std::lock_guard<std::mutex> lock(wq.csWake);
+            wq.numThreads += 1;
+        }
+        ~ThreadCounter()
+        {
+            std::lock_guard<std::mutex> lock(wq.csWake);
+            wq.numThreads -= 1;
+            wq.cond.notify_all();
+        }
+    };
+
+    /** Number of threads that may execute items of a lane at once */
+    int MaxRunning(int nLane) const
+    {
+        int n = numThreads;
+        if (nLane == HTTP_LANE_CHEAP)
+            return n;
+        if (nLane == HTTP_LANE_EXPENSIVE)
+            return std::max(n / 2, 1);
+        return MaxShared();
+    }
+
+    /** Number of threads that may execute items of the lanes other than the cheap one at once */
+    int MaxShared() const
+    {
+        return std::max(numThreads - 1, 1);
+    }
+
+    static bool IsShared(int nLane)
+    {
+        return nLane != HTTP_LANE_CHEAP;
+    }
+
+    bool IsRunnable(int nLane) const
+    {
+        if (lanes[nLane].depth == 0 || lanes[nLane].numRunning >= MaxRunning(nLane))
+            return false;
+        return !IsShared(nLane) || numBusyShared < MaxShared();
+    }
+
+    bool HasRunnable() const
+    {
+        for (int nLane = 0; nLane < HTTP_LANE_COUNT; nLane++) {
+            if (IsRunnable(nLane))
+                return true;
+        }
+        return false;
+    }
+
+    /** Claim a thread of those shared by the lanes other than the cheap one */
+    bool ClaimShared()
+    {
+        int n = numBusyShared;
+        while (n < MaxShared()) {
+            if (numBusyShared.compare_exchange_weak(n, n + 1))
+                return true;
+        }
+        return false;
+    }
+
+    void WakeOne()
+    {
+        {
+            std::lock_guard<std::mutex> lock(csWake);
+        }
+        cond.notify_one();
+    }
+
+    /** Take the next item to run, returning its lane or -1 if there is none */
+    int Take(std::unique_ptr<WorkItem>& item, int64_t& nTimeQueued)
+    {
+        for (int nLane = 0; nLane < HTTP_LANE_COUNT; nLane++) {
+            Lane& lane = lanes[nLane];
+            if (lane.depth == 0)
+                continue;
+            std::lock_guard<std::mutex> lock(lane.cs);
+            if (lane.queue.empty() || lane.numRunning >= MaxRunning(nLane))
+                continue;
+            if (IsShared(nLane) && !ClaimShared())
+                continue;
+            item = std::move(lane.queue.front().first);
+            nTimeQueued = lane.queue.front().second;
+            lane.queue.pop_front();
+            lane.depth -= 1;
+            lane.numRunning += 1;
+            return nLane;
+        }
+        return -1;
+    }
+
+public:
+    WorkQueue(size_t _maxDepth) : maxDepth(_maxDepth),
+                                 running(true),
+                                 numThreads(0),
+                                 numBusy(0),
+                                 numBusyShared(0)
+    {
+    }
+    /** Precondition: worker threads have all stopped
+     * (call WaitExit)
+     */
+    ~WorkQueue()
+    {
+    }
+    /** Enqueue a work item */
+    bool Enqueue(WorkItem* item, HTTPWorkLane nLane)
+    {
+        Lane& lane = lanes[nLane];
+        {
+            std::lock_guard<std::mutex> lock(lane.cs);
+            if (lane.queue.size() >= maxDepth) {
+                lane.numRejected += 1;
+                return false;
+            }
+            lane.queue.emplace_back(std::unique_ptr<WorkItem>(item), GetTimeMicros());
+            lane.depth += 1;
+        }
+        WakeOne();
+        return true;
+    }
+    /** Enqueue a work item only if a thread is idle to pick it up right away */
+    bool EnqueueIfIdle(WorkItem* item, HTTPWorkLane nLane)
+    {
+        if (!running)
+            return false;
+        size_t nQueued = 0;
+        for (int i = 0; i < HTTP_LANE_COUNT; i++)
+            nQueued += lanes[i].depth;
+        if (nQueued + numBusy >= (size_t)numThreads)
+            return false;
+        if (IsShared(nLane) && numBusyShared >= MaxShared())
+            return false;
+        Lane& lane = lanes[nLane];
+        {
+            std::lock_guard<std::mutex> lock(lane.cs);
+            if (lane.queue.size() + lane.numRunning >= (size_t)MaxRunning(nLane))
+                return false;
+            lane.queue.emplace_back(std::unique_ptr<WorkItem>(item), GetTimeMicros());
+            lane.depth += 1;
+        }
+        WakeOne();
+        return true;
+    }
+    /** Thread function */
+    void Run()
+    {
+        ThreadCounter count(*this);
+        while (running) {
+            std::unique_ptr<WorkItem> i;
+            int64_t nTimeQueued;
+            int nLane = Take(i, nTimeQueued);
+            if (nLane < 0) {
+                std::unique_lock<std::mutex> lock(csWake);
+                while (running && !HasRunnable())
+                    cond.wait(lock);
+                continue;
+            }
+            numBusy += 1;
+            int64_t nTimeStart = GetTimeMicros();
+            (*i)();
+            i.reset();
+            Lane& lane = lanes[nLane];
+            lane.totalWaitMicros += nTimeStart - nTimeQueued;
+            lane.totalRunMicros += GetTimeMicros() - nTimeStart;
+            lane.numProcessed += 1;
+            {
+                std::lock_guard<std::mutex> lock(lane.cs);
+                lane.numRunning -= 1;
+            }
+            if (IsShared(nLane))
+                numBusyShared -= 1;
+            numBusy -= 1;
+            // Another thread may have left an item for the capacity freed
+            if (HasRunnable())
+                WakeOne();
+        }
+    }
+    /** Interrupt and exit loops */
+    void Interrupt()
+    {
+        std::unique_lock<std::mutex> lock(csWake);
+        running = false;
+        cond.notify_all();
+    }
+    /** Wait for worker threads to exit */
+    void WaitExit()
+    {
+        std::unique_lock<std::mutex> lock(csWake);
+        while (numThreads > 0)
+            cond.wait(lock);
+    }
+
+    /** Return the counters of a lane */
+    HTTPWorkLaneStats GetStats(HTTPWorkLane nLane)
+    {
+        const Lane& lane = lanes[nLane];
+        HTTPWorkLaneStats stats;
+        stats.depth = lane.depth;
+        stats.maxDepth = maxDepth;
+        stats.running = lane.numRunning;
+        stats.maxRunning = MaxRunning(nLane);
+        stats.processed = lane.numProcessed;
+        stats.rejected = lane.numRejected;
+        stats.totalWaitMicros = lane.totalWaitMicros;
+        stats.totalRunMicros = lane.totalRunMicros;
+        return stats;
+    }
+};
+
+#endif // BITCOIN_HTTPWORKQUEUE_H
@@ -0,0 +1,34 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/addressindex.h"
+
+#include "chain.h"
+#include "undo.h"
+#include "validation.h"
+
+std::unique_ptr<CAddressIndex> g_addressindex;
+
+CAddressIndex::CAddressIndex(size_t nCacheSize, bool fMemory, bool fWipe) : db(new CAddressIndexDB(nCacheSize, fMemory, fWipe))
+{
+}
+
+bool CAddressIndex::WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex)
+{
+    // Like ConnectBlock, skip the genesis block, whose outputs are unspendable
+    if (!pindex->pprev)
+        return true;
+
+    CBlockUndo blockundo;
+    if (!UndoReadFromDisk(blockundo, pindex))
+        return false;
+    return db->WriteBlock(batch, block, blockundo, pindex->nHeight);
+}
+
+bool CAddressIndex::EraseBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex)
+{
+    if (!pindex->pprev)
+        return true;
+    return db->EraseBlock(batch, block, pindex->nHeight);
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEX_H
+#define BITCOIN_INDEX_ADDRESSINDEX_H
+
+#include "index/base.h"
+#include "txdb.h"
+
+#include <memory>
+
+/** The address and spent output index (-addressindex), see CAddressIndexDB */
+class CAddressIndex : public CBaseIndex
+{
+private:
+    const std::unique_ptr<CAddressIndexDB> db;
+
+protected:
+    const char* GetName() const override { return "addressindex"; }
+    bool WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) override;
+    bool EraseBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) override;
+
+public:
+    CAddressIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    CAddressIndexDB& GetDB() const override { return *db; }
+};
+
+/** The address index, if -addressindex */
+extern std::unique_ptr<CAddressIndex> g_addressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEX_H
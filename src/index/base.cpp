@@ -0,0 +1,192 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/base.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+/** Interval between progress messages while an index catches up (seconds) */
+static const int64_t INDEX_SYNC_LOG_INTERVAL = 30;
+
+CBaseIndex::CBaseIndex() : fSynced(false), pbestBlockIndex(NULL), fTipChanged(false)
+{
+}
+
+CBaseIndex::~CBaseIndex()
+{
+    Stop();
+}
+
+bool CBaseIndex::Start()
+{
+    CBlockLocator locator;
+    if (!GetDB().ReadBestBlock(locator))
+        locator.SetNull();
+
+    {
+        LOCK(cs_main);
+        if (!locator.IsNull()) {
+            // Resume from the block that was indexed last, even if it has
+            // left the active chain since, so that it is erased again.
+            BlockMap::iterator it = mapBlockIndex.find(locator.vHave.front());
+            if (it == mapBlockIndex.end())
+                return error("%s: best block of the %s is not in the block index", __func__, GetName());
+            pbestBlockIndex = it->second;
+        }
+    }
+
+    RegisterValidationInterface(this);
+    threadSync = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, GetName(), boost::function<void()>(boost::bind(&CBaseIndex::ThreadSync, this))));
+    return true;
+}
+
+void CBaseIndex::Interrupt()
+{
+    threadSync.interrupt();
+}
+
+void CBaseIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+    if (threadSync.joinable()) {
+        threadSync.interrupt();
+        threadSync.join();
+    }
+}
+
+int CBaseIndex::GetBestHeight() const
+{
+    const CBlockIndex* pindex = pbestBlockIndex;
+    return pindex ? pindex->nHeight : -1;
+}
+
+void CBaseIndex::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    boost::unique_lock<boost::mutex> lock(csSync);
+    fTipChanged = true;
+    condSync.notify_all();
+}
+
+bool CBaseIndex::Commit(CDBBatch& batch, const CBlockIndex* pindex, const CBlockLocator& locator)
+{
+    GetDB().WriteBestBlock(batch, locator);
+    if (!GetDB().WriteBatch(batch))
+        return false;
+
+    boost::unique_lock<boost::mutex> lock(csSync);
+    pbestBlockIndex = pindex;
+    condSync.notify_all();
+    return true;
+}
+
+void CBaseIndex::ThreadSync()
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    int64_t nLastLog = 0;
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindex = pbestBlockIndex;
+        const CBlockIndex* pindexNext = NULL;
+        bool fRewind = false;
+        CBlockLocator locator;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindexTip = chainActive.Tip();
+            if (pindex && !chainActive.Contains(pindex)) {
+                // Either the block was disconnected, and is erased here one
+                // block at a time, or the active chain is still catching up
+                // with the index (as with -reindex-chainstate).
+                if (pindexTip && pindex->GetAncestor(pindexTip->nHeight) != pindexTip) {
+                    fRewind = true;
+                    if (pindex->pprev)
+                        locator = chainActive.GetLocator(pindex->pprev);
+                }
+            } else {
+                pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+                if (pindexNext)
+                    locator = chainActive.GetLocator(pindexNext);
+                else if (!fSynced) {
+                    fSynced = true;
+                    LogPrintf("%s is enabled at height %d\n", GetName(), pindex ? pindex->nHeight : -1);
+                }
+            }
+        }
+
+        if (fRewind) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, consensusParams)) {
+                error("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+                break;
+            }
+            CDBBatch batch(GetDB());
+            if (!EraseBlock(batch, block, pindex) || !Commit(batch, pindex->pprev, locator)) {
+                error("%s: failed to erase block %s from the %s", __func__, pindex->GetBlockHash().ToString(), GetName());
+                break;
+            }
+            continue;
+        }
+
+        if (!pindexNext) {
+            // Wait for the next block, or for the active chain to catch up
+            boost::unique_lock<boost::mutex> lock(csSync);
+            condSync.notify_all();
+            while (!fTipChanged)
+                condSync.wait(lock);
+            fTipChanged = false;
+            continue;
+        }
+
+        if (!fSynced && GetTime() - nLastLog >= INDEX_SYNC_LOG_INTERVAL) {
+            LogPrintf("Syncing %s with block chain from height %d\n", GetName(), pindexNext->nHeight);
+            nLastLog = GetTime();
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindexNext, consensusParams)) {
+            error("%s: failed to read block %s from disk", __func__, pindexNext->GetBlockHash().ToString());
+            break;
+        }
+        CDBBatch batch(GetDB());
+        if (!WriteBlock(batch, block, pindexNext) || !Commit(batch, pindexNext, locator)) {
+            error("%s: failed to write block %s to the %s", __func__, pindexNext->GetBlockHash().ToString(), GetName());
+            break;
+        }
+    }
+
+    // Fail anyone waiting for the index rather than let them wait forever
+    LogPrintf("%s: %s sync stopped at height %d\n", __func__, GetName(), GetBestHeight());
+    boost::unique_lock<boost::mutex> lock(csSync);
+    fSynced = false;
+    condSync.notify_all();
+}
+
+bool CBaseIndex::BlockUntilSyncedToCurrentChain()
+{
+    while (true) {
+        const CBlockIndex* pindexTip;
+        {
+            LOCK(cs_main);
+            pindexTip = chainActive.Tip();
+        }
+
+        boost::unique_lock<boost::mutex> lock(csSync);
+        if (!fSynced)
+            return false;
+        const CBlockIndex* pindexBest = pbestBlockIndex;
+        if (!pindexTip || (pindexBest && pindexBest->GetAncestor(pindexTip->nHeight) == pindexTip))
+            return true;
+        // Woken by index progress and by new tips, after which the tip is read again
+        condSync.wait(lock);
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BASE_H
+#define BITCOIN_INDEX_BASE_H
+
+#include "validationinterface.h"
+
+#include <atomic>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CDBBatch;
+class CIndexDB;
+struct CBlockLocator;
+
+/**
+ * Base class for optional indexes that are built in the background.
+ *
+ * An index follows the active chain on its own thread: it catches up from
+ * the blocks on disk, and is woken by UpdatedBlockTip to index new blocks
+ * after they have been connected, so that index writes are not on the block
+ * validation path. On a reorganization it erases the disconnected blocks
+ * before indexing the new ones. The locator of the last block indexed is
+ * stored with the index, so an index can be enabled, disabled and enabled
+ * again without a reindex.
+ */
+class CBaseIndex : public CValidationInterface
+{
+private:
+    /** Whether the index has caught up with the active chain since it was started */
+    std::atomic<bool> fSynced;
+    /** The last block the index is in sync with; may be off the active chain until it is rewound */
+    std::atomic<const CBlockIndex*> pbestBlockIndex;
+
+    boost::thread threadSync;
+    /** Protects fTipChanged; condSync is signalled on new tips and on index progress */
+    boost::mutex csSync;
+    boost::condition_variable condSync;
+    bool fTipChanged;
+
+    void ThreadSync();
+    /** Write batch, and move the best block of the index to pindex */
+    bool Commit(CDBBatch& batch, const CBlockIndex* pindex, const CBlockLocator& locator);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+    virtual CIndexDB& GetDB() const = 0;
+    /** Name of the index, for log messages and the sync thread */
+    virtual const char* GetName() const = 0;
+    /** Add the entries of a block being connected to batch */
+    virtual bool WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) = 0;
+    /** Remove the entries of a block being disconnected in batch */
+    virtual bool EraseBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) = 0;
+
+public:
+    CBaseIndex();
+    virtual ~CBaseIndex();
+
+    /** Load the best block of the index, and start syncing it in the background. */
+    bool Start();
+    void Interrupt();
+    void Stop();
+
+    bool IsSynced() const { return fSynced; }
+    /** The height of the last block indexed, or -1 */
+    int GetBestHeight() const;
+
+    /**
+     * Wait until the index has indexed the current tip of the active chain.
+     * Returns false immediately if the index has not caught up with the
+     * chain since startup. Must not be called with cs_main held.
+     */
+    bool BlockUntilSyncedToCurrentChain();
+};
+
+#endif // BITCOIN_INDEX_BASE_H
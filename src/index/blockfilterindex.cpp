@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/blockfilterindex.h"
+
+#include "chain.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+CBlockFilterIndex::CBlockFilterIndex(size_t nCacheSize, bool fMemory, bool fWipe) : db(new CBlockFilterDB(nCacheSize, fMemory, fWipe))
+{
+}
+
+bool CBlockFilterIndex::WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block has no undo data, and its header chains from zero
+    CBlockUndo blockundo;
+    uint256 prevHeader;
+    if (pindex->pprev) {
+        if (!UndoReadFromDisk(blockundo, pindex))
+            return false;
+        CBlockFilterEntry prevEntry;
+        if (!db->ReadFilter(pindex->pprev->GetBlockHash(), prevEntry))
+            return error("%s: filter of the previous block %s is missing", __func__, pindex->pprev->GetBlockHash().ToString());
+        prevHeader = prevEntry.header;
+    }
+
+    BlockFilter filter(BLOCK_FILTER_BASIC, block, blockundo);
+    CBlockFilterEntry entry;
+    entry.filterHash = filter.GetHash();
+    entry.header = filter.ComputeHeader(prevHeader);
+    entry.vchFilter = filter.GetEncodedFilter();
+    db->WriteFilter(batch, pindex->GetBlockHash(), entry);
+    return true;
+}
+
+bool CBlockFilterIndex::EraseBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex)
+{
+    db->EraseFilter(batch, pindex->GetBlockHash());
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const
+{
+    CBlockFilterEntry entry;
+    if (!db->ReadFilter(pindex->GetBlockHash(), entry))
+        return false;
+    try {
+        filter = BlockFilter(BLOCK_FILTER_BASIC, pindex->GetBlockHash(), std::move(entry.vchFilter));
+    } catch (const std::exception& e) {
+        return error("%s: filter of block %s is corrupt: %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const
+{
+    CBlockFilterEntry entry;
+    if (!db->ReadFilter(pindex->GetBlockHash(), entry))
+        return false;
+    header = entry.header;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pstop, std::vector<BlockFilter>& vFilters) const
+{
+    if (nStartHeight < 0 || nStartHeight > pstop->nHeight)
+        return false;
+    vFilters.resize(pstop->nHeight - nStartHeight + 1);
+    for (const CBlockIndex* pindex = pstop; pindex && pindex->nHeight >= nStartHeight; pindex = pindex->pprev) {
+        if (!LookupFilter(pindex, vFilters[pindex->nHeight - nStartHeight]))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pstop, std::vector<uint256>& vHashes) const
+{
+    if (nStartHeight < 0 || nStartHeight > pstop->nHeight)
+        return false;
+    vHashes.resize(pstop->nHeight - nStartHeight + 1);
+    for (const CBlockIndex* pindex = pstop; pindex && pindex->nHeight >= nStartHeight; pindex = pindex->pprev) {
+        CBlockFilterEntry entry;
+        if (!db->ReadFilter(pindex->GetBlockHash(), entry))
+            return false;
+        vHashes[pindex->nHeight - nStartHeight] = entry.filterHash;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKFILTERINDEX_H
+#define BITCOIN_INDEX_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "index/base.h"
+#include "txdb.h"
+
+#include <memory>
+
+/** Interval between filter headers served in cfcheckpt messages */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * The basic block filter index (-blockfilterindex), see CBlockFilterDB.
+ * Filters are built once, as blocks are connected, and then served from the
+ * index to RPC clients and to peers.
+ */
+class CBlockFilterIndex : public CBaseIndex
+{
+private:
+    const std::unique_ptr<CBlockFilterDB> db;
+
+protected:
+    const char* GetName() const override { return "blockfilterindex"; }
+    bool WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) override;
+    bool EraseBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) override;
+
+public:
+    CBlockFilterIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    CBlockFilterDB& GetDB() const override { return *db; }
+
+    /** Get the filter of a block. Returns false if the block has not been indexed. */
+    bool LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const;
+    /** Get the filter header of a block */
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const;
+    /** Get the filters of the ancestors of pstop from nStartHeight up to pstop itself */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pstop, std::vector<BlockFilter>& vFilters) const;
+    /** Get the filter hashes of the ancestors of pstop from nStartHeight up to pstop itself */
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pstop, std::vector<uint256>& vHashes) const;
+};
+
+/** The block filter index, if -blockfilterindex */
+extern std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_INDEX_BLOCKFILTERINDEX_H
@@ -0,0 +1,25 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/txcommentindex.h"
+
+#include "chain.h"
+
+std::unique_ptr<CTxCommentIndex> g_txcommentindex;
+
+CTxCommentIndex::CTxCommentIndex(size_t nCacheSize, bool fMemory, bool fWipe) : db(new CTxCommentDB(nCacheSize, fMemory, fWipe))
+{
+}
+
+bool CTxCommentIndex::WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex)
+{
+    db->WriteBlock(batch, block, pindex->nHeight);
+    return true;
+}
+
+bool CTxCommentIndex::EraseBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex)
+{
+    db->EraseBlock(batch, block, pindex->nHeight);
+    return true;
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_TXCOMMENTINDEX_H
+#define BITCOIN_INDEX_TXCOMMENTINDEX_H
+
+#include "index/base.h"
+#include "txdb.h"
+
+#include <memory>
+
+/** The transaction comment index (-txcommentindex), see CTxCommentDB */
+class CTxCommentIndex : public CBaseIndex
+{
+private:
+    const std::unique_ptr<CTxCommentDB> db;
+
+protected:
+    const char* GetName() const override { return "txcommentindex"; }
+    bool WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) override;
+    bool EraseBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) override;
+
+public:
+    CTxCommentIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    CTxCommentDB& GetDB() const override { return *db; }
+};
+
+/** The transaction comment index, if -txcommentindex */
+extern std::unique_ptr<CTxCommentIndex> g_txcommentindex;
+
+#endif // BITCOIN_INDEX_TXCOMMENTINDEX_H
@@ -15,10 +15,16 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/sha256.h"
 #include "consensus/validation.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "index/addressindex.h"
+#include "index/blockfilterindex.h"
+#include "index/txcommentindex.h"
 #include "key.h"
+#include "mempooljournal.h"
+#include "merkleblock.h"
 #include "validation.h"
 #include "miner.h"
 #include "netbase.h"
@@ -62,6 +68,7 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
 #endif
 
@@ -181,6 +188,12 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptTorControl();
     if (g_connman)
         g_connman->Interrupt();
+    if (g_txcommentindex)
+        g_txcommentindex->Interrupt();
+    if (g_addressindex)
+        g_addressindex->Interrupt();
+    if (g_blockfilterindex)
+        g_blockfilterindex->Interrupt();
     threadGroup.interrupt_all();
 }
 
@@ -203,6 +216,10 @@ void Shutdown()
     StopREST();
     StopRPC();
     StopHTTPServer();
+    // The scheduler threads have stopped: deliver what is still queued for
+    // asynchronous subscribers before they are flushed
+    UnregisterBackgroundSignalScheduler();
+    SyncWithValidationInterfaceQueue();
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(false);
@@ -211,6 +228,19 @@ void Shutdown()
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
     g_connman.reset();
+    g_blocktemplateengine.reset();
+    if (g_txcommentindex) {
+        g_txcommentindex->Stop();
+        g_txcommentindex.reset();
+    }
+    if (g_addressindex) {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_blockfilterindex) {
+        g_blockfilterindex->Stop();
+        g_blockfilterindex.reset();
+    }
 
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
@@ -341,12 +371,15 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbprofile=[<db>:]<profile>", strprintf(_("Open databases with a LevelDB tuning profile (%s), for all of them or for one of: %s. Can be specified multiple times (default: %s)"),
+        ListDBProfiles(), strprintf("%s, %s, %s, %s, %s", DB_NAME_CHAINSTATE, DB_NAME_BLOCK_INDEX, DB_NAME_TX_COMMENT, DB_NAME_ADDRESS_INDEX, DB_NAME_BLOCK_FILTER), DEFAULT_DB_PROFILE));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-merkletreecache=<n>", strprintf(_("Keep the merkle trees of the <n> most recently filtered blocks in memory, 0 to disable (default: %u)"), DEFAULT_MERKLE_TREE_CACHE_BLOCKS));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
@@ -362,6 +395,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of compact block filters (BIP 158), used by the getblockfilter rpc call and by -peerblockfilters (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the transactions, balances and unspent outputs of every script, and of where outputs were spent, used by the getaddress* and getspentinfo rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-txcommentindex", strprintf(_("Maintain an index of transaction comments, used by the searchtxcomments and listtxcomments rpc calls (default: %u)"), DEFAULT_TXCOMMENTINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -379,16 +415,19 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Set the number of threads to process peer messages, each serving a fixed subset of the peers (1 to %d, default: %d)"), MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve compact block filters to peers per BIP 157, requires -blockfilterindex (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), Params(CBaseChainParams::MAIN).GetDefaultPort(), Params(CBaseChainParams::TESTNET).GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-rpcserialversion", strprintf(_("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"), DEFAULT_RPC_SERIALIZE_VERSION));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Wait for socket events with <mode> (%s; default: %s). select limits the number of connections to %u"), GetSupportedSocketEventsModes(), GetSocketEventsModeName(GetDefaultSocketEventsMode()), FD_SETSIZE));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -416,6 +455,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashblockhwm=<n>", strprintf(_("Set publish hash block outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqpubhashtxhwm=<n>", strprintf(_("Set publish hash transaction outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqpubrawblockhwm=<n>", strprintf(_("Set publish raw block outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqpubrawtxhwm=<n>", strprintf(_("Set publish raw transaction outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -488,6 +531,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockmintxfee=<amt>", strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
+    strUsage += HelpMessageOpt("-genthreads=<n>", strprintf(_("Set the number of threads generate and generatetoaddress search nonces with (0 = auto, <0 = leave that many cores free, default: %d)"), DEFAULT_GENERATE_THREADS));
 
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server", _("Accept command line and JSON-RPC commands"));
@@ -500,8 +544,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), BaseParams(CBaseChainParams::MAIN).RPCPort(), BaseParams(CBaseChainParams::TESTNET).RPCPort()));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcbatchparallel=<n>", strprintf(_("Execute up to <n> read-only requests of a JSON-RPC batch at once on idle RPC threads; other requests still run in order (default: %d)"), DEFAULT_RPC_BATCH_PARALLEL));
     if (showDebug) {
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of each lane of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -704,6 +749,7 @@ bool AppInitServers(boost::thread_group& threadGroup)
     RPCServer::OnPreCommand(&OnRPCPreCommand);
     if (!InitHTTPServer())
         return false;
+    RegisterHTTPRPCCommands(tableRPC);
     if (!StartRPC())
         return false;
     if (!StartHTTPRPC())
@@ -802,6 +848,7 @@ int nMaxConnections;
 int nUserMaxConnections;
 int nFD;
 ServiceFlags nLocalServices = NODE_NETWORK;
+SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
 
 }
 
@@ -887,6 +934,12 @@ bool AppInitParameterInteraction()
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-txcommentindex", DEFAULT_TXCOMMENTINDEX))
+            return InitError(_("Prune mode is incompatible with -txcommentindex."));
+        if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex."));
+        if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
     }
 
     // Make sure enough file descriptors are available
@@ -896,8 +949,13 @@ bool AppInitParameterInteraction()
     nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    std::string strSocketEvents = GetArg("-socketevents", GetSocketEventsModeName(GetDefaultSocketEventsMode()));
+    if (!ParseSocketEventsMode(strSocketEvents, socketEventsMode))
+        return InitError(strprintf(_("Invalid -socketevents ('%s'), must be one of: %s"), strSocketEvents, GetSupportedSocketEventsModes()));
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+    if (socketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1058,6 +1116,12 @@ bool AppInitParameterInteraction()
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     if (GetArg("-rpcserialversion", DEFAULT_RPC_SERIALIZE_VERSION) < 0)
         return InitError("rpcserialversion must be non-negative.");
 
@@ -1139,6 +1203,9 @@ bool AppInitSanityChecks()
 {
     // ********************************************************* Step 4: sanity checks
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1183,6 +1250,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    InitMerkleTreeCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
@@ -1194,6 +1262,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
 
+    RegisterBackgroundSignalScheduler(scheduler);
+
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
      * that the server is there and will be ready later).  Warmup mode will
@@ -1363,7 +1433,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     pzmqNotificationInterface = CZMQNotificationInterface::Create();
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        RegisterValidationInterface(pzmqNotificationInterface, true);
     }
 #endif
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
@@ -1405,6 +1475,17 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    // database profiles
+    std::set<std::string> setDBNames;
+    setDBNames.insert(DB_NAME_CHAINSTATE);
+    setDBNames.insert(DB_NAME_BLOCK_INDEX);
+    setDBNames.insert(DB_NAME_TX_COMMENT);
+    setDBNames.insert(DB_NAME_ADDRESS_INDEX);
+    setDBNames.insert(DB_NAME_BLOCK_FILTER);
+    std::string strDBProfileError;
+    if (!SetDBProfiles(mapMultiArgs.count("-dbprofile") ? mapMultiArgs.at("-dbprofile") : std::vector<std::string>(), setDBNames, strDBProfileError))
+        return InitError(strDBProfileError);
+
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
@@ -1412,6 +1493,18 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxCommentDBCache = 0;
+    if (GetBoolArg("-txcommentindex", DEFAULT_TXCOMMENTINDEX))
+        nTxCommentDBCache = std::min(nTotalCache / 8, nMaxTxCommentDBCache << 20);
+    nTotalCache -= nTxCommentDBCache;
+    int64_t nAddressDBCache = 0;
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+        nAddressDBCache = std::min(nTotalCache / 8, nMaxAddressDBCache << 20);
+    nTotalCache -= nAddressDBCache;
+    int64_t nBlockFilterDBCache = 0;
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        nBlockFilterDBCache = std::min(nTotalCache / 8, nMaxBlockFilterDBCache << 20);
+    nTotalCache -= nBlockFilterDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1419,6 +1512,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nTxCommentDBCache)
+        LogPrintf("* Using %.1fMiB for transaction comment index database\n", nTxCommentDBCache * (1.0 / 1024 / 1024));
+    if (nAddressDBCache)
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressDBCache * (1.0 / 1024 / 1024));
+    if (nBlockFilterDBCache)
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nBlockFilterDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
@@ -1556,6 +1655,24 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // Optional indexes are built in the background, and can be turned on
+    // and off without a reindex; -reindex rebuilds them too.
+    if (GetBoolArg("-txcommentindex", DEFAULT_TXCOMMENTINDEX)) {
+        g_txcommentindex.reset(new CTxCommentIndex(nTxCommentDBCache, false, fReindex));
+        if (!g_txcommentindex->Start())
+            return InitError(_("Unable to start the transaction comment index. Restart with -reindex to rebuild it."));
+    }
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_addressindex.reset(new CAddressIndex(nAddressDBCache, false, fReindex));
+        if (!g_addressindex->Start())
+            return InitError(_("Unable to start the address index. Restart with -reindex to rebuild it."));
+    }
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        g_blockfilterindex.reset(new CBlockFilterIndex(nBlockFilterDBCache, false, fReindex));
+        if (!g_blockfilterindex->Start())
+            return InitError(_("Unable to start the block filter index. Restart with -reindex to rebuild it."));
+    }
+
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
     if (!CWallet::InitLoadWallet())
@@ -1613,6 +1730,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    g_blocktemplateengine.reset(new BlockTemplateEngine(chainparams, &scheduler));
+    scheduler.scheduleEvery(&FlushMempoolJournal, MEMPOOL_JOURNAL_FLUSH_INTERVAL);
 
     // Wait for genesis block to be processed
     {
@@ -1651,6 +1770,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
+    connOptions.socketEventsMode = socketEventsMode;
+    connOptions.nMsgHandThreads = GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS);
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
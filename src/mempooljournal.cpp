@@ -0,0 +1,425 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempooljournal.h"
+
+#include "clientversion.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#ifdef WIN32
+#include <io.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+/** Snapshot written before the journal existed, without a sequence number */
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_JOURNAL = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+enum MempoolJournalRecord : uint8_t
+{
+    //! A transaction entered the mempool: tx, acceptance time
+    MEMPOOL_JOURNAL_ADD = 0,
+    //! A transaction left the mempool: txid
+    MEMPOOL_JOURNAL_REMOVE = 1,
+    //! The fee delta of a transaction changed: txid, new total delta
+    MEMPOOL_JOURNAL_DELTA = 2,
+};
+
+CMempoolJournal::CMempoolJournal()
+    : file(NULL), nSequence(0), nRecords(0), nValidSize(0), fLoaded(false), pool(NULL)
+{
+}
+
+CMempoolJournal::~CMempoolJournal()
+{
+    if (file)
+        fclose(file);
+}
+
+boost::filesystem::path CMempoolJournal::GetSnapshotPath() const
+{
+    return GetDataDir() / "mempool.dat";
+}
+
+boost::filesystem::path CMempoolJournal::GetJournalPath() const
+{
+    return GetDataDir() / "mempool.journal";
+}
+
+boost::filesystem::path CMempoolJournal::GetOldJournalPath() const
+{
+    return GetDataDir() / "mempool.journal.old";
+}
+
+bool CMempoolJournal::ReadJournal(const boost::filesystem::path& path, std::vector<MempoolJournalEntry>& vEntries, std::map<uint256, size_t>& mapIndex, std::map<uint256, CAmount>& mapDeltas, uint64_t& nSize, uint64_t& nCount)
+{
+    nSize = 0;
+    nCount = 0;
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+
+    try {
+        while (true) {
+            uint8_t nType;
+            uint64_t nRecordSequence;
+            CTransactionRef tx;
+            int64_t nTime = 0;
+            uint256 hash;
+            CAmount nFeeDelta = 0;
+            file >> nType >> nRecordSequence;
+            if (nType == MEMPOOL_JOURNAL_ADD) {
+                file >> tx >> nTime;
+            } else if (nType == MEMPOOL_JOURNAL_REMOVE) {
+                file >> hash;
+            } else if (nType == MEMPOOL_JOURNAL_DELTA) {
+                file >> hash >> nFeeDelta;
+            } else {
+                break;
+            }
+            nSize = ftell(file.Get());
+            nCount++;
+
+            // Records up to the snapshot's sequence number are part of it already
+            if (nRecordSequence <= nSequence)
+                continue;
+            nSequence = nRecordSequence;
+
+            if (nType == MEMPOOL_JOURNAL_ADD) {
+                std::map<uint256, size_t>::const_iterator it = mapIndex.find(tx->GetHash());
+                if (it != mapIndex.end()) {
+                    // Accepted again while it was being restored; keep it
+                    // ahead of the transactions that spend it
+                    vEntries[it->second].nTime = nTime;
+                } else {
+                    mapIndex[tx->GetHash()] = vEntries.size();
+                    vEntries.push_back(MempoolJournalEntry(tx, nTime, 0));
+                }
+            } else if (nType == MEMPOOL_JOURNAL_REMOVE) {
+                std::map<uint256, size_t>::iterator it = mapIndex.find(hash);
+                if (it != mapIndex.end()) {
+                    vEntries[it->second].tx.reset();
+                    mapIndex.erase(it);
+                }
+            } else if (nFeeDelta) {
+                mapDeltas[hash] = nFeeDelta;
+            } else {
+                mapDeltas.erase(hash);
+            }
+        }
+    } catch (const std::ios_base::failure&) {
+        // End of the file, or of its intact part
+    }
+
+    boost::system::error_code ec;
+    uint64_t nFileSize = boost::filesystem::file_size(path, ec);
+    if (!ec && nSize < nFileSize)
+        LogPrintf("Ignoring %u damaged bytes at the end of %s\n", nFileSize - nSize, path.filename().string());
+    return true;
+}
+
+bool CMempoolJournal::Load(std::vector<MempoolJournalEntry>& vEntries, std::map<uint256, CAmount>& mapDeltas)
+{
+    LOCK(cs);
+    fLoaded = false;
+    nSequence = 0;
+    nRecords = 0;
+    nValidSize = 0;
+
+    // Deltas are tracked by txid while reading, as journal records change
+    // them independently of the transactions coming and going
+    std::map<uint256, size_t> mapIndex;
+    std::map<uint256, CAmount> mapSnapshotDeltas;
+    CAutoFile filein(fopen(GetSnapshotPath().string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein.IsNull()) {
+        try {
+            uint64_t version;
+            filein >> version;
+            if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_JOURNAL) {
+                LogPrintf("Unknown mempool file version %u\n", version);
+                return false;
+            }
+            if (version == MEMPOOL_DUMP_VERSION)
+                filein >> nSequence;
+            uint64_t num;
+            filein >> num;
+            while (num--) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                filein >> tx;
+                filein >> nTime;
+                filein >> nFeeDelta;
+                mapIndex[tx->GetHash()] = vEntries.size();
+                vEntries.push_back(MempoolJournalEntry(tx, nTime, 0));
+                if (nFeeDelta)
+                    mapSnapshotDeltas[tx->GetHash()] = nFeeDelta;
+            }
+            filein >> mapDeltas;
+            mapDeltas.insert(mapSnapshotDeltas.begin(), mapSnapshotDeltas.end());
+        } catch (const std::exception& e) {
+            LogPrintf("Failed to deserialize mempool data on disk: %s\n", e.what());
+            vEntries.clear();
+            mapDeltas.clear();
+            return false;
+        }
+    }
+    filein.fclose();
+
+    uint64_t nOldSize, nOldRecords;
+    ReadJournal(GetOldJournalPath(), vEntries, mapIndex, mapDeltas, nOldSize, nOldRecords);
+    ReadJournal(GetJournalPath(), vEntries, mapIndex, mapDeltas, nValidSize, nRecords);
+
+    vEntries.erase(std::remove_if(vEntries.begin(), vEntries.end(),
+                       [](const MempoolJournalEntry& entry) { return !entry.tx; }),
+        vEntries.end());
+    BOOST_FOREACH(MempoolJournalEntry& entry, vEntries) {
+        std::map<uint256, CAmount>::iterator it = mapDeltas.find(entry.tx->GetHash());
+        if (it != mapDeltas.end()) {
+            entry.nFeeDelta = it->second;
+            mapDeltas.erase(it);
+        }
+    }
+    fLoaded = true;
+    return true;
+}
+
+bool CMempoolJournal::OpenFile(const char* mode)
+{
+    AssertLockHeld(cs);
+    file = fopen(GetJournalPath().string().c_str(), mode);
+    if (!file)
+        LogPrintf("Failed to open %s\n", GetJournalPath().string());
+    return file != NULL;
+}
+
+bool CMempoolJournal::Open(CTxMemPool& poolIn)
+{
+    {
+        LOCK(cs);
+        if (pool)
+            return file != NULL;
+
+        if (fLoaded) {
+            // Appending after a damaged record would hide everything behind it
+            if (OpenFile("ab") && !TruncateFile(file, nValidSize)) {
+                fclose(file);
+                file = NULL;
+            }
+        } else {
+            // What is on disk could not be read, so start over
+            nSequence = 0;
+            nRecords = 0;
+            boost::system::error_code ec;
+            boost::filesystem::remove(GetOldJournalPath(), ec);
+            if (WriteSnapshot(std::vector<MempoolJournalEntry>(), std::map<uint256, CAmount>(), 0))
+                OpenFile("wb");
+        }
+        pool = &poolIn;
+    }
+
+    poolIn.NotifyEntryAdded.connect(boost::bind(&CMempoolJournal::TransactionAdded, this, _1));
+    poolIn.NotifyEntryRemoved.connect(boost::bind(&CMempoolJournal::TransactionRemoved, this, _1, _2));
+    poolIn.NotifyFeeDeltaChanged.connect(boost::bind(&CMempoolJournal::FeeDeltaChanged, this, _1, _2));
+    return IsOpen();
+}
+
+bool CMempoolJournal::IsOpen() const
+{
+    LOCK(cs);
+    return file != NULL;
+}
+
+void CMempoolJournal::Append(CDataStream& ss)
+{
+    AssertLockHeld(cs);
+    if (fwrite(ss.data(), 1, ss.size(), file) != ss.size()) {
+        LogPrintf("Failed to write to %s, the mempool will be written out at shutdown instead\n", GetJournalPath().string());
+        fclose(file);
+        file = NULL;
+        return;
+    }
+    nRecords++;
+}
+
+void CMempoolJournal::TransactionAdded(CTransactionRef tx)
+{
+    LOCK(cs);
+    if (!file)
+        return;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint8_t)MEMPOOL_JOURNAL_ADD << ++nSequence << *tx << GetTime();
+    Append(ss);
+}
+
+void CMempoolJournal::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (!file)
+        return;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint8_t)MEMPOOL_JOURNAL_REMOVE << ++nSequence << tx->GetHash();
+    Append(ss);
+}
+
+void CMempoolJournal::FeeDeltaChanged(const uint256& hash, CAmount nFeeDelta)
+{
+    LOCK(cs);
+    if (!file)
+        return;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint8_t)MEMPOOL_JOURNAL_DELTA << ++nSequence << hash << nFeeDelta;
+    Append(ss);
+}
+
+void CMempoolJournal::Flush()
+{
+    // Records are appended under the mempool lock, so only hand
+    // them to the OS under cs. Syncing them to disk goes through a duplicate
+    // of the file descriptor, which stays valid if the journal is closed or
+    // replaced in the meantime.
+    FILE* fileSync = NULL;
+    {
+        LOCK(cs);
+        if (!file || fflush(file) != 0)
+            return;
+        int fd = dup(fileno(file));
+        if (fd >= 0) {
+            fileSync = fdopen(fd, "wb");
+            if (!fileSync)
+                close(fd);
+        }
+    }
+    if (fileSync) {
+        FileCommit(fileSync);
+        fclose(fileSync);
+    }
+}
+
+bool CMempoolJournal::NeedsCompaction(CTxMemPool& poolIn) const
+{
+    uint64_t nRecordsNow;
+    {
+        LOCK(cs);
+        if (!file)
+            return false;
+        nRecordsNow = nRecords;
+    }
+    return nRecordsNow > std::max<uint64_t>(MEMPOOL_JOURNAL_MIN_COMPACT_RECORDS, 2 * poolIn.size());
+}
+
+bool CMempoolJournal::WriteSnapshot(const std::vector<MempoolJournalEntry>& vEntries, const std::map<uint256, CAmount>& mapDeltas, uint64_t nSnapshotSequence)
+{
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+        file << nSnapshotSequence;
+
+        file << (uint64_t)vEntries.size();
+        BOOST_FOREACH(const MempoolJournalEntry& entry, vEntries) {
+            file << *(entry.tx);
+            file << (int64_t)entry.nTime;
+            file << (int64_t)entry.nFeeDelta;
+        }
+
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        return RenameOver(GetDataDir() / "mempool.dat.new", GetSnapshotPath());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+    }
+    return false;
+}
+
+bool CMempoolJournal::Compact(CTxMemPool& poolIn)
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::vector<MempoolJournalEntry> vEntries;
+    std::map<uint256, CAmount> mapDeltas;
+    uint64_t nSnapshotSequence;
+    bool fJournaling;
+
+    {
+        LOCK2(poolIn.cs, cs);
+        for (const auto& i : poolIn.mapDeltas) {
+            mapDeltas[i.first] = i.second.second;
+        }
+        std::vector<TxMempoolInfo> vinfo = poolIn.infoAll();
+        vEntries.reserve(vinfo.size());
+        BOOST_FOREACH(const TxMempoolInfo& info, vinfo) {
+            vEntries.push_back(MempoolJournalEntry(info.tx, info.nTime, info.nFeeDelta));
+            mapDeltas.erase(info.tx->GetHash());
+        }
+        nSnapshotSequence = nSequence;
+
+        // Changes from here on go to a fresh journal. The current one stays
+        // until the snapshot is on disk, unless one left by a failed
+        // compaction still does: the new snapshot covers both.
+        fJournaling = file != NULL;
+        if (fJournaling && !boost::filesystem::exists(GetOldJournalPath())) {
+            fclose(file);
+            file = NULL;
+            if (RenameOver(GetJournalPath(), GetOldJournalPath())) {
+                nRecords = 0;
+                OpenFile("wb");
+            } else {
+                OpenFile("ab");
+            }
+        }
+    }
+
+    int64_t nMid = GetTimeMicros();
+
+    if (!WriteSnapshot(vEntries, mapDeltas, nSnapshotSequence))
+        return false;
+
+    boost::system::error_code ec;
+    boost::filesystem::remove(GetOldJournalPath(), ec);
+    if (!fJournaling)
+        boost::filesystem::remove(GetJournalPath(), ec);
+
+    int64_t nLast = GetTimeMicros();
+    LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (nMid-nStart)*0.000001, (nLast-nMid)*0.000001);
+    return true;
+}
+
+void CMempoolJournal::Close()
+{
+    CTxMemPool* poolConnected;
+    {
+        LOCK(cs);
+        poolConnected = pool;
+    }
+    if (poolConnected) {
+        poolConnected->NotifyEntryAdded.disconnect(boost::bind(&CMempoolJournal::TransactionAdded, this, _1));
+        poolConnected->NotifyEntryRemoved.disconnect(boost::bind(&CMempoolJournal::TransactionRemoved, this, _1, _2));
+        poolConnected->NotifyFeeDeltaChanged.disconnect(boost::bind(&CMempoolJournal::FeeDeltaChanged, this, _1, _2));
+    }
+
+    LOCK(cs);
+    pool = NULL;
+    if (!file)
+        return;
+    FileCommit(file);
+    fclose(file);
+    file = NULL;
+    LogPrintf("Closed mempool journal at sequence number %u\n", nSequence);
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MEMPOOLJOURNAL_H
+#define BITCOIN_MEMPOOLJOURNAL_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+class CDataStream;
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+
+/** How often the mempool journal is flushed to disk, in seconds */
+static const int64_t MEMPOOL_JOURNAL_FLUSH_INTERVAL = 10;
+/** Journal records below which the journal is never compacted */
+static const uint64_t MEMPOOL_JOURNAL_MIN_COMPACT_RECORDS = 10000;
+
+/** A transaction to restore to the mempool */
+struct MempoolJournalEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    CAmount nFeeDelta;
+
+    MempoolJournalEntry(const CTransactionRef& txIn, int64_t nTimeIn, CAmount nFeeDeltaIn)
+        : tx(txIn), nTime(nTimeIn), nFeeDelta(nFeeDeltaIn) {}
+};
+
+/**
+ * Persists the mempool as a snapshot, mempool.dat, and a journal,
+ * mempool.journal, to which every transaction added to or removed from the
+ * mempool afterwards is appended, along with every change to a fee delta.
+ *
+ * Neither shutting down nor a crash requires writing out the whole mempool:
+ * the journal is flushed every MEMPOOL_JOURNAL_FLUSH_INTERVAL seconds, and
+ * only once it holds more records than twice the mempool's size is it folded
+ * into a new snapshot. Every record carries a sequence number and the
+ * snapshot stores the last one it covers, so compaction can write the
+ * snapshot outside of the mempool lock while new records go to a fresh
+ * journal, and a crash at any point leaves files that load consistently.
+ */
+class CMempoolJournal
+{
+private:
+    mutable CCriticalSection cs;
+    //! The journal being appended to, or NULL while closed
+    FILE* file;
+    //! Sequence number of the last record read or written
+    uint64_t nSequence;
+    //! Number of records in the current journal file
+    uint64_t nRecords;
+    //! Length of the intact part of the journal, where appending resumes
+    uint64_t nValidSize;
+    //! Whether Load read the files on disk, which may then be appended to
+    bool fLoaded;
+    //! The mempool whose changes are recorded, or NULL
+    CTxMemPool* pool;
+
+    boost::filesystem::path GetSnapshotPath() const;
+    boost::filesystem::path GetJournalPath() const;
+    boost::filesystem::path GetOldJournalPath() const;
+
+    bool ReadJournal(const boost::filesystem::path& path, std::vector<MempoolJournalEntry>& vEntries, std::map<uint256, size_t>& mapIndex, std::map<uint256, CAmount>& mapDeltas, uint64_t& nSize, uint64_t& nCount);
+    bool WriteSnapshot(const std::vector<MempoolJournalEntry>& vEntries, const std::map<uint256, CAmount>& mapDeltas, uint64_t nSnapshotSequence);
+    bool OpenFile(const char* mode);
+    void Append(CDataStream& ss);
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    void FeeDeltaChanged(const uint256& hash, CAmount nFeeDelta);
+
+public:
+    CMempoolJournal();
+    ~CMempoolJournal();
+
+    /**
+     * Read the snapshot and the journal. vEntries receives the transactions
+     * in the order they were accepted, and mapDeltas the fee deltas of
+     * transactions not in vEntries. Returns false if the snapshot cannot be
+     * read. A truncated journal is read up to its last intact record.
+     */
+    bool Load(std::vector<MempoolJournalEntry>& vEntries, std::map<uint256, CAmount>& mapDeltas);
+
+    /**
+     * Start appending the changes to pool to the journal. Must be called after
+     * Load, as it discards any damaged tail of the journal.
+     */
+    bool Open(CTxMemPool& poolIn);
+
+    bool IsOpen() const;
+
+    /** Write buffered records to disk, without holding up appends while they are synced */
+    void Flush();
+
+    /** Whether the journal has grown enough to be folded into a snapshot of poolIn */
+    bool NeedsCompaction(CTxMemPool& poolIn) const;
+
+    /** Write a new snapshot of poolIn and delete the journal records it covers */
+    bool Compact(CTxMemPool& poolIn);
+
+    /** Flush and stop appending */
+    void Close();
+};
+
+#endif // BITCOIN_MEMPOOLJOURNAL_H
@@ -7,17 +7,64 @@
 
 #include "hash.h"
 #include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "sync.h"
+#include "util.h"
 #include "utilstrencodings.h"
 
+#include <list>
+
+namespace {
+
+CCriticalSection cs_merkleTreeCache;
+//! Recently used block merkle trees, most recent first
+std::list<std::pair<uint256, std::shared_ptr<const MerkleTree> > > listMerkleTreeCache;
+unsigned int nMerkleTreeCacheBlocks = DEFAULT_MERKLE_TREE_CACHE_BLOCKS;
+
+} // anon namespace
+
+void InitMerkleTreeCache()
+{
+    LOCK(cs_merkleTreeCache);
+    nMerkleTreeCacheBlocks = std::max((int64_t)0, GetArg("-merkletreecache", DEFAULT_MERKLE_TREE_CACHE_BLOCKS));
+    listMerkleTreeCache.clear();
+}
+
+std::shared_ptr<const MerkleTree> GetBlockMerkleTree(const CBlock& block)
+{
+    std::vector<uint256> vTxid;
+    vTxid.reserve(block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        vTxid.push_back(block.vtx[i]->GetHash());
+
+    const uint256 hash = block.GetHash();
+    {
+        LOCK(cs_merkleTreeCache);
+        for (auto it = listMerkleTreeCache.begin(); it != listMerkleTreeCache.end(); ++it) {
+            // Mutated copies of a block share its hash, so the leaves must match too
+            if (it->first == hash && !it->second->empty() && it->second->front() == vTxid) {
+                listMerkleTreeCache.splice(listMerkleTreeCache.begin(), listMerkleTreeCache, it);
+                return listMerkleTreeCache.front().second;
+            }
+        }
+    }
+
+    std::shared_ptr<const MerkleTree> tree = std::make_shared<const MerkleTree>(ComputeMerkleTree(std::move(vTxid)));
+    LOCK(cs_merkleTreeCache);
+    if (nMerkleTreeCacheBlocks > 0) {
+        listMerkleTreeCache.push_front(std::make_pair(hash, tree));
+        if (listMerkleTreeCache.size() > nMerkleTreeCacheBlocks)
+            listMerkleTreeCache.pop_back();
+    }
+    return tree;
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
 {
     header = block.GetBlockHeader();
 
     std::vector<bool> vMatch;
-    std::vector<uint256> vHashes;
-
     vMatch.reserve(block.vtx.size());
-    vHashes.reserve(block.vtx.size());
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -29,10 +76,9 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
         }
         else
             vMatch.push_back(false);
-        vHashes.push_back(hash);
     }
 
-    txn = CPartialMerkleTree(vHashes, vMatch);
+    txn = CPartialMerkleTree(*GetBlockMerkleTree(block), vMatch);
 }
 
 CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
@@ -40,10 +86,7 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
     header = block.GetBlockHeader();
 
     std::vector<bool> vMatch;
-    std::vector<uint256> vHashes;
-
     vMatch.reserve(block.vtx.size());
-    vHashes.reserve(block.vtx.size());
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -52,30 +95,12 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
             vMatch.push_back(true);
         else
             vMatch.push_back(false);
-        vHashes.push_back(hash);
     }
 
-    txn = CPartialMerkleTree(vHashes, vMatch);
+    txn = CPartialMerkleTree(*GetBlockMerkleTree(block), vMatch);
 }
 
-uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
-    if (height == 0) {
-        // hash at height 0 is the txids themself
-        return vTxid[pos];
-    } else {
-        // calculate left hash
-        uint256 left = CalcHash(height-1, pos*2, vTxid), right;
-        // calculate right hash if not beyond the end of the array - copy left hash otherwise1
-        if (pos*2+1 < CalcTreeWidth(height-1))
-            right = CalcHash(height-1, pos*2+1, vTxid);
-        else
-            right = left;
-        // combine subhashes
-        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
-    }
-}
-
-void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) {
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const MerkleTree &vTree, const std::vector<bool> &vMatch) {
     // determine whether this node is the parent of at least one matched txid
     bool fParentOfMatch = false;
     for (unsigned int p = pos << height; p < (pos+1) << height && p < nTransactions; p++)
@@ -84,12 +109,12 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     vBits.push_back(fParentOfMatch);
     if (height==0 || !fParentOfMatch) {
         // if at height 0, or nothing interesting below, store hash and stop
-        vHash.push_back(CalcHash(height, pos, vTxid));
+        vHash.push_back(vTree[height][pos]);
     } else {
         // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height-1, pos*2, vTxid, vMatch);
+        TraverseAndBuild(height-1, pos*2, vTree, vMatch);
         if (pos*2+1 < CalcTreeWidth(height-1))
-            TraverseAndBuild(height-1, pos*2+1, vTxid, vMatch);
+            TraverseAndBuild(height-1, pos*2+1, vTree, vMatch);
     }
 }
 
@@ -132,17 +157,16 @@ uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, uns
 }
 
 CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) : nTransactions(vTxid.size()), fBad(false) {
-    // reset state
-    vBits.clear();
-    vHash.clear();
-
-    // calculate height of tree
-    int nHeight = 0;
-    while (CalcTreeWidth(nHeight) > 1)
-        nHeight++;
+    // hash every level of the tree up front, rather than once per stored node
+    MerkleTree vTree = ComputeMerkleTree(vTxid);
+    if (!vTree.empty())
+        TraverseAndBuild(vTree.size() - 1, 0, vTree, vMatch);
+}
 
-    // traverse the partial tree
-    TraverseAndBuild(nHeight, 0, vTxid, vMatch);
+CPartialMerkleTree::CPartialMerkleTree(const MerkleTree &vTree, const std::vector<bool> &vMatch) : nTransactions(vTree.empty() ? 0 : vTree[0].size()), fBad(false) {
+    // the height of the tree is the number of levels above the leaves
+    if (!vTree.empty())
+        TraverseAndBuild(vTree.size() - 1, 0, vTree, vMatch);
 }
 
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
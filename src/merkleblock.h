@@ -11,8 +11,15 @@
 #include "primitives/block.h"
 #include "bloom.h"
 
+#include <memory>
 #include <vector>
 
+/** Default for -merkletreecache, the number of recent blocks whose merkle trees are kept */
+static const unsigned int DEFAULT_MERKLE_TREE_CACHE_BLOCKS = 16;
+
+/** Every level of a block's merkle tree, as returned by ComputeMerkleTree */
+typedef std::vector<std::vector<uint256> > MerkleTree;
+
 /** Data structure that represents a partial merkle tree.
  *
  * It represents a subset of the txid's of a known block, in a way that
@@ -67,11 +74,8 @@ protected:
         return (nTransactions+(1 << height)-1) >> height;
     }
 
-    /** calculate the hash of a node in the merkle tree (at leaf level: the txid's themselves) */
-    uint256 CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid);
-
     /** recursive function that traverses tree nodes, storing the data as bits and hashes */
-    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+    void TraverseAndBuild(int height, unsigned int pos, const MerkleTree &vTree, const std::vector<bool> &vMatch);
 
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
@@ -107,6 +111,9 @@ public:
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** Construct a partial merkle tree from the full merkle tree over the txids, and a mask that selects a subset of them */
+    CPartialMerkleTree(const MerkleTree &vTree, const std::vector<bool> &vMatch);
+
     CPartialMerkleTree();
 
     /**
@@ -154,4 +161,14 @@ public:
     }
 };
 
+/**
+ * Return the merkle tree of a block's transactions. The trees of the most
+ * recently requested blocks are cached, so serving several filtered peers or
+ * proof requests for the same block hashes its transactions only once.
+ */
+std::shared_ptr<const MerkleTree> GetBlockMerkleTree(const CBlock& block);
+
+/** Size the block merkle tree cache according to -merkletreecache */
+void InitMerkleTreeCache();
+
 #endif // BITCOIN_MERKLEBLOCK_H
@@ -19,6 +19,7 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
+#include "scheduler.h"
 #include "script/standard.h"
 #include "timedata.h"
 #include "txmempool.h"
@@ -27,6 +28,8 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <atomic>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -74,7 +77,7 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
 }
 
 BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
-    : chainparams(_chainparams)
+    : pindexPrev(NULL), chainparams(_chainparams)
 {
     // Block resource limits
     // If neither -blockmaxsize or -blockmaxweight is given, limit to DEFAULT_BLOCK_MAX_*
@@ -126,18 +129,17 @@ void BlockAssembler::resetBlock()
 
     lastFewTxs = 0;
     blockFinished = false;
+    fSkippedPackage = false;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+bool BlockAssembler::SelectTransactions(bool fMineWitnessTx, int &nPackagesSelected, int &nDescendantsUpdated)
 {
-    int64_t nTimeStart = GetTimeMicros();
-
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
 
     if(!pblocktemplate.get())
-        return nullptr;
+        return false;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -145,8 +147,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    LOCK2(cs_main, mempool.cs);
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    pindexPrev = chainActive.Tip();
     nHeight = pindexPrev->nHeight + 1;
 
     pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
@@ -171,16 +172,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
 
     addPriorityTxs();
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
     addPackageTxs(nPackagesSelected, nDescendantsUpdated);
 
-    int64_t nTime1 = GetTimeMicros();
-
     nLastBlockTx = nBlockTx;
     nLastBlockSize = nBlockSize;
     nLastBlockWeight = nBlockWeight;
+    return true;
+}
 
+void BlockAssembler::FinishBlock(const CScript& scriptPubKeyIn)
+{
     // Create coinbase transaction.
     CMutableTransaction coinbaseTx;
     coinbaseTx.vin.resize(1);
@@ -193,15 +194,30 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
 
-    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
-    LogPrintf("CreateNewBlock(): total size: %u block weight: %u txs: %u fees: %ld sigops %d\n", nSerializeSize, GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
-
     // Fill in header
     pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
     pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    if (!SelectTransactions(fMineWitnessTx, nPackagesSelected, nDescendantsUpdated))
+        return nullptr;
+
+    int64_t nTime1 = GetTimeMicros();
+
+    FinishBlock(scriptPubKeyIn);
+
+    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    LogPrintf("CreateNewBlock(): total size: %u block weight: %u txs: %u fees: %ld sigops %d\n", nSerializeSize, GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -214,6 +230,48 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     return std::move(pblocktemplate);
 }
 
+std::unique_ptr<CBlockTemplate> BlockAssembler::StartBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    if (!SelectTransactions(fMineWitnessTx, nPackagesSelected, nDescendantsUpdated))
+        return nullptr;
+    FinishBlock(scriptPubKeyIn);
+
+    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    LogPrintf("CreateNewBlock(): total size: %u block weight: %u txs: %u fees: %ld sigops %d\n", nSerializeSize, GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+    LogPrint("bench", "StartBlock() packages: %.2fms (%d packages, %d updated descendants)\n", 0.001 * (GetTimeMicros() - nTimeStart), nPackagesSelected, nDescendantsUpdated);
+
+    return std::unique_ptr<CBlockTemplate>(new CBlockTemplate(*pblocktemplate));
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::UpdateBlock(const std::vector<CTxMemPool::txiter>& vNew, const CScript& scriptPubKeyIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    assert(pblocktemplate && pindexPrev == chainActive.Tip());
+    fSkippedPackage = false;
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    if (!vNew.empty()) {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated, &vNew);
+        nLastBlockTx = nBlockTx;
+        nLastBlockSize = nBlockSize;
+        nLastBlockWeight = nBlockWeight;
+    }
+    FinishBlock(scriptPubKeyIn);
+
+    LogPrint("bench", "UpdateBlock() %u new txs: %.2fms (%d packages, %d updated descendants), %u txs in block\n", vNew.size(), 0.001 * (GetTimeMicros() - nTimeStart), nPackagesSelected, nDescendantsUpdated, nBlockTx);
+
+    return std::unique_ptr<CBlockTemplate>(new CBlockTemplate(*pblocktemplate));
+}
+
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
 {
     BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
@@ -377,6 +435,28 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
     return nDescendantsUpdated;
 }
 
+void BlockAssembler::AddPackagesForNew(const std::vector<CTxMemPool::txiter>& vNew,
+        indexed_modified_transaction_set &mapModifiedTx)
+{
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    BOOST_FOREACH(const CTxMemPool::txiter it, vNew) {
+        if (inBlock.count(it) || mapModifiedTx.count(it))
+            continue;
+        CTxMemPoolModifiedEntry modEntry(it);
+        CTxMemPool::setEntries ancestors;
+        mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        BOOST_FOREACH(const CTxMemPool::txiter anc, ancestors) {
+            if (inBlock.count(anc)) {
+                modEntry.nSizeWithAncestors -= anc->GetTxSize();
+                modEntry.nModFeesWithAncestors -= anc->GetModifiedFee();
+                modEntry.nSigOpCostWithAncestors -= anc->GetSigOpCost();
+            }
+        }
+        mapModifiedTx.insert(modEntry);
+    }
+}
+
 // Skip entries in mapTx that are already in a block or are present
 // in mapModifiedTx (which implies that the mapTx ancestor state is
 // stale due to ancestor inclusion in the block)
@@ -415,7 +495,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* pvNew)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -423,13 +503,22 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     // Keep track of entries that failed inclusion, to avoid duplicate work
     CTxMemPool::setEntries failedTx;
 
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
     CTxMemPool::txiter iter;
 
+    if (pvNew) {
+        // Everything else in mapTx was considered before and would fail
+        // again, as the block only got fuller: adding transactions to the
+        // mempool does not change the ancestor state of those already there.
+        // So only queue the new ones and leave mapTx alone.
+        AddPackagesForNew(*pvNew, mapModifiedTx);
+        mi = mempool.mapTx.get<ancestor_score>().end();
+    } else {
+        // Start by adding all descendants of previously added txs to mapModifiedTx
+        // and modifying them for their already included ancestors
+        UpdatePackagesForAdded(inBlock, mapModifiedTx);
+    }
+
     // Limit the number of attempts to add transactions to the block when it is
     // close to full; this is just a simple heuristic to finish quickly if the
     // mempool has a lot of entries.
@@ -490,6 +579,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fSkippedPackage = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -627,6 +717,121 @@ void BlockAssembler::addPriorityTxs()
     fNeedSizeAccounting = fSizeAccounting;
 }
 
+std::unique_ptr<BlockTemplateEngine> g_blocktemplateengine;
+
+BlockTemplateEngine::BlockTemplateEngine(const CChainParams& _chainparams, CScheduler* pschedulerIn)
+    : chainparams(_chainparams), pscheduler(pschedulerIn), pindexPrev(NULL), fSupportsSegwit(false),
+      fStale(false), fSkippedPackage(false), nLastRebuild(0), fCheckScheduled(false), fInvalid(false)
+{
+    mempool.NotifyEntryAdded.connect(boost::bind(&BlockTemplateEngine::TransactionAdded, this, _1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&BlockTemplateEngine::TransactionRemoved, this, _1, _2));
+}
+
+BlockTemplateEngine::~BlockTemplateEngine()
+{
+    mempool.NotifyEntryAdded.disconnect(boost::bind(&BlockTemplateEngine::TransactionAdded, this, _1));
+    mempool.NotifyEntryRemoved.disconnect(boost::bind(&BlockTemplateEngine::TransactionRemoved, this, _1, _2));
+}
+
+void BlockTemplateEngine::TransactionAdded(CTransactionRef tx)
+{
+    LOCK(cs);
+    if (assembler)
+        vAdded.push_back(tx->GetHash());
+}
+
+void BlockTemplateEngine::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (setInTemplate.count(tx->GetHash()))
+        fStale = true;
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateEngine::GetTemplate(const CScript& scriptPubKeyIn, bool fSupportsSegwitIn)
+{
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+
+    bool fRebuild = !assembler || fStale || fInvalid || pindexPrev != chainActive.Tip() || fSupportsSegwit != fSupportsSegwitIn ||
+                    (fSkippedPackage && GetTime() - nLastRebuild >= BLOCK_TEMPLATE_REBUILD_INTERVAL);
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    if (fRebuild) {
+        setInTemplate.clear();
+        vAdded.clear();
+        assembler.reset(new BlockAssembler(chainparams));
+        pblocktemplate = assembler->StartBlock(scriptPubKeyIn, fSupportsSegwitIn);
+        if (!pblocktemplate) {
+            assembler.reset();
+            return nullptr;
+        }
+        pindexPrev = chainActive.Tip();
+        fSupportsSegwit = fSupportsSegwitIn;
+        fStale = false;
+        fSkippedPackage = false;
+        nLastRebuild = GetTime();
+    } else {
+        std::vector<CTxMemPool::txiter> vNew;
+        vNew.reserve(vAdded.size());
+        BOOST_FOREACH(const uint256& hash, vAdded) {
+            CTxMemPool::txiter it = mempool.mapTx.find(hash);
+            if (it != mempool.mapTx.end())
+                vNew.push_back(it);
+        }
+        vAdded.clear();
+        pblocktemplate = assembler->UpdateBlock(vNew, scriptPubKeyIn);
+        fSkippedPackage |= assembler->SkippedPackage();
+    }
+    const std::vector<CTransactionRef>& vtx = pblocktemplate->block.vtx;
+    for (size_t i = 1 + setInTemplate.size(); i < vtx.size(); i++)
+        setInTemplate.insert(vtx[i]->GetHash());
+
+    if (fInvalid) {
+        // The previous template was invalid, so check this one before anyone mines on it
+        CValidationState state;
+        if (!TestBlockValidity(state, chainparams, pblocktemplate->block, pindexPrev, false, false)) {
+            assembler.reset();
+            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+        }
+        fInvalid = false;
+    } else if (pscheduler) {
+        pblockToCheck = std::make_shared<const CBlock>(pblocktemplate->block);
+        if (!fCheckScheduled) {
+            fCheckScheduled = true;
+            pscheduler->scheduleFromNow(boost::bind(&BlockTemplateEngine::CheckTemplate, this), 0);
+        }
+    }
+    return pblocktemplate;
+}
+
+void BlockTemplateEngine::MarkStale()
+{
+    LOCK(cs);
+    fStale = true;
+}
+
+void BlockTemplateEngine::CheckTemplate()
+{
+    std::shared_ptr<const CBlock> pblock;
+    {
+        LOCK(cs);
+        pblock.swap(pblockToCheck);
+        fCheckScheduled = false;
+    }
+    if (!pblock)
+        return;
+
+    LOCK(cs_main);
+    CBlockIndex* pindexTip = chainActive.Tip();
+    if (pblock->hashPrevBlock != pindexTip->GetBlockHash())
+        return;
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexTip, false, false)) {
+        LogPrintf("%s: TestBlockValidity failed: %s\n", __func__, FormatStateMessage(state));
+        LOCK(cs);
+        fInvalid = true;
+    }
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -645,3 +850,38 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+/** Try every nStride-th nonce from nNonceBegin until one below *pnFound solves the header */
+static void ScanNoncesWorker(const CBlockHeader header, uint32_t nNonceBegin, uint32_t nNonceEnd, uint32_t nStride, std::atomic<uint32_t>* pnFound, const Consensus::Params* pconsensusParams)
+{
+    CPoWGrindContext context(header);
+    for (uint64_t nNonce = nNonceBegin; nNonce < nNonceEnd && nNonce < pnFound->load(); nNonce += nStride) {
+        if (CheckProofOfWork(context.GetPoWHash(nNonce), header.nBits, *pconsensusParams)) {
+            uint32_t nFound = pnFound->load();
+            while (nNonce < nFound && !pnFound->compare_exchange_weak(nFound, nNonce));
+            return;
+        }
+    }
+}
+
+bool ScanNonces(CBlockHeader* pblock, uint32_t nNonceEnd, int nThreads, const Consensus::Params& consensusParams)
+{
+    const uint32_t nNonceBegin = pblock->nNonce;
+    if (nNonceBegin >= nNonceEnd)
+        return false;
+    nThreads = std::max(1, std::min<int>(nThreads, nNonceEnd - nNonceBegin));
+
+    // Workers stop once a lower nonce than their next one has been found, so
+    // the lowest solution in the range wins regardless of scheduling
+    std::atomic<uint32_t> nFound(nNonceEnd);
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.create_thread(boost::bind(&ScanNoncesWorker, *pblock, nNonceBegin + i, nNonceEnd, nThreads, &nFound, &consensusParams));
+    ScanNoncesWorker(*pblock, nNonceBegin, nNonceEnd, nThreads, &nFound, &consensusParams);
+    threads.join_all();
+
+    if (nFound.load() == nNonceEnd)
+        return false;
+    pblock->nNonce = nFound.load();
+    return true;
+}
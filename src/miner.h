@@ -7,22 +7,29 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "sync.h"
 #include "txmempool.h"
 
 #include <stdint.h>
 #include <memory>
+#include <unordered_set>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
 class CBlockIndex;
 class CChainParams;
 class CReserveKey;
+class CScheduler;
 class CScript;
 class CWallet;
 
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Seconds between full rebuilds of a template that new transactions no longer fit into */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 5;
+/** Default for -genthreads, 0 = one thread per core */
+static const int DEFAULT_GENERATE_THREADS = 0;
 
 struct CBlockTemplate
 {
@@ -154,6 +161,7 @@ private:
     CTxMemPool::setEntries inBlock;
 
     // Chain context for the block
+    CBlockIndex* pindexPrev;
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
@@ -162,15 +170,43 @@ private:
     int lastFewTxs;
     bool blockFinished;
 
+    // Whether a package was left out for lack of space since the last UpdateBlock
+    bool fSkippedPackage;
+
 public:
     BlockAssembler(const CChainParams& chainparams);
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
 
+    /**
+     * Select transactions for a block on the current tip like CreateNewBlock,
+     * but keep them, so that UpdateBlock can add transactions that enter the
+     * mempool later without starting over. Returns a copy of the template,
+     * which has not been checked with TestBlockValidity.
+     * Requires cs_main and mempool.cs.
+     */
+    std::unique_ptr<CBlockTemplate> StartBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
+
+    /**
+     * Add the packages of transactions that entered the mempool since
+     * StartBlock or the last UpdateBlock to the kept template. None of the
+     * transactions selected so far may have left the mempool, and the tip
+     * must not have changed. Returns a copy of the template, which has not
+     * been checked with TestBlockValidity. Requires cs_main and mempool.cs.
+     */
+    std::unique_ptr<CBlockTemplate> UpdateBlock(const std::vector<CTxMemPool::txiter>& vNew, const CScript& scriptPubKeyIn);
+
+    /** Whether the last UpdateBlock left out a package for lack of space */
+    bool SkippedPackage() const { return fSkippedPackage; }
+
 private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Set up a new block on the current tip and select its transactions */
+    bool SelectTransactions(bool fMineWitnessTx, int &nPackagesSelected, int &nDescendantsUpdated);
+    /** Fill in the coinbase paying to scriptPubKeyIn and the header */
+    void FinishBlock(const CScript& scriptPubKeyIn);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
@@ -179,8 +215,9 @@ private:
     void addPriorityTxs();
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
+      * statistics from the package selection (for logging statistics).
+      * If pvNew is given, only packages of those transactions are considered. */
+    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* pvNew = NULL);
 
     // helper function for addPriorityTxs
     /** Test if tx will still "fit" in the block */
@@ -207,10 +244,78 @@ private:
       * state updated assuming given transactions are inBlock. Returns number
       * of updated descendants. */
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
+    /** Add the given transactions not yet in the block to mapModifiedTx with
+      * ancestor state updated for their ancestors already in the block */
+    void AddPackagesForNew(const std::vector<CTxMemPool::txiter>& vNew, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Serves block templates for getblocktemplate from a BlockAssembler that is
+ * kept across calls. Transactions entering the mempool are only added to the
+ * transactions already selected, which takes time in the number of new
+ * transactions rather than the size of the mempool. The template is built
+ * from scratch when the tip changes, when a selected transaction leaves the
+ * mempool, and at most every BLOCK_TEMPLATE_REBUILD_INTERVAL seconds once new
+ * packages stop fitting, so that better paying ones can displace others.
+ *
+ * TestBlockValidity runs on the scheduler thread for the latest template
+ * instead of delaying the caller. Should a template fail it, the next one is
+ * built from scratch and checked before it is returned. Without a scheduler,
+ * as in the unit tests, templates are not checked.
+ */
+class BlockTemplateEngine
+{
+private:
+    CCriticalSection cs;
+    const CChainParams& chainparams;
+    CScheduler* pscheduler;
+
+    //! Holds the transactions selected for the current template
+    std::unique_ptr<BlockAssembler> assembler;
+    CBlockIndex* pindexPrev;
+    bool fSupportsSegwit;
+    //! Transactions that entered the mempool since the last template
+    std::vector<uint256> vAdded;
+    //! Transactions in the current template
+    std::unordered_set<uint256, SaltedTxidHasher> setInTemplate;
+    //! A selected transaction left the mempool
+    bool fStale;
+    //! A new package did not fit into the template
+    bool fSkippedPackage;
+    int64_t nLastRebuild;
+
+    //! Latest template waiting to be checked, and whether a check is scheduled
+    std::shared_ptr<const CBlock> pblockToCheck;
+    bool fCheckScheduled;
+    //! The last checked template failed TestBlockValidity
+    bool fInvalid;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    void CheckTemplate();
+
+public:
+    BlockTemplateEngine(const CChainParams& chainparams, CScheduler* pschedulerIn);
+    ~BlockTemplateEngine();
+
+    /** Return a template for a block on the current tip with coinbase to scriptPubKeyIn */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CScript& scriptPubKeyIn, bool fSupportsSegwitIn);
+
+    /** Build the next template from scratch, e.g. after fee deltas changed */
+    void MarkStale();
+};
+
+extern std::unique_ptr<BlockTemplateEngine> g_blocktemplateengine;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
+/**
+ * Search the nonces from pblock->nNonce up to nNonceEnd for one that meets the
+ * block's proof of work target, split across nThreads threads. On success
+ * pblock->nNonce is set to the lowest such nonce, the same one a sequential
+ * search would find.
+ */
+bool ScanNonces(CBlockHeader* pblock, uint32_t nNonceEnd, int nThreads, const Consensus::Params& consensusParams);
 
 #endif // BITCOIN_MINER_H
@@ -26,6 +26,11 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -44,6 +49,13 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+/** Longest wait for socket events, after which disconnections are handled (milliseconds) */
+static const int SOCKET_EVENTS_TIMEOUT = 50;
+/** Maximum number of epoll events handled per wakeup */
+static const int EPOLL_MAX_EVENTS = 64;
+/** Maximum number of queued buffers handed to a single sendmsg() call */
+static const int MAX_SEND_IOV = 64;
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -361,7 +373,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -691,7 +703,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION, recvBufferPool);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -714,16 +726,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         nBytes -= handled;
 
         if (msg.complete()) {
-
-            //store received bytes per message command
-            //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
-            if (i == mapRecvBytesPerMsgCmd.end())
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
-
-            msg.nTime = nTimeMicros;
+            MarkMsgComplete(msg, nTimeMicros);
             complete = true;
         }
     }
@@ -731,6 +734,49 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+bool CNode::GetRecvBuffer(char*& pch, unsigned int& nSize)
+{
+    LOCK(cs_vRecv);
+    if (vRecvMsg.empty())
+        return false;
+    CNetMessage& msg = vRecvMsg.back();
+    // Small payloads are read along with the messages around them, so a
+    // burst of small messages still takes a single recv()
+    if (!msg.in_data || msg.hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH || msg.hdr.nMessageSize - msg.nDataPos < RECV_SCRATCH_SIZE)
+        return false;
+    pch = msg.GetDataBuffer(msg.hdr.nMessageSize - msg.nDataPos, nSize);
+    return true;
+}
+
+void CNode::ReceivedMsgData(unsigned int nBytes, bool& complete)
+{
+    complete = false;
+    int64_t nTimeMicros = GetTimeMicros();
+    LOCK(cs_vRecv);
+    nLastRecv = nTimeMicros / 1000000;
+    nRecvBytes += nBytes;
+
+    CNetMessage& msg = vRecvMsg.back();
+    msg.DataReceived(nBytes);
+    if (msg.complete()) {
+        MarkMsgComplete(msg, nTimeMicros);
+        complete = true;
+    }
+}
+
+void CNode::MarkMsgComplete(CNetMessage& msg, int64_t nTimeMicros)
+{
+    //store received bytes per message command
+    //to prevent a memory DOS, only allow valid commands
+    mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
+    if (i == mapRecvBytesPerMsgCmd.end())
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+
+    msg.nTime = nTimeMicros;
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -789,23 +835,95 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
-int CNetMessage::readData(const char *pch, unsigned int nBytes)
+char* CNetMessage::GetDataBuffer(unsigned int nMaxSize, unsigned int& nSize)
 {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    nSize = std::min(std::min(nRemaining, nMaxSize), RECV_ALLOC_STEP);
 
-    if (vRecv.size() < nDataPos + nCopy) {
+    if (vRecv.size() < nDataPos + nSize) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // The buffer only grows as the payload arrives, so a peer cannot make
+        // us commit memory for a large message by sending just its header.
+        unsigned int nNewSize = std::min(hdr.nMessageSize, nDataPos + nSize + RECV_ALLOC_STEP);
+        if (vRecv.capacity() < nNewSize) {
+            // Reuse an earlier large message's buffer once data starts arriving
+            if (pool && vRecv.capacity() == 0 && nNewSize >= RECV_SCRATCH_SIZE) {
+                CSerializeData vch = pool->Get(hdr.nMessageSize);
+                vch.clear();
+                vRecv.SwapBuffer(vch);
+            }
+            if (vRecv.capacity() < nNewSize)
+                vRecv.reserve(std::min(hdr.nMessageSize, std::max(nNewSize, 2 * (unsigned int)vRecv.capacity())));
+        }
+        vRecv.resize(nNewSize);
     }
 
-    hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+    return vRecv.data() + nDataPos;
+}
+
+void CNetMessage::DataReceived(unsigned int nBytes)
+{
+    hasher.Write((const unsigned char*)vRecv.data() + nDataPos, nBytes);
+    nDataPos += nBytes;
+}
+
+int CNetMessage::readData(const char *pch, unsigned int nBytes)
+{
+    unsigned int nCopy;
+    char* pchData = GetDataBuffer(nBytes, nCopy);
+
+    memcpy(pchData, pch, nCopy);
+    DataReceived(nCopy);
 
     return nCopy;
 }
 
+CNetMessage::~CNetMessage()
+{
+    if (pool) {
+        CSerializeData vch;
+        vRecv.clear();
+        vRecv.SwapBuffer(vch);
+        if (vch.capacity() > 0)
+            pool->Put(std::move(vch));
+    }
+}
+
+static_assert(MAX_RECV_POOL_SIZE >= MAX_BLOCK_SERIALIZED_SIZE, "the receive buffer pool must be able to keep a block's buffer");
+
+CSerializeData CNetMessageBufferPool::Get(size_t nSize)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (vBuffers.empty())
+        return CSerializeData();
+
+    std::vector<CSerializeData>::iterator itBest = vBuffers.begin();
+    for (std::vector<CSerializeData>::iterator it = vBuffers.begin(); it != vBuffers.end(); ++it) {
+        bool fFits = it->capacity() >= nSize;
+        bool fBestFits = itBest->capacity() >= nSize;
+        if (fFits ? (!fBestFits || it->capacity() < itBest->capacity()) : (!fBestFits && it->capacity() > itBest->capacity()))
+            itBest = it;
+    }
+
+    CSerializeData vch;
+    vch.swap(*itBest);
+    vBuffers.erase(itBest);
+    nPoolSize -= vch.capacity();
+    return vch;
+}
+
+void CNetMessageBufferPool::Put(CSerializeData&& vch)
+{
+    // Small buffers are cheap to allocate and would only take up room
+    if (vch.capacity() < RECV_SCRATCH_SIZE)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (vBuffers.size() >= MAX_RECV_POOL_BUFFERS || nPoolSize + vch.capacity() > MAX_RECV_POOL_SIZE)
+        return;
+    nPoolSize += vch.capacity();
+    vBuffers.push_back(std::move(vch));
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -829,27 +947,56 @@ size_t CConnman::SocketSendData(CNode *pnode) const
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
         int nBytes = 0;
+        size_t nTrySize = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifndef WIN32
+            // Gather the headers and payloads of the queued messages into one call
+            struct iovec iov[MAX_SEND_IOV];
+            int nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV; ++itIov, ++nIov) {
+                const std::vector<unsigned char>& data = **itIov;
+                iov[nIov].iov_base = const_cast<unsigned char*>(data.data()) + nOffset;
+                iov[nIov].iov_len = data.size() - nOffset;
+                nTrySize += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            const std::vector<unsigned char>& data = **it;
+            nTrySize = data.size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nTrySize, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Skip past the buffers that went out completely
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                size_t nBufferLeft = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nBufferLeft) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nBufferLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nTrySize) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1055,7 +1202,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1101,12 +1248,317 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocketEvents(pnode);
+    }
+}
+
+SocketEventsMode GetDefaultSocketEventsMode()
+{
+#ifdef USE_EPOLL
+    return SOCKETEVENTS_EPOLL;
+#else
+    return SOCKETEVENTS_SELECT;
+#endif
+}
+
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode)
+{
+    if (strMode == "select") {
+        mode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (strMode == "epoll") {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SOCKETEVENTS_SELECT: return "select";
+    case SOCKETEVENTS_EPOLL: return "epoll";
+    }
+    return "";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string strModes = "select";
+#ifdef USE_EPOLL
+    strModes += ", epoll";
+#endif
+    return strModes;
+}
+
+void CConnman::RegisterSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode != SOCKETEVENTS_EPOLL)
+        return;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+
+    // Registered once for the lifetime of the socket; closing the socket
+    // removes it from the epoll set again.
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
+void CConnman::UnregisterSocketEvents(CNode* pnode)
+{
+    setEpollRecvReady.erase(pnode);
+    setEpollSendReady.erase(pnode);
+}
+
+void CConnman::WakeSocketHandler()
+{
+#ifndef WIN32
+    if (wakeupPipe[1] == -1)
+        return;
+    char buf[1] = {0};
+    if (write(wakeupPipe[1], buf, sizeof(buf)) != 1 && errno != EAGAIN)
+        LogPrint("net", "write to wakeup pipe failed: %s\n", NetworkErrorString(errno));
+#endif
+}
+
+static void DrainWakeupPipe(int fd)
+{
+#ifndef WIN32
+    char buf[128];
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+#endif
+}
+
+void CConnman::SocketEventsSelect(std::set<SOCKET>& setListenReady, std::set<CNode*>& setRecvReady, std::set<CNode*>& setSendReady)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_EVENTS_TIMEOUT * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    if (wakeupPipe[0] != -1) {
+        FD_SET(wakeupPipe[0], &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, (SOCKET)wakeupPipe[0]);
+        have_fds = true;
+    }
+
+    std::vector<std::pair<CNode*, SOCKET> > vSockets;
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+            vSockets.push_back(std::make_pair(pnode, pnode->hSocket));
+
+            if (select_send) {
+                FD_SET(pnode->hSocket, &fdsetSend);
+                continue;
+            }
+            if (select_recv) {
+                FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+            return;
+    }
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        if (FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            setListenReady.insert(hListenSocket.socket);
+    }
+
+    if (wakeupPipe[0] != -1 && FD_ISSET(wakeupPipe[0], &fdsetRecv))
+        DrainWakeupPipe(wakeupPipe[0]);
+
+    // The sockets were copied above, as a node may close its socket (and
+    // the descriptor be reused) while select() waits
+    for (const auto& item : vSockets) {
+        if (FD_ISSET(item.second, &fdsetRecv) || FD_ISSET(item.second, &fdsetError))
+            setRecvReady.insert(item.first);
+        if (FD_ISSET(item.second, &fdsetSend))
+            setSendReady.insert(item.first);
+    }
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::set<SOCKET>& setListenReady, std::set<CNode*>& setRecvReady, std::set<CNode*>& setSendReady)
+{
+    // As with select(), drain the send buffer of a node before receiving
+    // more, and leave nodes with a full receive buffer alone
+    auto fnCanRecv = [](CNode* pnode) {
+        if (pnode->fPauseRecv)
+            return false;
+        LOCK(pnode->cs_vSend);
+        return pnode->vSendMsg.empty();
+    };
+
+    // Nodes with data left from an earlier edge are serviced without waiting
+    bool fPending = !setEpollSendReady.empty();
+    for (CNode* pnode : setEpollRecvReady) {
+        if (fnCanRecv(pnode)) {
+            fPending = true;
+            break;
+        }
+    }
+
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, EPOLL_MAX_EVENTS, fPending ? 0 : SOCKET_EVENTS_TIMEOUT);
+    if (interruptNet)
+        return;
+
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT)))
+                return;
+        }
+        nEvents = 0;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        void* ptr = events[i].data.ptr;
+        if (ptr == &vhListenSocket) {
+            // Listening sockets are level-triggered, and all checked by accept()
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+                setListenReady.insert(hListenSocket.socket);
+        } else if (ptr == wakeupPipe) {
+            DrainWakeupPipe(wakeupPipe[0]);
+        } else {
+            // Nodes stay registered until their socket is closed, and are
+            // only deleted by this thread after that
+            CNode* pnode = static_cast<CNode*>(ptr);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                setEpollRecvReady.insert(pnode);
+            if (events[i].events & EPOLLOUT)
+                setEpollSendReady.insert(pnode);
+        }
+    }
+
+    for (CNode* pnode : setEpollRecvReady) {
+        if (fnCanRecv(pnode))
+            setRecvReady.insert(pnode);
+    }
+    setSendReady = setEpollSendReady;
+}
+#endif
+
+void CConnman::SocketEvents(std::set<SOCKET>& setListenReady, std::set<CNode*>& setRecvReady, std::set<CNode*>& setSendReady)
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        SocketEventsEpoll(setListenReady, setRecvReady, setSendReady);
+        return;
+    }
+#endif
+    SocketEventsSelect(setListenReady, setRecvReady, setSendReady);
+}
+
+void CConnman::InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetSystemTimeInSeconds();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+        else if (!pnode->fSuccessfullyConnected)
+        {
+            LogPrintf("version handshake timeout from %d\n", pnode->id);
+            pnode->fDisconnect = true;
+        }
     }
 }
 
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
     while (!interruptNet)
     {
         //
@@ -1122,6 +1574,7 @@ void CConnman::ThreadSocketHandler()
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                    UnregisterSocketEvents(pnode);
 
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
@@ -1173,105 +1626,38 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::set<SOCKET> setListenReady;
+        std::set<CNode*> setRecvReady;
+        std::set<CNode*> setSendReady;
+        SocketEvents(setListenReady, setRecvReady, setSendReady);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && setListenReady.count(hListenSocket.socket))
             {
                 AcceptConnection(hListenSocket);
             }
         }
 
         //
-        // Service each socket
+        // Service each socket that is ready
         //
+        std::set<CNode*> setServiced(setRecvReady);
+        setServiced.insert(setSendReady.begin(), setSendReady.end());
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (!setServiced.count(pnode))
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
+            }
         }
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
@@ -1281,34 +1667,29 @@ void CConnman::ThreadSocketHandler()
             //
             // Receive
             //
-            bool recvSet = false;
-            bool sendSet = false;
-            bool errorSet = false;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
-            }
-            if (recvSet || errorSet)
+            if (setRecvReady.count(pnode))
             {
                 {
                     {
                         // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
+                        char pchBuf[RECV_SCRATCH_SIZE];
+                        char* pchRecv = pchBuf;
+                        unsigned int nRecvSize = sizeof(pchBuf);
+                        // Large payloads are received straight into their message
+                        bool fInPlace = pnode->GetRecvBuffer(pchRecv, nRecvSize);
                         int nBytes = 0;
                         {
                             LOCK(pnode->cs_hSocket);
                             if (pnode->hSocket == INVALID_SOCKET)
                                 continue;
-                            nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                            nBytes = recv(pnode->hSocket, pchRecv, nRecvSize, MSG_DONTWAIT);
                         }
                         if (nBytes > 0)
                         {
                             bool notify = false;
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+                            if (fInPlace)
+                                pnode->ReceivedMsgData(nBytes, notify);
+                            else if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
                                 pnode->CloseSocketDisconnect();
                             RecordBytesRecv(nBytes);
                             if (notify) {
@@ -1325,7 +1706,7 @@ void CConnman::ThreadSocketHandler()
                                     pnode->nProcessQueueSize += nSizeAdded;
                                     pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                                 }
-                                WakeMessageHandler();
+                                WakeMessageHandler(pnode);
                             }
                         }
                         else if (nBytes == 0)
@@ -1345,6 +1726,11 @@ void CConnman::ThreadSocketHandler()
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
                             }
+                            else if (nErr == WSAEWOULDBLOCK)
+                            {
+                                // Drained; wait for the next edge
+                                setEpollRecvReady.erase(pnode);
+                            }
                         }
                     }
                 }
@@ -1353,46 +1739,17 @@ void CConnman::ThreadSocketHandler()
             //
             // Send
             //
-            if (sendSet)
+            if (setSendReady.count(pnode))
             {
                 LOCK(pnode->cs_vSend);
                 size_t nBytes = SocketSendData(pnode);
                 if (nBytes) {
                     RecordBytesSent(nBytes);
                 }
-            }
-
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetSystemTimeInSeconds();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-                else if (!pnode->fSuccessfullyConnected)
-                {
-                    LogPrintf("version handshake timeout from %d\n", pnode->id);
-                    pnode->fDisconnect = true;
-                }
+                // Either everything was sent, and later messages are sent
+                // optimistically by PushMessage, or the socket is full and
+                // the next edge follows when it has room again
+                setEpollSendReady.erase(pnode);
             }
         }
         {
@@ -1400,6 +1757,18 @@ void CConnman::ThreadSocketHandler()
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->Release();
         }
+
+        //
+        // Inactivity checking
+        //
+        int64_t nTime = GetSystemTimeInSeconds();
+        if (nTime != nLastInactivityCheck)
+        {
+            nLastInactivityCheck = nTime;
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
+                InactivityCheck(pnode);
+        }
     }
 }
 
@@ -1407,9 +1776,21 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        std::fill(vMsgProcWake.begin(), vMsgProcWake.end(), true);
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
+}
+
+void CConnman::WakeMessageHandler(const CNode* pnode)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        if (vMsgProcWake.empty())
+            return;
+        vMsgProcWake[GetMessageHandlerThread(pnode)] = true;
+    }
+    // All threads share the condition variable and check their own flag
+    condMsgProc.notify_all();
 }
 
 
@@ -1960,21 +2341,29 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocketEvents(pnode);
     }
 
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+int CConnman::GetMessageHandlerThread(const CNode* pnode) const
+{
+    return pnode->GetId() % nMsgHandThreads;
+}
+
+void CConnman::ThreadMessageHandler(int nThread)
 {
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (GetMessageHandlerThread(pnode) != nThread)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
@@ -2008,9 +2397,9 @@ void CConnman::ThreadMessageHandler()
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nThread] { return vMsgProcWake[nThread]; });
         }
-        fMsgProcWake = false;
+        vMsgProcWake[nThread] = false;
     }
 }
 
@@ -2205,6 +2594,10 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+    nMsgHandThreads = 1;
+    socketEventsMode = SOCKETEVENTS_SELECT;
+    epollfd = -1;
+    wakeupPipe[0] = wakeupPipe[1] = -1;
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2232,6 +2625,9 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
 
+    socketEventsMode = connOptions.socketEventsMode;
+    nMsgHandThreads = std::max(1, std::min(connOptions.nMsgHandThreads, MAX_MSGHAND_THREADS));
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2290,9 +2686,47 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        vMsgProcWake.assign(nMsgHandThreads, false);
     }
 
+#ifndef WIN32
+    if (wakeupPipe[0] == -1) {
+        if (pipe(wakeupPipe) != 0) {
+            LogPrintf("Unable to create wakeup pipe: %s\n", NetworkErrorString(WSAGetLastError()));
+            wakeupPipe[0] = wakeupPipe[1] = -1;
+        } else {
+            for (int i = 0; i < 2; i++)
+                fcntl(wakeupPipe[i], F_SETFL, fcntl(wakeupPipe[i], F_GETFL, 0) | O_NONBLOCK);
+        }
+    }
+#endif
+
+#ifdef USE_EPOLL
+    if (socketEventsMode == SOCKETEVENTS_EPOLL && epollfd == -1) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1) {
+            LogPrintf("Unable to create epoll instance, falling back to select: %s\n", NetworkErrorString(WSAGetLastError()));
+            socketEventsMode = SOCKETEVENTS_SELECT;
+        } else {
+            // Listening sockets and the wakeup pipe are level-triggered, and
+            // identified by the address of their container
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = &vhListenSocket;
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+                if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0)
+                    LogPrintf("epoll_ctl failed for listening socket: %s\n", NetworkErrorString(WSAGetLastError()));
+            }
+            if (wakeupPipe[0] != -1) {
+                event.data.ptr = wakeupPipe;
+                if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupPipe[0], &event) != 0)
+                    LogPrintf("epoll_ctl failed for wakeup pipe: %s\n", NetworkErrorString(WSAGetLastError()));
+            }
+        }
+    }
+#endif
+    LogPrintf("Using %s for socket events\n", GetSocketEventsModeName(socketEventsMode));
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2309,7 +2743,13 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    LogPrintf("Using %d message handler threads\n", nMsgHandThreads);
+    for (int i = 0; i < nMsgHandThreads; i++) {
+        std::string strThreadName = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        threadMessageHandlers.push_back(std::thread([this, i, strThreadName] {
+            TraceThread(strThreadName.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i)));
+        }));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL);
@@ -2341,6 +2781,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2358,8 +2799,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    BOOST_FOREACH(std::thread& threadMessageHandler, threadMessageHandlers) {
+        if (threadMessageHandler.joinable())
+            threadMessageHandler.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2392,7 +2836,24 @@ void CConnman::Stop()
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+    setEpollRecvReady.clear();
+    setEpollSendReady.clear();
     vhListenSocket.clear();
+
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
+#ifndef WIN32
+    for (int i = 0; i < 2; i++) {
+        if (wakeupPipe[i] != -1) {
+            close(wakeupPipe[i]);
+            wakeupPipe[i] = -1;
+        }
+    }
+#endif
     delete semOutbound;
     semOutbound = NULL;
     delete semAddnode;
@@ -2699,6 +3160,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     minFeeFilter = 0;
     lastSentFeeFilter = 0;
     nextSendTimeFeeFilter = 0;
+    recvBufferPool = std::make_shared<CNetMessageBufferPool>();
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
@@ -2760,17 +3222,28 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg)
+    : data(std::make_shared<const std::vector<unsigned char>>(std::move(msg.data))),
+      command(std::move(msg.command)),
+      hash(Hash(data->begin(), data->end()))
+{
+}
+
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    PushMessage(pnode, CSharedNetMsg(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.data->size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    memcpy(hdr.pchChecksum, msg.hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
@@ -2785,9 +3258,9 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader)));
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.data);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
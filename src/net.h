@@ -28,6 +28,7 @@
 #include <thread>
 #include <memory>
 #include <condition_variable>
+#include <set>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -59,6 +60,13 @@ static const unsigned int MAX_ADDR_TO_SEND = 1000;
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
 /** Maximum length of strSubVer in `version` message */
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
+/** Size of the scratch buffer for socket reads; larger payloads are received in place */
+static const unsigned int RECV_SCRATCH_SIZE = 0x10000;
+/** How far ahead of the received data a payload buffer is allocated */
+static const unsigned int RECV_ALLOC_STEP = 256 * 1024;
+/** Maximum number and total size of the payload buffers each peer keeps for reuse */
+static const size_t MAX_RECV_POOL_BUFFERS = 4;
+static const size_t MAX_RECV_POOL_SIZE = MAX_PROTOCOL_MESSAGE_LENGTH;
 /** Maximum number of automatic outgoing nodes */
 static const int MAX_OUTBOUND_CONNECTIONS = 8;
 /** Maximum number of addnode outgoing nodes */
@@ -87,12 +95,32 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -msghandthreads default */
+static const int DEFAULT_MSGHAND_THREADS = 2;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
+/** Ways of waiting for socket events in the socket handler thread, see -socketevents */
+enum SocketEventsMode {
+    // select(), available everywhere but limited to FD_SETSIZE sockets
+    SOCKETEVENTS_SELECT = 0,
+    // Edge-triggered epoll (Linux only), with sockets registered once
+    SOCKETEVENTS_EPOLL = 1,
+};
+
+/** The best socket events mode available on this platform */
+SocketEventsMode GetDefaultSocketEventsMode();
+/** Parse a -socketevents value; fails for modes not available on this platform */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+/** Comma separated names of the socket events modes available on this platform */
+std::string GetSupportedSocketEventsModes();
+
 typedef int64_t NodeId;
 
 struct AddedNodeInfo
@@ -120,6 +148,20 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * A message that is serialized and checksummed once, and can then be queued
+ * for any number of peers. They all send the same immutable payload.
+ */
+struct CSharedNetMsg
+{
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    std::string command;
+    uint256 hash; //!< Hash of the payload, for the checksum in the header
+
+    CSharedNetMsg() {}
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+};
+
 
 class CConnman
 {
@@ -146,6 +188,8 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
+        int nMsgHandThreads = 1;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -161,6 +205,7 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     template<typename Callable>
     void ForEachNode(Callable&& func)
@@ -286,7 +331,12 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all message handler threads */
     void WakeMessageHandler();
+    /** Wake the message handler thread that processes the given node */
+    void WakeMessageHandler(const CNode* pnode);
+    /** Interrupt the socket handler thread while it waits for socket events */
+    void WakeSocketHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -298,9 +348,28 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    /**
+     * Each message handler thread processes a fixed subset of the nodes, so
+     * the messages of a node are always handled in order by the same thread.
+     */
+    void ThreadMessageHandler(int nThread);
+    int GetMessageHandlerThread(const CNode* pnode) const;
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
+    /** Check a node for timeouts, and mark it for disconnection */
+    void InactivityCheck(CNode* pnode);
+
+    /**
+     * Wait for socket events. Returns the listening sockets with connections
+     * to accept, and the nodes to receive from and to send to.
+     */
+    void SocketEvents(std::set<SOCKET>& setListenReady, std::set<CNode*>& setRecvReady, std::set<CNode*>& setSendReady);
+    void SocketEventsSelect(std::set<SOCKET>& setListenReady, std::set<CNode*>& setRecvReady, std::set<CNode*>& setSendReady);
+    void SocketEventsEpoll(std::set<SOCKET>& setListenReady, std::set<CNode*>& setRecvReady, std::set<CNode*>& setSendReady);
+    /** Start watching a new node's socket; needed once per node in epoll mode */
+    void RegisterSocketEvents(CNode* pnode);
+    /** Forget a node that is being disconnected */
+    void UnregisterSocketEvents(CNode* pnode);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -357,6 +426,20 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+
+    SocketEventsMode socketEventsMode;
+    /** epoll instance, in epoll mode */
+    int epollfd;
+    /**
+     * Nodes whose sockets were reported readable or writable by epoll, and
+     * that have not yet hit EWOULDBLOCK since. With edge-triggered events
+     * these are the only nodes with pending socket work. Only used by the
+     * socket handler thread.
+     */
+    std::set<CNode*> setEpollRecvReady;
+    std::set<CNode*> setEpollSendReady;
+    /** Self-pipe used to wake the socket handler thread; -1 where unavailable */
+    int wakeupPipe[2];
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -390,8 +473,9 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** flags for waking each message handler thread, guarded by mutexMsgProc */
+    std::vector<bool> vMsgProcWake;
+    int nMsgHandThreads;
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -403,7 +487,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group& threadGroup);
@@ -515,10 +599,34 @@ public:
 
 
 
+/**
+ * Payload buffers of the messages received from one peer. When a message has
+ * been processed its buffer comes back here and is used for a later message,
+ * so a peer that keeps sending blocks does not cost an allocation, a series
+ * of reallocations while the payload arrives, and a cleanse of the freed
+ * memory per message.
+ */
+class CNetMessageBufferPool
+{
+private:
+    std::mutex mutex;
+    std::vector<CSerializeData> vBuffers;
+    size_t nPoolSize;
+
+public:
+    CNetMessageBufferPool() : nPoolSize(0) {}
+
+    /** Take the smallest buffer that can hold nSize bytes, or the largest one there is */
+    CSerializeData Get(size_t nSize);
+    /** Return a buffer, which is dropped instead if the pool is full */
+    void Put(CSerializeData&& vch);
+};
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
     mutable uint256 data_hash;
+    std::shared_ptr<CNetMessageBufferPool> pool;
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
@@ -531,13 +639,20 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn, std::shared_ptr<CNetMessageBufferPool> poolIn = nullptr) : pool(std::move(poolIn)), hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
+    ~CNetMessage();
+
+    // Moves only, so a payload buffer goes back to the pool once
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    CNetMessage(const CNetMessage&) = delete;
+    CNetMessage& operator=(const CNetMessage&) = delete;
 
     bool complete() const
     {
@@ -556,6 +671,15 @@ public:
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    /**
+     * Get the place in the payload where up to nMaxSize of the next bytes
+     * go, and the number of bytes that fit there. This lets the payload be
+     * received from the socket directly, without copying it.
+     */
+    char* GetDataBuffer(unsigned int nMaxSize, unsigned int& nSize);
+    /** Account for nBytes written to the buffer returned by GetDataBuffer */
+    void DataReceived(unsigned int nBytes);
 };
 
 
@@ -571,10 +695,11 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
+    std::shared_ptr<CNetMessageBufferPool> recvBufferPool;
 
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
@@ -631,6 +756,9 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // vAddrToSend and addrKnown are also used by the message handler
+    // threads of the nodes that relay addresses to this one
+    CCriticalSection cs_addrSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -701,6 +829,8 @@ private:
 
     CService addrLocal;
     mutable CCriticalSection cs_addrLocal;
+
+    void MarkMsgComplete(CNetMessage& msg, int64_t nTimeMicros);
 public:
 
     NodeId GetId() const {
@@ -722,6 +852,14 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /**
+     * Get where the next bytes from the socket go when they are part of a
+     * large payload, so they can be received into the message without a
+     * copy. Returns false if they should go through ReceiveMsgBytes.
+     */
+    bool GetRecvBuffer(char*& pch, unsigned int& nSize);
+    /** Account for nBytes received into the buffer from GetRecvBuffer */
+    void ReceivedMsgData(unsigned int nBytes, bool& complete);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -753,6 +891,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -761,6 +900,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.rand32() % vAddrToSend.size()] = _addr;
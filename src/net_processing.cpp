@@ -11,6 +11,7 @@
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
+#include "index/blockfilterindex.h"
 #include "init.h"
 #include "validation.h"
 #include "merkleblock.h"
@@ -105,6 +106,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -117,13 +119,40 @@ namespace {
     /** Number of peers from which we're downloading blocks. */
     int nPeersWithValidatedDownloads = 0;
 
+    /** A relayed transaction, with its tx messages serialized for the first peer that asks */
+    struct RelayEntry {
+        CTransactionRef tx;
+        CSharedNetMsg msgs[2]; //!< without and with witness data
+
+        explicit RelayEntry(CTransactionRef txIn) : tx(std::move(txIn)) {}
+    };
+
     /** Relay map, protected by cs_main. */
-    typedef std::map<uint256, CTransactionRef> MapRelay;
+    typedef std::map<uint256, RelayEntry> MapRelay;
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
 } // anon namespace
 
+int64_t UpdateBlockDownloadAverage(int64_t nAverage, int64_t nSample)
+{
+    return nAverage ? (7 * nAverage + nSample) / 8 : nSample;
+}
+
+int GetBlockDownloadWindow(int64_t nBlockServiceTime)
+{
+    int64_t nWindow = BLOCK_DOWNLOAD_TARGET_LATENCY / std::max<int64_t>(nBlockServiceTime, 1);
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER, nWindow));
+}
+
+bool ShouldRequestStalledBlock(int64_t nAge, int64_t nLatency, int64_t nStallerLatency)
+{
+    if (nLatency == 0)
+        return false;
+    return nAge > std::max(2 * nLatency, BLOCK_DOWNLOAD_TARGET_LATENCY) &&
+           (nStallerLatency == 0 || nLatency < nStallerLatency);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Registration of network node signals.
@@ -175,6 +204,14 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving average of the time from requesting a block from this peer until it arrives (in microseconds), or 0 if unknown.
+    int64_t nBlockLatency;
+    //! Moving average of the time this peer takes per block while it has requests queued (in microseconds), or 0 if unknown.
+    int64_t nBlockServiceTime;
+    //! When the last block we requested from this peer arrived (in microseconds).
+    int64_t nLastBlockReceived;
+    //! How many blocks may be in flight from this peer, sized to its measured throughput.
+    int nBlockWindow;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -211,6 +248,10 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlockLatency = 0;
+        nBlockServiceTime = 0;
+        nLastBlockReceived = 0;
+        nBlockWindow = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -329,6 +370,25 @@ bool MarkBlockAsReceived(const uint256& hash) {
     return false;
 }
 
+// Requires cs_main.
+// Measures how fast the peer delivered a block we requested from it, and sizes its download window so that
+// about BLOCK_DOWNLOAD_TARGET_LATENCY worth of blocks stays queued at the peer. Call before MarkBlockAsReceived.
+void UpdateBlockDownloadSpeed(NodeId nodeid, const uint256& hash) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    const QueuedBlock& queuedBlock = *itInFlight->second.second;
+    int64_t nNow = GetTimeMicros();
+    int64_t nLatency = nNow - queuedBlock.nTimeRequested;
+    // If the peer was idle before this request, its whole latency was spent on this block
+    int64_t nServiceTime = nNow - std::max(state->nLastBlockReceived, queuedBlock.nTimeRequested);
+    state->nBlockLatency = UpdateBlockDownloadAverage(state->nBlockLatency, nLatency);
+    state->nBlockServiceTime = UpdateBlockDownloadAverage(state->nBlockServiceTime, nServiceTime);
+    state->nLastBlockReceived = nNow;
+    state->nBlockWindow = GetBlockDownloadWindow(state->nBlockServiceTime);
+}
+
 // Requires cs_main.
 // returns false, still setting pit, if the block was already in flight from the same peer
 // pit will only be valid as long as the same cs_main lock is being held
@@ -347,7 +407,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)});
+            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -467,8 +527,9 @@ const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex*
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
+ *  at most count entries. If the download window is full, nodeStaller and pindexStalled are set to
+ *  the peer and the in-flight block that hold it up. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalled, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
 
@@ -504,6 +565,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -539,6 +601,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -549,6 +612,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -564,6 +628,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+    stats.nBlockWindow = state->nBlockWindow;
+    stats.nBlockLatency = state->nBlockLatency;
     BOOST_FOREACH(const QueuedBlock& queue, state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
@@ -775,10 +841,38 @@ static CCriticalSection cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
+/**
+ * Messages carrying the most recent block, by command and whether they
+ * include witness data. Each is serialized for the first peer that needs it
+ * and then shared by all the others.
+ */
+static std::map<std::pair<std::string, bool>, CSharedNetMsg> most_recent_block_msgs;
+
+/** Get a block or cmpctblock message for the most recent block. Requires cs_most_recent_block. */
+static CSharedNetMsg GetMostRecentBlockMsg(const std::string& strCommand, bool fWitness)
+{
+    AssertLockHeld(cs_most_recent_block);
+    CSharedNetMsg& msg = most_recent_block_msgs[std::make_pair(strCommand, fWitness)];
+    if (!msg.data) {
+        // Neither message depends on the peer's version beyond the witness flag
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        int nSendFlags = fWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+        if (strCommand == NetMsgType::CMPCTBLOCK) {
+            if (fWitness) {
+                msg = CSharedNetMsg(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+            } else {
+                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, false);
+                msg = CSharedNetMsg(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+            }
+        } else {
+            msg = CSharedNetMsg(msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *most_recent_block));
+        }
+    }
+    return msg;
+}
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
-    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
 
@@ -790,15 +884,17 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
     bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, Params().GetConsensus());
     uint256 hashBlock(pblock->GetHash());
 
+    CSharedNetMsg msgCmpctBlock;
     {
         LOCK(cs_most_recent_block);
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_block_msgs.clear();
+        msgCmpctBlock = GetMostRecentBlockMsg(NetMsgType::CMPCTBLOCK, true);
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
+    connman->ForEachNode([this, pindex, &msgCmpctBlock, fWitnessEnabled, &hashBlock](CNode* pnode) {
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -810,7 +906,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint("net", "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->id);
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, msgCmpctBlock);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -964,11 +1060,33 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/**
+ * Read a block that was requested by a peer from disk. Only the position of
+ * the block is taken under cs_main, so that peers served by other message
+ * handler threads are not held up by the disk read.
+ */
+static bool ReadRequestedBlock(CBlock& block, const CDiskBlockPos& pos, const uint256& hash, const Consensus::Params& consensusParams)
+{
+    if (!ReadBlockFromDisk(block, pos, consensusParams))
+        return false;
+    // A pruned block file may have been reused since the position was taken
+    return block.GetHash() == hash;
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+
+    // At most one block is served per call. It is looked up under cs_main,
+    // and read from disk and sent after the lock is released.
+    CInv invBlock;
+    CDiskBlockPos posBlock;
+    bool fPeerWantsWitness = false;
+    bool fSendCmpctBlock = false;
+    uint256 hashTipContinue;
+    {
     LOCK(cs_main);
 
     while (it != pfrom->vRecvGetData.end()) {
@@ -1034,66 +1152,14 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
-                    else if (inv.type == MSG_FILTERED_BLOCK)
-                    {
-                        bool sendMerkleBlock = false;
-                        CMerkleBlock merkleBlock;
-                        {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                sendMerkleBlock = true;
-                                merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
-                            }
-                        }
-                        if (sendMerkleBlock) {
-                            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *block.vtx[pair.first]));
-                        }
-                        // else
-                            // no response
+                    invBlock = inv;
+                    posBlock = mi->second->GetBlockPos();
+                    if (inv.type == MSG_CMPCT_BLOCK) {
+                        fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+                        fSendCmpctBlock = CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
                     }
-                    else if (inv.type == MSG_CMPCT_BLOCK)
-                    {
-                        // If a peer is asking for old blocks, we're almost guaranteed
-                        // they won't have a useful mempool to match against a compact block,
-                        // and we don't feel like constructing the object for them, so
-                        // instead we respond with the full, non-compact block.
-                        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                        int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                        if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
-                            connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                        } else
-                            connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, block));
-                    }
-
-                    // Trigger the peer node to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
-                    {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        std::vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-                        pfrom->hashContinue.SetNull();
-                    }
+                        hashTipContinue = chainActive.Tip()->GetBlockHash();
                 }
             }
             else if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX)
@@ -1103,7 +1169,11 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 auto mi = mapRelay.find(inv.hash);
                 int nSendFlags = (inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0);
                 if (mi != mapRelay.end()) {
-                    connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
+                    // Serialized once and shared by every peer that asks for it
+                    CSharedNetMsg& msgTx = mi->second.msgs[inv.type == MSG_WITNESS_TX];
+                    if (!msgTx.data)
+                        msgTx = CSharedNetMsg(msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second.tx));
+                    connman.PushMessage(pfrom, msgTx);
                     push = true;
                 } else if (pfrom->timeLastMempoolReq) {
                     auto txinfo = mempool.info(inv.hash);
@@ -1126,6 +1196,86 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 break;
         }
     }
+    }
+
+    if (!invBlock.hash.IsNull())
+    {
+        // The most recent block is requested by many peers at once, so it is
+        // sent from memory, serialized only once
+        CSharedNetMsg msgRecentBlock;
+        if (invBlock.type != MSG_FILTERED_BLOCK) {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == invBlock.hash) {
+                if (invBlock.type == MSG_CMPCT_BLOCK)
+                    msgRecentBlock = GetMostRecentBlockMsg(fSendCmpctBlock ? NetMsgType::CMPCTBLOCK : NetMsgType::BLOCK, fPeerWantsWitness);
+                else
+                    msgRecentBlock = GetMostRecentBlockMsg(NetMsgType::BLOCK, invBlock.type == MSG_WITNESS_BLOCK);
+            }
+        }
+
+        // Send block from disk
+        CBlock block;
+        if (msgRecentBlock.data)
+            connman.PushMessage(pfrom, msgRecentBlock);
+        else if (!ReadRequestedBlock(block, posBlock, invBlock.hash, consensusParams)) {
+            LogPrintf("%s: cannot load block %s from disk for peer=%d\n", __func__, invBlock.hash.ToString(), pfrom->GetId());
+        }
+        else if (invBlock.type == MSG_BLOCK)
+            connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
+        else if (invBlock.type == MSG_WITNESS_BLOCK)
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+        else if (invBlock.type == MSG_FILTERED_BLOCK)
+        {
+            bool sendMerkleBlock = false;
+            CMerkleBlock merkleBlock;
+            {
+                LOCK(pfrom->cs_filter);
+                if (pfrom->pfilter) {
+                    sendMerkleBlock = true;
+                    merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                }
+            }
+            if (sendMerkleBlock) {
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                // This avoids hurting performance by pointlessly requiring a round-trip
+                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                // they must either disconnect and retry or request the full block.
+                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                // however we MUST always provide at least what the remote peer needs
+                typedef std::pair<unsigned int, uint256> PairType;
+                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                    connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *block.vtx[pair.first]));
+            }
+            // else
+                // no response
+        }
+        else if (invBlock.type == MSG_CMPCT_BLOCK)
+        {
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            if (fSendCmpctBlock) {
+                CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
+                connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+            } else
+                connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, block));
+        }
+
+        // Trigger the peer node to send a getblocks request for the next batch of inventory
+        if (!hashTipContinue.IsNull())
+        {
+            // Bypass PushInventory, this must send even if redundant,
+            // and we want it right after the last block so they don't
+            // wait for other stuff first.
+            std::vector<CInv> vInv;
+            vInv.push_back(CInv(MSG_BLOCK, hashTipContinue));
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+            pfrom->hashContinue.SetNull();
+        }
+    }
 
     pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
 
@@ -1166,6 +1316,137 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
+/**
+ * Validate a getcfilters, getcfheaders or getcfcheckpt request, and find its
+ * stop block. Peers that ask for filters we do not serve, for blocks we do
+ * not have in the active chain, or for too many filters at once are
+ * disconnected, as BIP 157 requires.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t nFilterType, uint32_t nStartHeight, const uint256& stopHash, uint32_t nMaxHeightDiff, const CBlockIndex*& pstop)
+{
+    if (nFilterType != BLOCK_FILTER_BASIC || !(pfrom->GetLocalServices() & NODE_COMPACT_FILTERS) || !g_blockfilterindex) {
+        LogPrint("net", "peer %d requested unsupported block filter type: %d\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(stopHash);
+        // Only filters of the active chain are kept
+        if (it == mapBlockIndex.end() || !chainActive.Contains(it->second)) {
+            LogPrint("net", "peer %d requested filters for a block not in the active chain: %s\n", pfrom->id, stopHash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        pstop = it->second;
+    }
+
+    uint32_t nStopHeight = pstop->nHeight;
+    if (nStartHeight > nStopHeight) {
+        LogPrint("net", "peer %d sent invalid getcfilters/getcfheaders with start height %d and stop height %d\n",
+                 pfrom->id, nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (nStopHeight - nStartHeight >= nMaxHeightDiff) {
+        LogPrint("net", "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->id, nStopHeight - nStartHeight + 1, nMaxHeightDiff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    return true;
+}
+
+/** Answer a getcfilters request with one cfilter message per block */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman& connman)
+{
+    uint8_t nFilterType;
+    uint32_t nStartHeight;
+    uint256 stopHash;
+
+    vRecv >> nFilterType >> nStartHeight >> stopHash;
+
+    const CBlockIndex* pstop;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, stopHash, MAX_GETCFILTERS_SIZE, pstop))
+        return;
+
+    std::vector<BlockFilter> vFilters;
+    if (!g_blockfilterindex->LookupFilterRange(nStartHeight, pstop, vFilters)) {
+        LogPrint("net", "Failed to find block filter in index: filter_type=%s, start height=%d, stop hash=%s\n",
+                 BlockFilterTypeName((BlockFilterType)nFilterType), nStartHeight, stopHash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const BlockFilter& filter : vFilters)
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+}
+
+/** Answer a getcfheaders request with the header before the range and the filter hashes in it */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman& connman)
+{
+    uint8_t nFilterType;
+    uint32_t nStartHeight;
+    uint256 stopHash;
+
+    vRecv >> nFilterType >> nStartHeight >> stopHash;
+
+    const CBlockIndex* pstop;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, stopHash, MAX_GETCFHEADERS_SIZE, pstop))
+        return;
+
+    uint256 prevHeader;
+    if (nStartHeight > 0) {
+        const CBlockIndex* pprev = pstop->GetAncestor(nStartHeight - 1);
+        if (!g_blockfilterindex->LookupFilterHeader(pprev, prevHeader)) {
+            LogPrint("net", "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName((BlockFilterType)nFilterType), pprev->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> vFilterHashes;
+    if (!g_blockfilterindex->LookupFilterHashRange(nStartHeight, pstop, vFilterHashes)) {
+        LogPrint("net", "Failed to find block filter hashes in index: filter_type=%s, start height=%d, stop hash=%s\n",
+                 BlockFilterTypeName((BlockFilterType)nFilterType), nStartHeight, stopHash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::CFHEADERS, nFilterType, pstop->GetBlockHash(), prevHeader, vFilterHashes));
+}
+
+/** Answer a getcfcheckpt request with the filter headers at every CFCHECKPT_INTERVAL blocks */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman& connman)
+{
+    uint8_t nFilterType;
+    uint256 stopHash;
+
+    vRecv >> nFilterType >> stopHash;
+
+    const CBlockIndex* pstop;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, stopHash, std::numeric_limits<uint32_t>::max(), pstop))
+        return;
+
+    std::vector<uint256> vHeaders(pstop->nHeight / CFCHECKPT_INTERVAL);
+
+    // Walk back from the stop block; the filter headers are read by hash
+    const CBlockIndex* pindex = pstop;
+    for (int i = vHeaders.size() - 1; i >= 0; i--) {
+        pindex = pindex->GetAncestor((i + 1) * CFCHECKPT_INTERVAL);
+        if (!g_blockfilterindex->LookupFilterHeader(pindex, vHeaders[i])) {
+            LogPrint("net", "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName((BlockFilterType)nFilterType), pindex->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::CFCHECKPT, nFilterType, pstop->GetBlockHash(), vHeaders));
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
@@ -1677,6 +1958,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
+        CDiskBlockPos posBlock;
+        bool fSendFullBlock = false;
+        {
         LOCK(cs_main);
 
         BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
@@ -1698,13 +1982,19 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             inv.type = State(pfrom->GetId())->fWantsCmpctWitness ? MSG_WITNESS_BLOCK : MSG_BLOCK;
             inv.hash = req.blockhash;
             pfrom->vRecvGetData.push_back(inv);
+            fSendFullBlock = true;
+        }
+        posBlock = it->second->GetBlockPos();
+        }
+
+        if (fSendFullBlock) {
             ProcessGetData(pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
             return true;
         }
 
         CBlock block;
-        bool ret = ReadBlockFromDisk(block, it->second, chainparams.GetConsensus());
-        assert(ret);
+        if (!ReadRequestedBlock(block, posBlock, req.blockhash, chainparams.GetConsensus()))
+            return error("cannot load block %s from disk for getblocktxn", req.blockhash.ToString());
 
         SendBlockTransactions(block, req, pfrom, connman);
     }
@@ -1716,6 +2006,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
+        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+        std::vector<CBlock> vHeaders;
+        {
         LOCK(cs_main);
         if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
             LogPrint("net", "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->id);
@@ -1740,8 +2033,6 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 pindex = chainActive.Next(pindex);
         }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
         LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex))
@@ -1763,6 +2054,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
+        }
+        // Serialize the reply without holding up the other message handler threads
         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
     }
 
@@ -1786,6 +2079,18 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // Verify the signatures before taking cs_main for good, so that transactions from
+        // different peers are checked in parallel by the message handler threads. The
+        // cheaper checks run first, so no signature is verified for a transaction that
+        // would be rejected anyway, and AcceptToMemoryPool reuses the result.
+        CTxScriptPrecheck precheck;
+        {
+            LOCK(cs_main);
+            if (!AlreadyHave(inv))
+                PrepareTxScriptPrecheck(mempool, ptx, true, precheck);
+        }
+        RunTxScriptPrecheck(tx, precheck);
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
@@ -1796,7 +2101,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         std::list<CTransactionRef> lRemovedTxn;
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, &lRemovedTxn)) {
+        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, &lRemovedTxn, false, 0, &precheck)) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx, connman);
             for (unsigned int i = 0; i < tx.vout.size(); i++) {
@@ -2382,6 +2687,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
+            UpdateBlockDownloadSpeed(pfrom->GetId(), hash);
             forceProcessing |= MarkBlockAsReceived(hash);
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
@@ -2414,9 +2720,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
         std::vector<CAddress> vAddr = connman.GetAddresses();
         FastRandomContext insecure_rand;
+        LOCK(pfrom->cs_addrSend);
+        pfrom->vAddrToSend.clear();
         BOOST_FOREACH(const CAddress &addr, vAddr)
             pfrom->PushAddress(addr, insecure_rand);
     }
@@ -2591,6 +2898,18 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
     }
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
+    }
+
     else if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown Command
         // message would be undesirable as we transmit it ourselves.
@@ -2663,6 +2982,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
             return false;
 
         std::list<CNetMessage> msgs;
+        bool fResumeRecv;
         {
             LOCK(pfrom->cs_vProcessMsg);
             if (pfrom->vProcessMsg.empty())
@@ -2670,9 +2990,14 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
             // Just take one message
             msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
             pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+            fResumeRecv = pfrom->fPauseRecv && pfrom->nProcessQueueSize <= connman.GetReceiveFloodSize();
             pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman.GetReceiveFloodSize();
             fMoreWork = !pfrom->vProcessMsg.empty();
         }
+        // The socket handler may be waiting for other sockets, with this
+        // one's data still unread
+        if (fResumeRecv)
+            connman.WakeSocketHandler();
         CNetMessage& msg(msgs.front());
 
         msg.SetVersion(pfrom->GetRecvVersion());
@@ -2756,22 +3081,58 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
     return fMoreWork;
 }
 
-class CompareInvMempoolOrder
+bool RelayBefore(const TxRelayKey& a, const TxRelayKey& b)
 {
-    CTxMemPool *mp;
-public:
-    CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
+    if (a.fInMempool != b.fInMempool)
+        return a.fInMempool;
+    if (!a.fInMempool)
+        return false;
+    if (a.nCountWithAncestors != b.nCountWithAncestors)
+        return a.nCountWithAncestors < b.nCountWithAncestors;
+    double f1 = (double)a.nModFee * b.nTxSize;
+    double f2 = (double)b.nModFee * a.nTxSize;
+    if (f1 == f2)
+        return b.hash < a.hash;
+    return f1 > f2;
+}
+
+void CTxRelayOrder::GetCandidates(const CTxMemPool& pool, const std::set<uint256>& setTx, std::vector<TxRelayCandidate>& vCandidates, int64_t nNow)
+{
+    if (nNow >= nExpire) {
+        mapKeys.clear();
+        nExpire = nNow + RELAY_ORDER_SNAPSHOT_INTERVAL;
     }
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+    std::vector<size_t> vMissing;
+    vCandidates.reserve(setTx.size());
+    for (std::set<uint256>::iterator it = setTx.begin(); it != setTx.end(); it++) {
+        auto mi = mapKeys.find(*it);
+        if (mi == mapKeys.end())
+            vMissing.push_back(vCandidates.size());
+        vCandidates.push_back(std::make_pair(mi == mapKeys.end() ? NULL : &mi->second, it));
     }
-};
+    if (vMissing.empty())
+        return;
+
+    LOCK(pool.cs);
+    for (size_t i : vMissing) {
+        const uint256& hash = *vCandidates[i].second;
+        TxRelayKey& key = mapKeys[hash];
+        key.hash = hash;
+        CTxMemPool::indexed_transaction_set::const_iterator mi = pool.mapTx.find(hash);
+        key.fInMempool = mi != pool.mapTx.end();
+        if (key.fInMempool) {
+            key.nCountWithAncestors = mi->GetCountWithAncestors();
+            key.nModFee = mi->GetModifiedFee();
+            key.nTxSize = mi->GetTxSize();
+        }
+        // References into an unordered_map stay valid across rehashing
+        vCandidates[i].first = &key;
+    }
+}
+
+/** Protected by cs_main */
+static CTxRelayOrder txRelayOrder;
 
 bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
@@ -2833,6 +3194,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
@@ -2969,12 +3331,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness)
-                                connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
-                            else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
-                                connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                            }
+                            connman.PushMessage(pto, GetMostRecentBlockMsg(NetMsgType::CMPCTBLOCK, state.fWantsCmpctWitness));
                             fGotBlockFromCache = true;
                         }
                     }
@@ -3098,11 +3455,8 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
             // Determine transactions to relay
             if (fSendTrickle) {
                 // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
+                std::vector<TxRelayCandidate> vInvTx;
+                txRelayOrder.GetCandidates(mempool, pto->setInventoryTxToSend, vInvTx, nNow);
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
@@ -3110,16 +3464,16 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                 }
                 // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                 // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                CompareInvRelayOrder compareInvRelayOrder;
+                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvRelayOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
                 LOCK(pto->cs_filter);
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
+                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvRelayOrder);
+                    std::set<uint256>::iterator it = vInvTx.back().second;
                     vInvTx.pop_back();
                     uint256 hash = *it;
                     // Remove it from the to-be-sent set
@@ -3148,7 +3502,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                             vRelayExpiration.pop_front();
                         }
 
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                        auto ret = mapRelay.insert(std::make_pair(hash, RelayEntry(std::move(txinfo.tx))));
                         if (ret.second) {
                             vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
                         }
@@ -3193,10 +3547,24 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nBlockWindow) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalled = NULL;
+            FindNextBlocksToDownload(pto->GetId(), state.nBlockWindow - state.nBlocksInFlight, vToDownload, staller, pindexStalled, consensusParams);
+            if (vToDownload.empty() && staller != -1) {
+                // The download window is held up by another peer. If this peer is faster and the request has been
+                // outstanding for much longer than this peer takes to deliver a block, ask this peer for it instead
+                // of waiting for the staller to time out.
+                const CNodeState* stateStaller = State(staller);
+                int64_t nAge = nNow - mapBlocksInFlight[pindexStalled->GetBlockHash()].second->nTimeRequested;
+                if (ShouldRequestStalledBlock(nAge, state.nBlockLatency, stateStaller->nBlockLatency)) {
+                    LogPrint("net", "Re-requesting block %s (%d) held up by peer=%d from peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                        pindexStalled->nHeight, staller, pto->id);
+                    vToDownload.push_back(pindexStalled);
+                    staller = -1;
+                }
+            }
             BOOST_FOREACH(const CBlockIndex *pindex, vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
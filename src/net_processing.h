@@ -7,8 +7,12 @@
 #define BITCOIN_NET_PROCESSING_H
 
 #include "net.h"
+#include "txmempool.h"
 #include "validationinterface.h"
 
+#include <set>
+#include <unordered_map>
+
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** Expiration time for orphan transactions in seconds */
@@ -17,6 +21,13 @@ static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static const uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static const uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+
+/** How long (in microseconds) the shared transaction relay order is reused before it is rebuilt */
+static const int64_t RELAY_ORDER_SNAPSHOT_INTERVAL = 1000000;
 
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
@@ -41,6 +52,8 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlockWindow;
+    int64_t nBlockLatency;
 };
 
 /** Get statistics from node state */
@@ -48,6 +61,65 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
+/**
+ * Where a transaction goes in the announcement order: fewest in-mempool
+ * ancestors first, then highest fee rate (see CTxMemPool::CompareDepthAndScore).
+ */
+struct TxRelayKey
+{
+    bool fInMempool;
+    uint64_t nCountWithAncestors;
+    CAmount nModFee;
+    size_t nTxSize;
+    uint256 hash;
+};
+
+/** Whether a is announced before b */
+bool RelayBefore(const TxRelayKey& a, const TxRelayKey& b);
+
+typedef std::pair<const TxRelayKey*, std::set<uint256>::iterator> TxRelayCandidate;
+
+class CompareInvRelayOrder
+{
+public:
+    bool operator()(const TxRelayCandidate& a, const TxRelayCandidate& b) const
+    {
+        /* As std::make_heap produces a max-heap, we want the entries with the
+         * fewest ancestors/highest fee to sort later. */
+        return RelayBefore(*b.first, *a.first);
+    }
+};
+
+/**
+ * The relay order keys of recently announced transactions, shared by all
+ * peers. Peers mostly announce the same transactions, so each one is looked
+ * up in the mempool once per snapshot rather than twice per heap comparison
+ * for every peer. The snapshot is dropped every RELAY_ORDER_SNAPSHOT_INTERVAL
+ * so that ancestor counts and fees do not go stale.
+ */
+class CTxRelayOrder
+{
+private:
+    std::unordered_map<uint256, TxRelayKey, SaltedTxidHasher> mapKeys;
+    int64_t nExpire;
+
+public:
+    CTxRelayOrder() : nExpire(0) {}
+
+    /** Pair each of a peer's pending transactions with its key, locking the mempool at most once */
+    void GetCandidates(const CTxMemPool& pool, const std::set<uint256>& setTx, std::vector<TxRelayCandidate>& vCandidates, int64_t nNow);
+};
+
+/** Fold a new measurement of a peer's block download speed (in microseconds) into its moving average, or 0 if none yet */
+int64_t UpdateBlockDownloadAverage(int64_t nAverage, int64_t nSample);
+/** How many blocks may be in flight from a peer that takes nBlockServiceTime microseconds per block */
+int GetBlockDownloadWindow(int64_t nBlockServiceTime);
+/**
+ * Whether to also request a block that has been in flight from a stalling peer for nAge microseconds, from a
+ * peer whose block latency is nLatency. Latencies are 0 while unknown.
+ */
+bool ShouldRequestStalledBlock(int64_t nAge, int64_t nLatency, int64_t nStallerLatency);
+
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& interrupt);
 /**
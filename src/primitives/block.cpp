@@ -23,6 +23,19 @@ uint256 CBlockHeader::GetPoWHash() const
     return thash;
 }
 
+CPoWGrindContext::CPoWGrindContext(const CBlockHeader& headerIn) : header(headerIn), vchScratchpad(SCRYPT_SCRATCHPAD_SIZE)
+{
+    scrypt_midstate_init(&midstate, BEGIN(header.nVersion));
+}
+
+uint256 CPoWGrindContext::GetPoWHash(uint32_t nNonce)
+{
+    uint256 thash;
+    header.nNonce = nNonce;
+    scrypt_1024_1_1_256_sp_midstate(&midstate, BEGIN(header.nVersion), BEGIN(thash), &vchScratchpad[0]);
+    return thash;
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
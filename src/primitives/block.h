@@ -6,6 +6,7 @@
 #ifndef BITCOIN_PRIMITIVES_BLOCK_H
 #define BITCOIN_PRIMITIVES_BLOCK_H
 
+#include "crypto/scrypt.h"
 #include "primitives/transaction.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -72,6 +73,25 @@ public:
     }
 };
 
+/**
+ * Computes the proof of work hashes of a block header with different nonces.
+ * The part of scrypt that only depends on the first 64 bytes of the header is
+ * done once, and one scratchpad is reused for every hash.
+ */
+class CPoWGrindContext
+{
+private:
+    CBlockHeader header;
+    scrypt_midstate midstate;
+    std::vector<char> vchScratchpad;
+
+public:
+    explicit CPoWGrindContext(const CBlockHeader& headerIn);
+
+    /** The proof of work hash of the header with nNonce */
+    uint256 GetPoWHash(uint32_t nNonce);
+};
+
 
 class CBlock : public CBlockHeader
 {
@@ -9,6 +9,7 @@
 #include "primitives/transaction.h"
 #include "validation.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -57,8 +58,10 @@ struct CCoin {
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSON(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSON(CJSONStreamWriter& writer, bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -244,10 +247,13 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReplyStart(HTTP_OK);
+        CJSONStreamWriter writer(std::bind(&HTTPRequest::WriteReplyChunk, req, std::placeholders::_1));
+        blockToJSON(writer, block, pblockindex, showTxDetails);
+        writer.Flush();
+        req->WriteReplyChunk("\n");
+        req->WriteReplyEnd();
         return true;
     }
 
@@ -333,11 +339,13 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        std::string strJSON = mempoolObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReplyStart(HTTP_OK);
+        CJSONStreamWriter writer(std::bind(&HTTPRequest::WriteReplyChunk, req, std::placeholders::_1));
+        mempoolToJSON(writer, true);
+        writer.Flush();
+        req->WriteReplyChunk("\n");
+        req->WriteReplyEnd();
         return true;
     }
     default: {
@@ -401,6 +409,64 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+// A bit of a hack - dependency on functions defined in rpc/blockchain.cpp
+UniValue searchtxcomments(const JSONRPCRequest& request);
+UniValue listtxcomments(const JSONRPCRequest& request);
+
+static bool rest_txcomments(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    JSONRPCRequest jsonRequest;
+    jsonRequest.params = UniValue(UniValue::VARR);
+    UniValue (*actor)(const JSONRPCRequest&) = NULL;
+    if (path[0] == "prefix" && (path.size() == 3 || path.size() == 4)) {
+        if (!IsHex(path[2]) && !path[2].empty())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid prefix: " + path[2]);
+        std::vector<unsigned char> vchPrefix(ParseHex(path[2]));
+        jsonRequest.params.push_back(std::string(vchPrefix.begin(), vchPrefix.end()));
+        jsonRequest.params.push_back(atoi(path[1]));
+        if (path.size() == 4)
+            jsonRequest.params.push_back(path[3]);
+        actor = searchtxcomments;
+    } else if (path[0] == "height" && (path.size() == 4 || path.size() == 5)) {
+        jsonRequest.params.push_back(atoi(path[2]));
+        jsonRequest.params.push_back(atoi(path[3]));
+        jsonRequest.params.push_back(atoi(path[1]));
+        if (path.size() == 5)
+            jsonRequest.params.push_back(path[4]);
+        actor = listtxcomments;
+    } else {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/txcomments/prefix/<count>/<hexprefix>.json or /rest/txcomments/height/<count>/<start>/<end>.json, optionally followed by /<cursor>.");
+    }
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue commentsObject;
+        try {
+            commentsObject = actor(jsonRequest);
+        } catch (const UniValue& objError) {
+            return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").get_str());
+        }
+        std::string strJSON = commentsObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -603,21 +669,29 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
+    HTTPWorkLane lane;
 } uri_prefixes[] = {
-      {"/rest/tx/", rest_tx},
-      {"/rest/block/notxdetails/", rest_block_notxdetails},
-      {"/rest/block/", rest_block_extended},
-      {"/rest/chaininfo", rest_chaininfo},
-      {"/rest/mempool/info", rest_mempool_info},
-      {"/rest/mempool/contents", rest_mempool_contents},
-      {"/rest/headers/", rest_headers},
-      {"/rest/getutxos", rest_getutxos},
+      {"/rest/tx/", rest_tx, HTTP_LANE_DEFAULT},
+      {"/rest/block/notxdetails/", rest_block_notxdetails, HTTP_LANE_EXPENSIVE},
+      {"/rest/block/", rest_block_extended, HTTP_LANE_EXPENSIVE},
+      {"/rest/chaininfo", rest_chaininfo, HTTP_LANE_CHEAP},
+      {"/rest/mempool/info", rest_mempool_info, HTTP_LANE_CHEAP},
+      {"/rest/mempool/contents", rest_mempool_contents, HTTP_LANE_EXPENSIVE},
+      {"/rest/headers/", rest_headers, HTTP_LANE_DEFAULT},
+      {"/rest/getutxos", rest_getutxos, HTTP_LANE_DEFAULT},
+      {"/rest/txcomments/", rest_txcomments, HTTP_LANE_DEFAULT},
 };
 
+static HTTPWorkLane GetLane(HTTPWorkLane lane, HTTPRequest* req, const std::string& strReq)
+{
+    return lane;
+}
+
 bool StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler,
+                            std::bind(&GetLane, uri_prefixes[i].lane, std::placeholders::_1, std::placeholders::_2));
     return true;
 }
 
@@ -4,17 +4,23 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amount.h"
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "index/addressindex.h"
+#include "index/blockfilterindex.h"
+#include "index/txcommentindex.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -102,50 +108,88 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/**
+ * The fields of blockToJSON, split around the transactions: before receives
+ * those preceding "tx", after those following it.
+ */
+static void blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& before, UniValue& after)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
+    before.setObject();
+    before.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("weight", (int)::GetBlockWeight(block)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
-    for(const auto& tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(*tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx->GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    before.push_back(Pair("confirmations", confirmations));
+    before.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
+    before.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+    before.push_back(Pair("weight", (int)::GetBlockWeight(block)));
+    before.push_back(Pair("height", blockindex->nHeight));
+    before.push_back(Pair("version", block.nVersion));
+    before.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
+    before.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+
+    after.setObject();
+    after.push_back(Pair("time", block.GetBlockTime()));
+    after.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+    after.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    after.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    after.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    after.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        after.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        after.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+}
+
+static UniValue blockTxToJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToJSON(tx, uint256(), objTx);
+    return objTx;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result, after;
+    blockFieldsToJSON(block, blockindex, result, after);
+    UniValue txs(UniValue::VARR);
+    for(const auto& tx : block.vtx)
+        txs.push_back(blockTxToJSON(*tx, txDetails));
+    result.push_back(Pair("tx", txs));
+    result.pushKVs(after);
     return result;
 }
 
+/**
+ * Write the same as blockToJSON, converting one transaction at a time. The
+ * writer may block on a slow client, so cs_main is only held to look at the
+ * chain, and must not be held by the caller.
+ */
+void blockToJSON(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue before, after;
+    {
+        LOCK(cs_main);
+        blockFieldsToJSON(block, blockindex, before, after);
+    }
+    writer.BeginObject();
+    for (size_t i = 0; i < before.size(); i++)
+        writer.Pair(before.getKeys()[i], before.getValues()[i]);
+    writer.Key("tx");
+    writer.BeginArray();
+    for (const auto& tx : block.vtx)
+        writer.Value(blockTxToJSON(*tx, txDetails));
+    writer.EndArray();
+    for (size_t i = 0; i < after.size(); i++)
+        writer.Pair(after.getKeys()[i], after.getValues()[i]);
+    writer.EndObject();
+}
+
 UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -411,6 +455,50 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/**
+ * Write the same as mempoolToJSON, converting one entry at a time. The writer
+ * may block on a slow client, so the mempool is only locked to convert each
+ * entry, and entries removed in the meantime are left out.
+ */
+void mempoolToJSON(CJSONStreamWriter& writer, bool fVerbose = false)
+{
+    if (fVerbose)
+    {
+        vector<uint256> vtxid;
+        {
+            LOCK(mempool.cs);
+            vtxid.reserve(mempool.mapTx.size());
+            BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+                vtxid.push_back(e.GetTx().GetHash());
+        }
+
+        writer.BeginObject();
+        BOOST_FOREACH(const uint256& hash, vtxid)
+        {
+            UniValue info(UniValue::VOBJ);
+            {
+                LOCK(mempool.cs);
+                CTxMemPool::txiter it = mempool.mapTx.find(hash);
+                if (it == mempool.mapTx.end())
+                    continue;
+                entryToJSON(info, *it);
+            }
+            writer.Pair(hash.ToString(), info);
+        }
+        writer.EndObject();
+    }
+    else
+    {
+        vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        writer.BeginArray();
+        BOOST_FOREACH(const uint256& hash, vtxid)
+            writer.Value(hash.ToString());
+        writer.EndArray();
+    }
+}
+
 UniValue getrawmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -439,6 +527,10 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     if (request.params.size() > 0)
         fVerbose = request.params[0].get_bool();
 
+    if (request.resultWriter) {
+        mempoolToJSON(*request.resultWriter, fVerbose);
+        return NullUniValue;
+    }
     return mempoolToJSON(fVerbose);
 }
 
@@ -728,8 +820,6 @@ UniValue getblock(const JSONRPCRequest& request)
             + HelpExampleRpc("getblock", "\"e2acdf2dd19a702e5d12a925f1e984b01e47a933562ca893656d4afb38b44ee3\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -737,17 +827,21 @@ UniValue getblock(const JSONRPCRequest& request)
     if (request.params.size() > 1)
         fVerbose = request.params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        pblockindex = mapBlockIndex[hash];
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    }
 
     if (!fVerbose)
     {
@@ -757,6 +851,11 @@ UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
+    if (request.resultWriter) {
+        blockToJSON(*request.resultWriter, block, pblockindex);
+        return NullUniValue;
+    }
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex);
 }
 
@@ -983,6 +1082,433 @@ UniValue gettxout(const JSONRPCRequest& request)
     return ret;
 }
 
+static const int DEFAULT_INDEX_RESULTS = 100;
+static const int MAX_INDEX_RESULTS = 1000;
+
+static int ParseIndexCount(const UniValue& param)
+{
+    int nCount = DEFAULT_INDEX_RESULTS;
+    if (!param.isNull())
+        nCount = param.get_int();
+    if (nCount < 1 || nCount > MAX_INDEX_RESULTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 1 and %d", MAX_INDEX_RESULTS));
+    return nCount;
+}
+
+/**
+ * Wait until a background index has caught up with the active chain. This
+ * must happen before cs_main is taken, as the index needs it to make progress.
+ */
+static void SyncIndex(CBaseIndex* pindex, const std::string& strName, const std::string& strOption)
+{
+    if (!pindex)
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("%s not enabled (use %s)", strName, strOption));
+    if (!pindex->BlockUntilSyncedToCurrentChain())
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("%s is still being built (synced to height %d)", strName, pindex->GetBestHeight()));
+}
+
+/** Decode a cursor returned by EncodeIndexCursor, if one was given */
+template<typename T>
+static bool ParseIndexCursor(const UniValue& param, T& entry)
+{
+    if (param.isNull() || param.get_str().empty())
+        return false;
+    if (!IsHex(param.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "cursor must be hexadecimal");
+    std::vector<unsigned char> vchCursor(ParseHex(param.get_str()));
+    CDataStream ssCursor(vchCursor, SER_DISK, CLIENT_VERSION);
+    try {
+        ssCursor >> entry;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    return true;
+}
+
+/** Pagination cursors are the serialized index entry to continue from */
+template<typename T>
+static std::string EncodeIndexCursor(const T& entry)
+{
+    CDataStream ssCursor(SER_DISK, CLIENT_VERSION);
+    ssCursor << entry;
+    return HexStr(ssCursor.begin(), ssCursor.end());
+}
+
+/** Format up to nCount index entries, and the cursor of the next entry if there is one */
+static UniValue TxCommentsToJSON(const std::vector<CTxCommentEntry>& vEntries, size_t nCount)
+{
+    UniValue comments(UniValue::VARR);
+    for (size_t i = 0; i < vEntries.size() && i < nCount; i++) {
+        const CTxCommentEntry& entry = vEntries[i];
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", entry.txid.GetHex()));
+        obj.push_back(Pair("height", entry.nHeight));
+        if (chainActive[entry.nHeight])
+            obj.push_back(Pair("blockhash", chainActive[entry.nHeight]->GetBlockHash().GetHex()));
+        obj.push_back(Pair("comment", entry.strTxComment));
+        comments.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("comments", comments));
+    if (vEntries.size() > nCount)
+        ret.push_back(Pair("next", EncodeIndexCursor(vEntries[nCount])));
+    return ret;
+}
+
+UniValue searchtxcomments(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw runtime_error(
+            "searchtxcomments \"prefix\" ( count \"cursor\" )\n"
+            "\nReturns the transactions in the active chain whose comment starts with the given prefix,\n"
+            "in comment then block height order. Requires -txcommentindex.\n"
+            "\nArguments:\n"
+            "1. \"prefix\"        (string, required) The comment prefix to search for; \"\" matches every comment\n"
+            + strprintf("2. count           (numeric, optional, default=%d) The maximum number of results to return (at most %d)\n", DEFAULT_INDEX_RESULTS, MAX_INDEX_RESULTS) +
+            "3. \"cursor\"        (string, optional) The \"next\" value of a previous call, to continue from\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"comments\": [\n"
+            "    {\n"
+            "      \"txid\" : \"txid\",        (string) The transaction id\n"
+            "      \"height\" : n,           (numeric) The height of the block containing the transaction\n"
+            "      \"blockhash\" : \"hash\",   (string) The hash of the block containing the transaction\n"
+            "      \"comment\" : \"text\"      (string) The transaction comment\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"        (string, optional) Pass as cursor to get the next page of results\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("searchtxcomments", "\"text:\"")
+            + HelpExampleRpc("searchtxcomments", "\"text:\", 100")
+        );
+
+    const std::string strPrefix = request.params[0].get_str();
+    const int nCount = ParseIndexCount(request.params[1]);
+    CTxCommentEntry start;
+    const bool fStart = ParseIndexCursor(request.params[2], start);
+
+    SyncIndex(g_txcommentindex.get(), "Transaction comment index", "-txcommentindex");
+    LOCK(cs_main);
+
+    std::vector<CTxCommentEntry> vEntries;
+    if (!g_txcommentindex->GetDB().FindByPrefix(strPrefix, fStart ? &start : NULL, nCount + 1, vEntries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read transaction comment index");
+    return TxCommentsToJSON(vEntries, nCount);
+}
+
+UniValue listtxcomments(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
+        throw runtime_error(
+            "listtxcomments start_height ( end_height count \"cursor\" )\n"
+            "\nReturns the commented transactions in a range of blocks of the active chain, in block\n"
+            "height order. Requires -txcommentindex.\n"
+            "\nArguments:\n"
+            "1. start_height    (numeric, required) The height of the first block to include\n"
+            "2. end_height      (numeric, optional, default=tip) The height of the last block to include\n"
+            + strprintf("3. count           (numeric, optional, default=%d) The maximum number of results to return (at most %d)\n", DEFAULT_INDEX_RESULTS, MAX_INDEX_RESULTS) +
+            "4. \"cursor\"        (string, optional) The \"next\" value of a previous call, to continue from\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"comments\": [\n"
+            "    {\n"
+            "      \"txid\" : \"txid\",        (string) The transaction id\n"
+            "      \"height\" : n,           (numeric) The height of the block containing the transaction\n"
+            "      \"blockhash\" : \"hash\",   (string) The hash of the block containing the transaction\n"
+            "      \"comment\" : \"text\"      (string) The transaction comment\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"        (string, optional) Pass as cursor to get the next page of results\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("listtxcomments", "1000000 1001000")
+            + HelpExampleRpc("listtxcomments", "1000000, 1001000")
+        );
+
+    SyncIndex(g_txcommentindex.get(), "Transaction comment index", "-txcommentindex");
+    LOCK(cs_main);
+
+    const int nStartHeight = request.params[0].get_int();
+    int nEndHeight = chainActive.Height();
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        nEndHeight = request.params[1].get_int();
+    if (nStartHeight < 0 || nEndHeight < nStartHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height range");
+    const int nCount = ParseIndexCount(request.params[2]);
+    CTxCommentEntry start;
+    const bool fStart = ParseIndexCursor(request.params[3], start);
+
+    std::vector<CTxCommentEntry> vEntries;
+    if (!g_txcommentindex->GetDB().FindByHeight(nStartHeight, nEndHeight, fStart ? &start : NULL, nCount + 1, vEntries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read transaction comment index");
+    return TxCommentsToJSON(vEntries, nCount);
+}
+
+/** Accept either an address or a hex scriptPubKey */
+static uint256 ParseScriptHash(const UniValue& param)
+{
+    const std::string& str = param.get_str();
+    CBitcoinAddress address(str);
+    if (address.IsValid()) {
+        CScript scriptPubKey = GetScriptForDestination(address.Get());
+        return CAddressIndexDB::GetScriptHash(scriptPubKey);
+    }
+    if (!str.empty() && IsHex(str)) {
+        std::vector<unsigned char> vchScript(ParseHex(str));
+        return CAddressIndexDB::GetScriptHash(CScript(vchScript.begin(), vchScript.end()));
+    }
+    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script");
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"\n"
+            "\nReturns the balance of an address or script in the active chain. Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"       (string, required) The address, or the hex-encoded scriptPubKey\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,   (numeric) The current balance in " + CURRENCY_UNIT + "\n"
+            "  \"received\" : x.xxx   (numeric) The total amount ever received in " + CURRENCY_UNIT + "\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+            + HelpExampleRpc("getaddressbalance", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+        );
+
+    const uint256 scriptHash = ParseScriptHash(request.params[0]);
+
+    SyncIndex(g_addressindex.get(), "Address index", "-addressindex");
+
+    CAmount nBalance, nReceived;
+    if (!g_addressindex->GetDB().ReadBalance(scriptHash, nBalance, nReceived))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    ret.push_back(Pair("received", ValueFromAmount(nReceived)));
+    return ret;
+}
+
+UniValue getaddressdeltas(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 5)
+        throw runtime_error(
+            "getaddressdeltas \"address\" ( start_height end_height count \"cursor\" )\n"
+            "\nReturns every change to the balance of an address or script in a range of blocks of the\n"
+            "active chain, in block height order. Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"       (string, required) The address, or the hex-encoded scriptPubKey\n"
+            "2. start_height    (numeric, optional, default=0) The height of the first block to include\n"
+            "3. end_height      (numeric, optional, default=tip) The height of the last block to include\n"
+            + strprintf("4. count           (numeric, optional, default=%d) The maximum number of results to return (at most %d)\n", DEFAULT_INDEX_RESULTS, MAX_INDEX_RESULTS) +
+            "5. \"cursor\"        (string, optional) The \"next\" value of a previous call, to continue from\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"deltas\": [\n"
+            "    {\n"
+            "      \"txid\" : \"txid\",        (string) The transaction id\n"
+            "      \"index\" : n,            (numeric) The output index, or the input index if spending\n"
+            "      \"spending\" : true|false, (boolean) Whether this is an input spending from the script\n"
+            "      \"amount\" : x.xxx,       (numeric) The change in balance in " + CURRENCY_UNIT + ", negative if spending\n"
+            "      \"height\" : n,           (numeric) The height of the block containing the transaction\n"
+            "      \"blockhash\" : \"hash\"    (string) The hash of the block containing the transaction\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"        (string, optional) Pass as cursor to get the next page of results\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\" 1000000 1001000")
+            + HelpExampleRpc("getaddressdeltas", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\", 1000000, 1001000")
+        );
+
+    const uint256 scriptHash = ParseScriptHash(request.params[0]);
+
+    SyncIndex(g_addressindex.get(), "Address index", "-addressindex");
+    LOCK(cs_main);
+
+    int nStartHeight = 0;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        nStartHeight = request.params[1].get_int();
+    int nEndHeight = chainActive.Height();
+    if (request.params.size() > 2 && !request.params[2].isNull())
+        nEndHeight = request.params[2].get_int();
+    if (nStartHeight < 0 || nEndHeight < nStartHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height range");
+    const int nCount = ParseIndexCount(request.params[3]);
+    CAddressDelta start;
+    const bool fStart = ParseIndexCursor(request.params[4], start);
+
+    std::vector<CAddressDelta> vDeltas;
+    if (!g_addressindex->GetDB().ReadDeltas(scriptHash, nStartHeight, nEndHeight, fStart ? &start : NULL, nCount + 1, vDeltas))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+
+    UniValue deltas(UniValue::VARR);
+    for (size_t i = 0; i < vDeltas.size() && i < (size_t)nCount; i++) {
+        const CAddressDelta& delta = vDeltas[i];
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", delta.txid.GetHex()));
+        obj.push_back(Pair("index", (int64_t)delta.nIndex));
+        obj.push_back(Pair("spending", delta.fSpending));
+        obj.push_back(Pair("amount", ValueFromAmount(delta.nValue)));
+        obj.push_back(Pair("height", delta.nHeight));
+        if (chainActive[delta.nHeight])
+            obj.push_back(Pair("blockhash", chainActive[delta.nHeight]->GetBlockHash().GetHex()));
+        deltas.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("deltas", deltas));
+    if (vDeltas.size() > (size_t)nCount)
+        ret.push_back(Pair("next", EncodeIndexCursor(vDeltas[nCount])));
+    return ret;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw runtime_error(
+            "getaddressutxos \"address\" ( count \"cursor\" )\n"
+            "\nReturns the unspent outputs of an address or script in the active chain. Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"       (string, required) The address, or the hex-encoded scriptPubKey\n"
+            + strprintf("2. count           (numeric, optional, default=%d) The maximum number of results to return (at most %d)\n", DEFAULT_INDEX_RESULTS, MAX_INDEX_RESULTS) +
+            "3. \"cursor\"        (string, optional) The \"next\" value of a previous call, to continue from\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"utxos\": [\n"
+            "    {\n"
+            "      \"txid\" : \"txid\",        (string) The transaction id\n"
+            "      \"vout\" : n,             (numeric) The output index\n"
+            "      \"amount\" : x.xxx,       (numeric) The output value in " + CURRENCY_UNIT + "\n"
+            "      \"height\" : n            (numeric) The height of the block containing the transaction\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"        (string, optional) Pass as cursor to get the next page of results\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\"")
+            + HelpExampleRpc("getaddressutxos", "\"LER4HnAEFwYHbmGxCfP2po1nPrUeiK8KM2\", 100")
+        );
+
+    const uint256 scriptHash = ParseScriptHash(request.params[0]);
+    const int nCount = ParseIndexCount(request.params[1]);
+    CAddressUnspent start;
+    const bool fStart = ParseIndexCursor(request.params[2], start);
+
+    SyncIndex(g_addressindex.get(), "Address index", "-addressindex");
+
+    std::vector<CAddressUnspent> vUnspent;
+    if (!g_addressindex->GetDB().ReadUnspent(scriptHash, fStart ? &start : NULL, nCount + 1, vUnspent))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+
+    UniValue utxos(UniValue::VARR);
+    for (size_t i = 0; i < vUnspent.size() && i < (size_t)nCount; i++) {
+        const CAddressUnspent& unspent = vUnspent[i];
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", unspent.outpoint.hash.GetHex()));
+        obj.push_back(Pair("vout", (int64_t)unspent.outpoint.n));
+        obj.push_back(Pair("amount", ValueFromAmount(unspent.nValue)));
+        obj.push_back(Pair("height", unspent.nHeight));
+        utxos.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("utxos", utxos));
+    if (vUnspent.size() > (size_t)nCount)
+        ret.push_back(Pair("next", EncodeIndexCursor(vUnspent[nCount])));
+    return ret;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the transaction input in the active chain that spent an output. Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"txid\"          (string, required) The transaction id\n"
+            "2. n               (numeric, required) The output index\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"txid\",     (string) The spending transaction id\n"
+            "  \"index\" : n,         (numeric) The spending input index\n"
+            "  \"height\" : n         (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "\"txid\" 1")
+            + HelpExampleRpc("getspentinfo", "\"txid\", 1")
+        );
+
+    const COutPoint outpoint(ParseHashV(request.params[0], "txid"), request.params[1].get_int());
+
+    SyncIndex(g_addressindex.get(), "Address index", "-addressindex");
+
+    CSpentIndexValue spent;
+    if (!g_addressindex->GetDB().ReadSpent(outpoint, spent))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to find spending transaction");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txid", spent.txid.GetHex()));
+    ret.push_back(Pair("index", (int64_t)spent.nInput));
+    ret.push_back(Pair("height", spent.nHeight));
+    return ret;
+}
+
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nReturns the BIP 158 compact block filter of a block in the active chain, and its filter header. Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=\"basic\") The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) The hex-encoded filter data\n"
+            "  \"header\" : \"hex\"    (string) The hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"e2acdf2dd19a702e5d12a925f1e984b01e47a933562ca893656d4afb38b44ee3\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"e2acdf2dd19a702e5d12a925f1e984b01e47a933562ca893656d4afb38b44ee3\", \"basic\"")
+        );
+
+    uint256 blockHash = ParseHashV(request.params[0], "blockhash");
+    BlockFilterType filterType = BLOCK_FILTER_BASIC;
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        if (!BlockFilterTypeByName(request.params[1].get_str(), filterType))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    SyncIndex(g_blockfilterindex.get(), "Block filter index", "-blockfilterindex");
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(blockHash);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pindex = it->second;
+        if (!chainActive.Contains(pindex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block is not in the active chain");
+    }
+
+    BlockFilter filter;
+    uint256 header;
+    if (!g_blockfilterindex->LookupFilter(pindex, filter) || !g_blockfilterindex->LookupFilterHeader(pindex, header))
+        throw JSONRPCError(RPC_MISC_ERROR, "Filter not found");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", header.GetHex()));
+    return ret;
+}
+
 UniValue verifychain(const JSONRPCRequest& request)
 {
     int nCheckLevel = GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -1302,6 +1828,55 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getdbinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getdbinfo\n"
+            "\nReturns the tuning profile and memory usage of each open LevelDB database.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",            (string) The name -dbprofile selects the database by\n"
+            "    \"path\": \"xxxx\",            (string) The location of the database\n"
+            "    \"memory\": true|false,        (boolean) Whether the database is held in memory only\n"
+            "    \"profile\": \"xxxx\",         (string) The profile the database was opened with\n"
+            "    \"cache_size\": xxxxx,         (numeric) The cache budget of the database in bytes\n"
+            "    \"block_cache\": xxxxx,        (numeric) The size of the block cache in bytes\n"
+            "    \"write_buffer\": xxxxx,       (numeric) The size of each write buffer in bytes\n"
+            "    \"max_open_files\": xxxxx,     (numeric) The number of tables kept open\n"
+            "    \"compression\": true|false,   (boolean) Whether tables are compressed, if LevelDB supports it\n"
+            "    \"bloom_bits\": xxxxx,         (numeric) Bits per key of the bloom filter, 0 for none\n"
+            "    \"block_size\": xxxxx,         (numeric) The approximate size of a table block in bytes\n"
+            "    \"memory_usage\": xxxxx        (numeric) LevelDB's estimate of the memory it uses in bytes\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbinfo", "")
+            + HelpExampleRpc("getdbinfo", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH(const CDBWrapperInfo& info, ListOpenDatabases()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", info.strName));
+        obj.push_back(Pair("path", info.strPath));
+        obj.push_back(Pair("memory", info.fMemory));
+        obj.push_back(Pair("profile", info.profile.strName));
+        obj.push_back(Pair("cache_size", (uint64_t)info.nCacheSize));
+        obj.push_back(Pair("block_cache", (uint64_t)info.nBlockCacheSize));
+        obj.push_back(Pair("write_buffer", (uint64_t)info.nWriteBufferSize));
+        obj.push_back(Pair("max_open_files", info.profile.nMaxOpenFiles));
+        obj.push_back(Pair("compression", info.profile.fCompression));
+        obj.push_back(Pair("bloom_bits", info.profile.nBloomBits));
+        obj.push_back(Pair("block_size", (uint64_t)info.profile.nBlockSize));
+        obj.push_back(Pair("memory_usage", info.nMemoryUsage));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1422,9 +1997,14 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
     { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      true,  {"address"} },
+    { "blockchain",         "getaddressdeltas",       &getaddressdeltas,       true,  {"address","start_height","end_height","count","cursor"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        true,  {"address","count","cursor"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
+    { "blockchain",         "getdbinfo",              &getdbinfo,              true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
@@ -1432,8 +2012,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           true,  {"txid","n"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "listtxcomments",         &listtxcomments,         true,  {"start_height","end_height","count","cursor"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
+    { "blockchain",         "searchtxcomments",       &searchtxcomments,       true,  {"prefix","count","cursor"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          true,  {"blockhash"} },
@@ -104,6 +104,15 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "verifychain", 0, "checklevel" },
     { "verifychain", 1, "nblocks" },
     { "pruneblockchain", 0, "height" },
+    { "searchtxcomments", 1, "count" },
+    { "listtxcomments", 0, "start_height" },
+    { "listtxcomments", 1, "end_height" },
+    { "listtxcomments", 2, "count" },
+    { "getaddressdeltas", 1, "start_height" },
+    { "getaddressdeltas", 2, "end_height" },
+    { "getaddressdeltas", 3, "count" },
+    { "getaddressutxos", 1, "count" },
+    { "getspentinfo", 1, "n" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
     { "estimatefee", 0, "nblocks" },
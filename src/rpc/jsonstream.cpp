@@ -0,0 +1,94 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+CJSONStreamWriter::CJSONStreamWriter(const Sink& sinkIn) : sink(sinkIn), fAfterKey(false), fUsed(false)
+{
+}
+
+void CJSONStreamWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vEmpty.empty()) {
+        // Only one value at the top level
+        assert(!fUsed);
+    } else if (vEmpty.back()) {
+        vEmpty.back() = false;
+    } else {
+        strBuffer += ',';
+    }
+    fUsed = true;
+}
+
+void CJSONStreamWriter::MaybeFlush()
+{
+    if (strBuffer.size() >= JSON_STREAM_CHUNK_SIZE)
+        Flush();
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    strBuffer += '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    strBuffer += '}';
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    strBuffer += '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    strBuffer += ']';
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    BeginValue();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    BeginValue();
+    strBuffer += value.write();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Pair(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    Value(value);
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    sink(strBuffer);
+    strBuffer.clear();
+}
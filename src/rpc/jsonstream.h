@@ -0,0 +1,61 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/** Size above which CJSONStreamWriter hands its output to the sink */
+static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Writes one JSON value piece by piece, handing the text to a sink in chunks
+ * of about JSON_STREAM_CHUNK_SIZE bytes, so that large documents need not be
+ * held in memory as a UniValue tree and then as a string. The output is the
+ * same as UniValue::write() of the equivalent tree.
+ */
+class CJSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+
+private:
+    Sink sink;
+    std::string strBuffer;
+    //! For each object or array being written, whether it is still empty
+    std::vector<bool> vEmpty;
+    //! Whether a key was written and its value is next
+    bool fAfterKey;
+    //! Whether anything was written
+    bool fUsed;
+
+    void BeginValue();
+    void MaybeFlush();
+
+public:
+    CJSONStreamWriter(const Sink& sinkIn);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Write the key of the next value of an object */
+    void Key(const std::string& key);
+    /** Write a whole value */
+    void Value(const UniValue& value);
+    /** Write a key and its value */
+    void Pair(const std::string& key, const UniValue& value);
+
+    /** Hand what is buffered to the sink */
+    void Flush();
+    /** Whether anything was written */
+    bool IsUsed() const { return fUsed; }
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -109,6 +109,10 @@ UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nG
         nHeight = nHeightStart;
         nHeightEnd = nHeightStart+nGenerate;
     }
+    int nThreads = GetArg("-genthreads", DEFAULT_GENERATE_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    nThreads = std::max(nThreads, 1);
     unsigned int nExtraNonce = 0;
     UniValue blockHashes(UniValue::VARR);
     while (nHeight < nHeightEnd)
@@ -121,16 +125,18 @@ UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nG
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetPoWHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
-        if (nMaxTries == 0) {
-            break;
-        }
-        if (pblock->nNonce == nInnerLoopCount) {
+        const uint32_t nNonceBegin = pblock->nNonce;
+        uint32_t nNonceEnd = nInnerLoopCount;
+        if (nMaxTries < nNonceEnd - nNonceBegin)
+            nNonceEnd = nNonceBegin + nMaxTries;
+        if (!ScanNonces(pblock, nNonceEnd, nThreads, Params().GetConsensus())) {
+            nMaxTries -= nNonceEnd - nNonceBegin;
+            if (nMaxTries == 0) {
+                break;
+            }
             continue;
         }
+        nMaxTries -= pblock->nNonce - nNonceBegin;
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
         if (!ProcessNewBlock(Params(), shared_pblock, true, NULL))
             throw JSONRPCError(RPC_INTERNAL_ERROR, "ProcessNewBlock, block not accepted");
@@ -283,6 +289,8 @@ UniValue prioritisetransaction(const JSONRPCRequest& request)
     CAmount nAmount = request.params[2].get_int64();
 
     mempool.PrioritiseTransaction(hash, request.params[0].get_str(), request.params[1].get_real(), nAmount);
+    if (g_blocktemplateengine)
+        g_blocktemplateengine->MarkStale();
     return true;
 }
 
@@ -527,27 +535,28 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
     // Update block
     static CBlockIndex* pindexPrev;
-    static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
+        mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = nullptr;
 
-        // Store the pindexBest used before CreateNewBlock, to avoid races
+        // Store the pindexBest used before GetTemplate, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
         fLastTemplateSupportsSegwit = fSupportsSegwit;
 
-        // Create new block
+        // Update the block, which only has to look at the transactions that
+        // arrived since the last call
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
+        if (!g_blocktemplateengine)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block templates are not available");
+        pblocktemplate = g_blocktemplateengine->GetTemplate(scriptDummy, fSupportsSegwit);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
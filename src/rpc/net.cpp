@@ -102,6 +102,8 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"blockwindow\": n,          (numeric) How many blocks may be in flight from this peer\n"
+            "    \"blocklatency\": n,         (numeric) Average time in seconds for this peer to deliver a requested block, 0 if unknown\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"					
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -166,6 +168,8 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("blockwindow", statestats.nBlockWindow));
+            obj.push_back(Pair("blocklatency", statestats.nBlockLatency / 1000000.0));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
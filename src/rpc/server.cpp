@@ -23,7 +23,10 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <condition_variable>
 #include <memory> // for unique_ptr
+#include <mutex>
+#include <set>
 #include <unordered_map>
 
 using namespace RPCServer;
@@ -415,12 +418,107 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/**
+ * Methods that only read state. Requests of a batch for these may run in
+ * parallel with each other, any other request runs on its own, after the
+ * requests before it and before the ones after it.
+ */
+static const char* const batchParallelMethods[] = {
+    "getbestblockhash", "getblock", "getblockchaininfo", "getblockcount", "getblockhash",
+    "getblockheader", "getchaintips", "getconnectioncount", "getdifficulty", "getmempoolancestors",
+    "getmempooldescendants", "getmempoolentry", "getmempoolinfo", "getmininginfo", "getnettotals",
+    "getnetworkinfo", "getpeerinfo", "getrawmempool", "getrawtransaction", "gettxout",
+    "gettxoutproof", "decoderawtransaction", "decodescript", "estimatefee", "estimatepriority",
+    "estimatesmartfee", "estimatesmartpriority", "listbanned", "validateaddress", "verifytxoutproof",
+};
+
+static bool IsBatchParallelRequest(const UniValue& req)
+{
+    static const std::set<std::string> setMethods(batchParallelMethods, batchParallelMethods + ARRAYLEN(batchParallelMethods));
+    if (!req.isObject())
+        return true; // Fails without touching any state
+    const UniValue& method = find_value(req, "method");
+    return method.isStr() && setMethods.count(method.get_str());
+}
+
+/** State shared by the threads executing one JSON-RPC batch */
+struct JSONRPCBatch
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    //! The requests, only valid while requests remain to be claimed
+    const UniValue* pvReq;
+    std::vector<UniValue> vReplies;
+    //! Index of the next request to execute
+    size_t nNext;
+    //! Number of replies stored
+    size_t nDone;
+    //! Whether a request that may change state is executing
+    bool fExclusive;
+
+    JSONRPCBatch(const UniValue& vReq) : pvReq(&vReq), vReplies(vReq.size()), nNext(0), nDone(0), fExclusive(false) {}
+};
+
+/**
+ * Execute requests of the batch until none is left to claim. Helpers queued
+ * late may find the batch finished and its requests gone, so they only look
+ * at the requests after claiming one. A request that may change state waits
+ * for all requests before it, and holds off the ones after it, so the batch
+ * has the same effect as executing its requests one by one.
+ */
+static void JSONRPCExecBatchWorker(std::shared_ptr<JSONRPCBatch> batch)
+{
+    std::unique_lock<std::mutex> lock(batch->cs);
+    while (batch->nNext < batch->vReplies.size()) {
+        size_t nIdx = batch->nNext;
+        bool fParallel = IsBatchParallelRequest((*batch->pvReq)[nIdx]);
+        if (batch->fExclusive || (!fParallel && batch->nDone < nIdx)) {
+            batch->cond.wait(lock);
+            continue;
+        }
+        batch->nNext++;
+        batch->fExclusive = !fParallel;
+        lock.unlock();
+        UniValue reply = JSONRPCExecOne((*batch->pvReq)[nIdx]);
+        lock.lock();
+        batch->vReplies[nIdx] = reply;
+        batch->nDone++;
+        if (!fParallel)
+            batch->fExclusive = false;
+        batch->cond.notify_all();
+    }
+}
+
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCTaskQueuer& queueTask, int nParallel)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    if (!queueTask || nParallel <= 1 || vReq.size() <= 1) {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+        return ret.write() + "\n";
+    }
 
+    // The calling thread works through the batch too, so it completes even
+    // if no helper gets to run, e.g. when all threads are busy with batches
+    int64_t nTimeStart = GetTimeMillis();
+    std::shared_ptr<JSONRPCBatch> batch = std::make_shared<JSONRPCBatch>(vReq);
+    int nHelpers = 0;
+    while (nHelpers < nParallel - 1 && (size_t)nHelpers < vReq.size() - 1 && queueTask(std::bind(&JSONRPCExecBatchWorker, batch)))
+        nHelpers++;
+    JSONRPCExecBatchWorker(batch);
+    {
+        std::unique_lock<std::mutex> lock(batch->cs);
+        while (batch->nDone < batch->vReplies.size())
+            batch->cond.wait(lock);
+    }
+
+    unsigned int nFailed = 0;
+    BOOST_FOREACH(UniValue& reply, batch->vReplies) {
+        if (!find_value(reply, "error").isNull())
+            nFailed++;
+        ret.push_back(reply);
+    }
+    LogPrint("rpc", "ThreadRPCServer batch of %u requests on %d threads, %u failed (%dms)\n", vReq.size(), nHelpers + 1, nFailed, GetTimeMillis() - nTimeStart);
     return ret.write() + "\n";
 }
 
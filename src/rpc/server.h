@@ -10,6 +10,7 @@
 #include "rpc/protocol.h"
 #include "uint256.h"
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -32,6 +33,7 @@ namespace RPCServer
 }
 
 class CBlockIndex;
+class CJSONStreamWriter;
 class CNetAddr;
 
 /** Wrapper for UniValue::VType, which includes typeAny:
@@ -52,8 +54,13 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /**
+     * Where the method may write a large result as it produces it, or NULL.
+     * A method that writes its result there returns NullUniValue.
+     */
+    CJSONStreamWriter* resultWriter;
 
-    JSONRPCRequest() { id = NullUniValue; params = NullUniValue; fHelp = false; }
+    JSONRPCRequest() { id = NullUniValue; params = NullUniValue; fHelp = false; resultWriter = NULL; }
     void parse(const UniValue& valRequest);
 };
 
@@ -203,7 +210,15 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/** Queues a task to run on another thread, returning false if it cannot */
+typedef std::function<bool(const std::function<void(void)>&)> RPCTaskQueuer;
+/**
+ * Execute a batch of JSON-RPC requests and return the replies, in request
+ * order, as a JSON array. Up to nParallel requests for methods that only read
+ * state run at once, the calling thread being helped by tasks handed to
+ * queueTask. Any other request runs alone, after the requests before it.
+ */
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCTaskQueuer& queueTask = RPCTaskQueuer(), int nParallel = 1);
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
 // Retrieves any serialization flags requested in command line argument
@@ -15,6 +15,7 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -138,6 +139,137 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from an existing vector by reference, without copying it
+ */
+class CVectorReader
+{
+private:
+    const int nType;
+    const int nVersion;
+    const std::vector<unsigned char>& vchData;
+    size_t nPos;
+
+public:
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  vchDataIn  Referenced byte vector to read from
+ * @param[in]  nPosIn Starting position. Vector index where reads should start.
+ */
+    CVectorReader(int nTypeIn, int nVersionIn, const std::vector<unsigned char>& vchDataIn, size_t nPosIn)
+        : nType(nTypeIn), nVersion(nVersionIn), vchData(vchDataIn), nPos(nPosIn)
+    {
+        if (nPos > vchData.size())
+            throw std::ios_base::failure("CVectorReader(...): end of data (nPos > vchData.size())");
+    }
+
+    template<typename T>
+    CVectorReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return nVersion; }
+    int GetType() const { return nType; }
+
+    size_t size() const { return vchData.size() - nPos; }
+    bool empty() const { return vchData.size() == nPos; }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize == 0)
+            return;
+        if (nSize > size())
+            throw std::ios_base::failure("CVectorReader::read(): end of data");
+        memcpy(pch, vchData.data() + nPos, nSize);
+        nPos += nSize;
+    }
+};
+
+/** Reads bits, most significant first, from a byte stream */
+template <typename IStream>
+class BitStreamReader
+{
+private:
+    IStream& istream;
+    /** Byte last read from istream */
+    uint8_t nBuffer;
+    /** Number of high order bits of nBuffer already returned; 8 when a new byte is needed */
+    int nOffset;
+
+public:
+    explicit BitStreamReader(IStream& istreamIn) : istream(istreamIn), nBuffer(0), nOffset(8) {}
+
+    /** Read the next nBits bits (at most 64) as the low order bits of an integer */
+    uint64_t Read(int nBits)
+    {
+        if (nBits < 0 || nBits > 64)
+            throw std::out_of_range("BitStreamReader::Read(): nBits must be between 0 and 64");
+
+        uint64_t nData = 0;
+        while (nBits > 0) {
+            if (nOffset == 8) {
+                istream >> nBuffer;
+                nOffset = 0;
+            }
+            int nCount = std::min(8 - nOffset, nBits);
+            nData <<= nCount;
+            nData |= static_cast<uint8_t>(nBuffer << nOffset) >> (8 - nCount);
+            nOffset += nCount;
+            nBits -= nCount;
+        }
+        return nData;
+    }
+};
+
+/** Writes bits, most significant first, to a byte stream. The last byte is zero padded by Flush(). */
+template <typename OStream>
+class BitStreamWriter
+{
+private:
+    OStream& ostream;
+    /** Byte being assembled */
+    uint8_t nBuffer;
+    /** Number of high order bits of nBuffer already written */
+    int nOffset;
+
+public:
+    explicit BitStreamWriter(OStream& ostreamIn) : ostream(ostreamIn), nBuffer(0), nOffset(0) {}
+
+    ~BitStreamWriter()
+    {
+        Flush();
+    }
+
+    /** Write the low order nBits bits (at most 64) of nData */
+    void Write(uint64_t nData, int nBits)
+    {
+        if (nBits < 0 || nBits > 64)
+            throw std::out_of_range("BitStreamWriter::Write(): nBits must be between 0 and 64");
+
+        while (nBits > 0) {
+            int nCount = std::min(8 - nOffset, nBits);
+            nBuffer |= (nData << (64 - nBits)) >> (64 - 8 + nOffset);
+            nOffset += nCount;
+            nBits -= nCount;
+            if (nOffset == 8)
+                Flush();
+        }
+    }
+
+    /** Write out a partially filled byte, padded with zero bits */
+    void Flush()
+    {
+        if (nOffset == 0)
+            return;
+        ostream << nBuffer;
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -238,6 +370,7 @@ public:
     bool empty() const                               { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c=0)         { vch.resize(n + nReadPos, c); }
     void reserve(size_type n)                        { vch.reserve(n + nReadPos); }
+    size_type capacity() const                       { return vch.capacity() - nReadPos; }
     const_reference operator[](size_type pos) const  { return vch[pos + nReadPos]; }
     reference operator[](size_type pos)              { return vch[pos + nReadPos]; }
     void clear()                                     { vch.clear(); nReadPos = 0; }
@@ -409,6 +542,12 @@ public:
         clear();
     }
 
+    /** Exchange the underlying buffer with another one, so its memory can be reused */
+    void SwapBuffer(vector_type& vchOther) {
+        vch.swap(vchOther);
+        nReadPos = 0;
+    }
+
     /**
      * XOR the contents of this stream with a certain key.
      *
@@ -215,4 +215,38 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+BOOST_AUTO_TEST_CASE(DoS_blockdownloadwindow)
+{
+    // The window covers BLOCK_DOWNLOAD_TARGET_LATENCY worth of blocks at the peer's service time
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(BLOCK_DOWNLOAD_TARGET_LATENCY / 40), 40);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(BLOCK_DOWNLOAD_TARGET_LATENCY / 16), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    // ...but fast peers are capped and slow ones still get a few blocks
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(0), MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1000), MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(BLOCK_DOWNLOAD_TARGET_LATENCY), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(60 * BLOCK_DOWNLOAD_TARGET_LATENCY), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // The first measurement is taken as is, later ones move the average an eighth of the way
+    BOOST_CHECK_EQUAL(UpdateBlockDownloadAverage(0, 80000), 80000);
+    BOOST_CHECK_EQUAL(UpdateBlockDownloadAverage(80000, 160000), 90000);
+    int64_t nServiceTime = UpdateBlockDownloadAverage(0, 1000000);
+    for (int i = 0; i < 100; i++)
+        nServiceTime = UpdateBlockDownloadAverage(nServiceTime, 20000);
+    BOOST_CHECK(nServiceTime < 21000);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(nServiceTime), BLOCK_DOWNLOAD_TARGET_LATENCY / nServiceTime);
+
+    // A stalled block is only requested again from a measured peer that is faster than the staller...
+    const int64_t nLatency = 100000;
+    const int64_t nOld = BLOCK_DOWNLOAD_TARGET_LATENCY + 1;
+    BOOST_CHECK(ShouldRequestStalledBlock(nOld, nLatency, 0));
+    BOOST_CHECK(ShouldRequestStalledBlock(nOld, nLatency, 2 * nLatency));
+    BOOST_CHECK(!ShouldRequestStalledBlock(nOld, nLatency, nLatency));
+    BOOST_CHECK(!ShouldRequestStalledBlock(nOld, 0, 0));
+    // ...once the request is older than both the target latency and twice the peer's latency
+    BOOST_CHECK(!ShouldRequestStalledBlock(BLOCK_DOWNLOAD_TARGET_LATENCY, nLatency, 0));
+    const int64_t nSlowLatency = BLOCK_DOWNLOAD_TARGET_LATENCY;
+    BOOST_CHECK(!ShouldRequestStalledBlock(2 * nSlowLatency, nSlowLatency, 0));
+    BOOST_CHECK(ShouldRequestStalledBlock(2 * nSlowLatency + 1, nSlowLatency, 0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "primitives/block.h"
+#include "script/script.h"
+#include "txdb.h"
+#include "undo.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_connect_disconnect)
+{
+    CAddressIndexDB db(1 << 20, true);
+    CScript scriptX = CScript() << OP_1;
+    CScript scriptY = CScript() << OP_2;
+    const uint256 hashX = CAddressIndexDB::GetScriptHash(scriptX);
+    const uint256 hashY = CAddressIndexDB::GetScriptHash(scriptY);
+
+    // Block 1: a coinbase paying 50 to X and 10 to Y
+    CMutableTransaction txA;
+    txA.vin.resize(1);
+    txA.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    txA.vout.push_back(CTxOut(50, scriptX));
+    txA.vout.push_back(CTxOut(10, scriptY));
+    CBlock block1;
+    block1.vtx.push_back(MakeTransactionRef(txA));
+    CDBBatch batch1(db);
+    BOOST_CHECK(db.WriteBlock(batch1, block1, CBlockUndo(), 1));
+    BOOST_CHECK(db.WriteBatch(batch1));
+
+    // Block 2: B spends X's output, and C spends one of B's outputs
+    CMutableTransaction txB;
+    txB.vin.push_back(CTxIn(COutPoint(txA.GetHash(), 0)));
+    txB.vout.push_back(CTxOut(30, scriptY));
+    txB.vout.push_back(CTxOut(20, scriptX));
+    CMutableTransaction txC;
+    txC.vin.push_back(CTxIn(COutPoint(txB.GetHash(), 1)));
+    txC.vout.push_back(CTxOut(20, scriptY));
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].scriptSig = CScript() << OP_0 << OP_1;
+    txCoinbase.vout.push_back(CTxOut(0, CScript() << OP_RETURN));
+    CBlock block2;
+    block2.vtx.push_back(MakeTransactionRef(txCoinbase));
+    block2.vtx.push_back(MakeTransactionRef(txB));
+    block2.vtx.push_back(MakeTransactionRef(txC));
+    CBlockUndo undo2;
+    undo2.vtxundo.resize(2);
+    undo2.vtxundo[0].vprevout.push_back(CTxInUndo(txA.vout[0]));
+    undo2.vtxundo[1].vprevout.push_back(CTxInUndo(txB.vout[1]));
+    CDBBatch batch2(db);
+    BOOST_CHECK(db.WriteBlock(batch2, block2, undo2, 2));
+    BOOST_CHECK(db.WriteBatch(batch2));
+
+    CAmount nBalance, nReceived;
+    BOOST_CHECK(db.ReadBalance(hashX, nBalance, nReceived));
+    BOOST_CHECK_EQUAL(nBalance, 0);
+    BOOST_CHECK_EQUAL(nReceived, 70);
+    BOOST_CHECK(db.ReadBalance(hashY, nBalance, nReceived));
+    BOOST_CHECK_EQUAL(nBalance, 60);
+    BOOST_CHECK_EQUAL(nReceived, 60);
+
+    std::vector<CAddressUnspent> vUnspent;
+    BOOST_CHECK(db.ReadUnspent(hashX, NULL, 100, vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    BOOST_CHECK(db.ReadUnspent(hashY, NULL, 100, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 3U);
+
+    std::vector<CAddressDelta> vDeltas;
+    BOOST_CHECK(db.ReadDeltas(hashX, 0, 10, NULL, 100, vDeltas));
+    BOOST_CHECK_EQUAL(vDeltas.size(), 4U);
+    BOOST_CHECK_EQUAL(vDeltas[0].nHeight, 1);
+    BOOST_CHECK_EQUAL(vDeltas[0].nValue, 50);
+    vDeltas.clear();
+    BOOST_CHECK(db.ReadDeltas(hashX, 2, 2, NULL, 100, vDeltas));
+    BOOST_CHECK_EQUAL(vDeltas.size(), 3U);
+
+    // Page through X's deltas one at a time
+    std::vector<CAddressDelta> vPage;
+    BOOST_CHECK(db.ReadDeltas(hashX, 0, 10, NULL, 2, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    CAddressDelta next = vPage.back();
+    vPage.clear();
+    BOOST_CHECK(db.ReadDeltas(hashX, 0, 10, &next, 100, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 3U);
+
+    CSpentIndexValue spent;
+    BOOST_CHECK(db.ReadSpent(COutPoint(txA.GetHash(), 0), spent));
+    BOOST_CHECK(spent.txid == txB.GetHash());
+    BOOST_CHECK_EQUAL(spent.nInput, 0U);
+    BOOST_CHECK_EQUAL(spent.nHeight, 2);
+    BOOST_CHECK_EQUAL(spent.nPrevHeight, 1);
+
+    // Disconnecting block 2 restores the outputs it spent
+    CDBBatch batch3(db);
+    BOOST_CHECK(db.EraseBlock(batch3, block2, 2));
+    BOOST_CHECK(db.WriteBatch(batch3));
+    BOOST_CHECK(db.ReadBalance(hashX, nBalance, nReceived));
+    BOOST_CHECK_EQUAL(nBalance, 50);
+    BOOST_CHECK_EQUAL(nReceived, 50);
+    vUnspent.clear();
+    BOOST_CHECK(db.ReadUnspent(hashX, NULL, 100, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].outpoint == COutPoint(txA.GetHash(), 0));
+    BOOST_CHECK_EQUAL(vUnspent[0].nHeight, 1);
+    vUnspent.clear();
+    BOOST_CHECK(db.ReadUnspent(hashY, NULL, 100, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(!db.ReadSpent(COutPoint(txA.GetHash(), 0), spent));
+    BOOST_CHECK(!db.ReadSpent(COutPoint(txB.GetHash(), 1), spent));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
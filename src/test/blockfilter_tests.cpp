@@ -0,0 +1,207 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "index/blockfilterindex.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "undo.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+/** A deterministic 32 byte element, so the false positive checks cannot flake */
+static GCSFilter::Element MakeElement(uint32_t n)
+{
+    uint256 hash = Hash(BEGIN(n), END(n));
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (uint32_t i = 0; i < 100; ++i) {
+        included_elements.insert(MakeElement(i));
+        excluded_elements.insert(MakeElement(1000 + i));
+    }
+
+    GCSFilter filter(GCSFilter::Params(0, 0, BASIC_FILTER_P, BASIC_FILTER_M), included_elements);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    for (const GCSFilter::Element& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        GCSFilter::ElementSet vQuery(excluded_elements);
+        vQuery.insert(element);
+        BOOST_CHECK(filter.MatchAny(vQuery));
+    }
+    BOOST_CHECK(!filter.MatchAny(excluded_elements));
+
+    // Decoding the encoded filter gives back the same filter
+    GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), filter.GetN());
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    for (const GCSFilter::Element& element : included_elements)
+        BOOST_CHECK(decoded.Match(element));
+
+    // Malformed encodings are rejected
+    std::vector<unsigned char> vchExcess(filter.GetEncoded());
+    vchExcess.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), vchExcess), std::ios_base::failure);
+    std::vector<unsigned char> vchShort(filter.GetEncoded());
+    vchShort.resize(vchShort.size() / 2);
+    BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), vchShort), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
+{
+    GCSFilter filter;
+    BOOST_CHECK_EQUAL(filter.GetN(), 0U);
+    BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1U);
+    BOOST_CHECK(!filter.Match(MakeElement(0)));
+
+    // An empty set encodes to just its element count
+    GCSFilter::ElementSet no_elements;
+    GCSFilter empty(GCSFilter::Params(), no_elements);
+    BOOST_CHECK(empty.GetEncoded() == filter.GetEncoded());
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript included_scripts[5], excluded_scripts[3];
+
+    // First two are outputs on a single transaction.
+    included_scripts[0] << std::vector<unsigned char>(65, 0) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // Third is an output on a second transaction.
+    included_scripts[2] << OP_1 << std::vector<unsigned char>(33, 2) << OP_1 << OP_CHECKMULTISIG;
+
+    // Last two are spent by a single transaction.
+    included_scripts[3] << OP_0 << std::vector<unsigned char>(32, 3);
+    included_scripts[4] << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+
+    // OP_RETURN output, and the empty output of a coinstake.
+    excluded_scripts[0] << OP_RETURN << std::vector<unsigned char>(40, 4);
+    excluded_scripts[1] = CScript();
+
+    // Script that is spent but not in the block's outputs.
+    excluded_scripts[2] << OP_RETURN << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+
+    CMutableTransaction tx_1;
+    tx_1.vout.emplace_back(100, included_scripts[0]);
+    tx_1.vout.emplace_back(200, included_scripts[1]);
+
+    CMutableTransaction tx_2;
+    tx_2.vout.emplace_back(0, excluded_scripts[1]);
+    tx_2.vout.emplace_back(300, included_scripts[2]);
+    tx_2.vout.emplace_back(0, excluded_scripts[0]);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx_1));
+    block.vtx.push_back(MakeTransactionRef(tx_2));
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[3]), false, 1000);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(600, included_scripts[4]), false, 10000);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(700, excluded_scripts[2]), false, 100000);
+
+    BlockFilter block_filter(BLOCK_FILTER_BASIC, block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+    BOOST_CHECK_EQUAL(filter.GetN(), 5U);
+
+    for (const CScript& script : included_scripts)
+        BOOST_CHECK(filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    for (const CScript& script : excluded_scripts)
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(script.begin(), script.end())));
+
+    // Test serialization/unserialization.
+    BlockFilter block_filter2;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    stream >> block_filter2;
+
+    BOOST_CHECK_EQUAL(block_filter.GetFilterType(), block_filter2.GetFilterType());
+    BOOST_CHECK(block_filter.GetBlockHash() == block_filter2.GetBlockHash());
+    BOOST_CHECK(block_filter.GetEncodedFilter() == block_filter2.GetEncodedFilter());
+
+    BlockFilter default_ctor_block_filter_1;
+    BlockFilter default_ctor_block_filter_2;
+    BOOST_CHECK_EQUAL(default_ctor_block_filter_1.GetFilterType(), default_ctor_block_filter_2.GetFilterType());
+    BOOST_CHECK_EQUAL(default_ctor_block_filter_1.GetFilterType(), BLOCK_FILTER_INVALID);
+
+    // The header chains the filter hash onto the previous header
+    uint256 prevHeader = block.GetHash();
+    uint256 filterHash = block_filter.GetHash();
+    BOOST_CHECK(block_filter.ComputeHeader(prevHeader) == Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end()));
+    BOOST_CHECK(block_filter.ComputeHeader(prevHeader) != block_filter.ComputeHeader(uint256()));
+
+    // Filters are keyed by their block, so another block's filter does not match the same scripts
+    CBlock block2(block);
+    block2.nNonce = 1;
+    BlockFilter block_filter3(BLOCK_FILTER_BASIC, block2, block_undo);
+    BOOST_CHECK(block_filter3.GetEncodedFilter() != block_filter.GetEncodedFilter());
+
+    // Unknown filter types are rejected
+    BOOST_CHECK_THROW(BlockFilter(BLOCK_FILTER_INVALID, block.GetHash(), block_filter.GetEncodedFilter()), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BlockFilterType filterType;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filterType));
+    BOOST_CHECK_EQUAL(filterType, BLOCK_FILTER_BASIC);
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BLOCK_FILTER_BASIC), "basic");
+    BOOST_CHECK(!BlockFilterTypeByName("extended", filterType));
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BLOCK_FILTER_INVALID), "");
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_index_sync)
+{
+    CBlockFilterIndex index(1 << 20, true);
+    BOOST_CHECK(index.Start());
+
+    int64_t nTimeout = GetTimeMillis() + 10000;
+    while (!index.IsSynced() && GetTimeMillis() < nTimeout)
+        MilliSleep(10);
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+
+    const CBlockIndex* pgenesis;
+    {
+        LOCK(cs_main);
+        pgenesis = chainActive.Genesis();
+    }
+
+    // The genesis block is indexed without undo data, and its header chains from zero
+    BlockFilter expected(BLOCK_FILTER_BASIC, Params().GenesisBlock(), CBlockUndo());
+    BlockFilter filter;
+    BOOST_CHECK(index.LookupFilter(pgenesis, filter));
+    BOOST_CHECK(filter.GetBlockHash() == pgenesis->GetBlockHash());
+    BOOST_CHECK(filter.GetEncodedFilter() == expected.GetEncodedFilter());
+
+    uint256 header;
+    BOOST_CHECK(index.LookupFilterHeader(pgenesis, header));
+    BOOST_CHECK(header == expected.ComputeHeader(uint256()));
+
+    std::vector<BlockFilter> vFilters;
+    BOOST_CHECK(index.LookupFilterRange(0, pgenesis, vFilters));
+    BOOST_CHECK_EQUAL(vFilters.size(), 1U);
+    std::vector<uint256> vHashes;
+    BOOST_CHECK(index.LookupFilterHashRange(0, pgenesis, vHashes));
+    BOOST_CHECK_EQUAL(vHashes.size(), 1U);
+    BOOST_CHECK(vHashes[0] == expected.GetHash());
+    BOOST_CHECK(!index.LookupFilterHashRange(1, pgenesis, vHashes));
+
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 
 #include <boost/assign/std/vector.hpp> // for 'operator+=()'
 #include <boost/assert.hpp>
+#include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
 // Test if a string consists entirely of null characters
@@ -318,6 +319,58 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    std::set<std::string> setDBNames;
+    setDBNames.insert("chainstate");
+    setDBNames.insert("blockindex");
+    std::string strError;
+
+    // A bare profile applies to every database, a named one overrides it
+    std::vector<std::string> vArgs;
+    vArgs.push_back("hdd");
+    vArgs.push_back("chainstate:ssd");
+    BOOST_CHECK(SetDBProfiles(vArgs, setDBNames, strError));
+    BOOST_CHECK_EQUAL(GetSelectedDBProfile("chainstate").strName, "ssd");
+    BOOST_CHECK_EQUAL(GetSelectedDBProfile("blockindex").strName, "hdd");
+    BOOST_CHECK_EQUAL(GetSelectedDBProfile("").strName, "hdd");
+
+    // Every profile opens a working database, which getdbinfo reports
+    CDBProfile profile;
+    const char* const pszProfiles[] = {"default", "ssd", "hdd"};
+    BOOST_FOREACH(const char* pszProfile, pszProfiles) {
+        vArgs.assign(1, std::string("chainstate:") + pszProfile);
+        BOOST_CHECK(SetDBProfiles(vArgs, setDBNames, strError));
+        BOOST_CHECK(GetDBProfile(pszProfile, profile));
+        boost::filesystem::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, "chainstate");
+        uint256 in = GetRandHash(), res;
+        BOOST_CHECK(dbw.Write('k', in));
+        BOOST_CHECK(dbw.Read('k', res));
+        BOOST_CHECK(res == in);
+
+        bool fFound = false;
+        BOOST_FOREACH(const CDBWrapperInfo& info, ListOpenDatabases()) {
+            if (info.strPath != ph.string())
+                continue;
+            fFound = true;
+            BOOST_CHECK_EQUAL(info.strName, "chainstate");
+            BOOST_CHECK_EQUAL(info.profile.strName, pszProfile);
+            BOOST_CHECK_EQUAL(info.nBlockCacheSize, (1 << 20) / 100 * profile.nBlockCachePercent);
+            BOOST_CHECK(info.nBlockCacheSize + 2 * info.nWriteBufferSize <= info.nCacheSize);
+        }
+        BOOST_CHECK(fFound);
+    }
+
+    // Unknown databases and profiles are rejected, leaving the selection as it was
+    vArgs.assign(1, "chainstate:tape");
+    BOOST_CHECK(!SetDBProfiles(vArgs, setDBNames, strError));
+    vArgs.assign(1, "walletdb:ssd");
+    BOOST_CHECK(!SetDBProfiles(vArgs, setDBNames, strError));
+    BOOST_CHECK_EQUAL(GetSelectedDBProfile("chainstate").strName, "hdd");
 
+    BOOST_CHECK(SetDBProfiles(std::vector<std::string>(), setDBNames, strError));
+    BOOST_CHECK_EQUAL(GetSelectedDBProfile("chainstate").strName, DEFAULT_DB_PROFILE);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
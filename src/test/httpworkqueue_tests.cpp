@@ -0,0 +1,113 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "httpworkqueue.h"
+#include "utiltime.h"
+
+#include "test/test_bitcoin.h"
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(httpworkqueue_tests, BasicTestingSetup)
+
+struct TestWorkItem
+{
+    std::function<void(void)> func;
+
+    TestWorkItem(const std::function<void(void)>& _func) : func(_func) {}
+    void operator()() { func(); }
+};
+
+/** Items that block until released, like long polls and slow calls */
+class BlockingItems
+{
+private:
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fReleased;
+    int nStarted;
+
+public:
+    BlockingItems() : fReleased(false), nStarted(0) {}
+
+    TestWorkItem* Make()
+    {
+        return new TestWorkItem([this]() {
+            std::unique_lock<std::mutex> lock(cs);
+            nStarted++;
+            cond.notify_all();
+            while (!fReleased)
+                cond.wait(lock);
+        });
+    }
+
+    /** Wait until n items have started, or a while has passed */
+    int WaitStarted(int n)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait_for(lock, std::chrono::seconds(10), [this, n]() { return nStarted >= n; });
+        return nStarted;
+    }
+
+    void Release()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fReleased = true;
+        cond.notify_all();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(httpworkqueue_cheap_lane_kept_free)
+{
+    const int nThreads = DEFAULT_HTTP_THREADS;
+    WorkQueue<TestWorkItem> queue(16);
+    std::vector<std::thread> vThreads;
+    for (int i = 0; i < nThreads; i++)
+        vThreads.emplace_back(&WorkQueue<TestWorkItem>::Run, &queue);
+
+    // Two long polls and two expensive calls, enough to occupy every thread
+    BlockingItems blocking;
+    BOOST_CHECK(queue.Enqueue(blocking.Make(), HTTP_LANE_WAIT));
+    BOOST_CHECK(queue.Enqueue(blocking.Make(), HTTP_LANE_WAIT));
+    BOOST_CHECK(queue.Enqueue(blocking.Make(), HTTP_LANE_EXPENSIVE));
+    BOOST_CHECK(queue.Enqueue(blocking.Make(), HTTP_LANE_EXPENSIVE));
+
+    // Only all threads but one run them between them
+    BOOST_CHECK_EQUAL(blocking.WaitStarted(nThreads - 1), nThreads - 1);
+    MilliSleep(50);
+    BOOST_CHECK_EQUAL(blocking.WaitStarted(nThreads), nThreads - 1);
+    HTTPWorkLaneStats statsWait = queue.GetStats(HTTP_LANE_WAIT);
+    HTTPWorkLaneStats statsExpensive = queue.GetStats(HTTP_LANE_EXPENSIVE);
+    BOOST_CHECK_EQUAL(statsWait.running + statsExpensive.running, nThreads - 1);
+    BOOST_CHECK_EQUAL(statsWait.depth + statsExpensive.depth, 1U);
+
+    // The one left runs a cheap call right away
+    std::promise<void> promiseCheap;
+    std::future<void> futureCheap = promiseCheap.get_future();
+    BOOST_CHECK(queue.Enqueue(new TestWorkItem([&promiseCheap]() { promiseCheap.set_value(); }), HTTP_LANE_CHEAP));
+    BOOST_CHECK(futureCheap.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+
+    // ...but no default one
+    std::unique_ptr<TestWorkItem> itemDefault(new TestWorkItem([]() {}));
+    BOOST_CHECK(!queue.EnqueueIfIdle(itemDefault.get(), HTTP_LANE_DEFAULT));
+
+    // The queued item runs once a thread is released
+    blocking.Release();
+    BOOST_CHECK_EQUAL(blocking.WaitStarted(nThreads), nThreads);
+
+    queue.Interrupt();
+    for (std::thread& thread : vThreads)
+        thread.join();
+    queue.WaitExit();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
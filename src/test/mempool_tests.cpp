@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "net_processing.h"
 #include "policy/policy.h"
+#include "random.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -584,4 +586,67 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolRelayOrderTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // Parents at different fee rates, a high fee child, and a transaction
+    // that left the mempool
+    std::vector<CMutableTransaction> vTx(4);
+    const CAmount vFee[] = {10000, 20000, 0, 50000};
+    std::set<uint256> setTx;
+    for (unsigned int i = 0; i < vTx.size(); i++) {
+        vTx[i].vout.resize(1);
+        vTx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vTx[i].vout[0].nValue = (i + 1) * COIN;
+        if (i == 3) {
+            vTx[i].vin.resize(1);
+            vTx[i].vin[0].prevout = COutPoint(vTx[0].GetHash(), 0);
+            vTx[i].vin[0].scriptSig = CScript() << OP_11;
+        }
+        pool.addUnchecked(vTx[i].GetHash(), entry.Fee(vFee[i]).FromTx(vTx[i]));
+        setTx.insert(vTx[i].GetHash());
+    }
+    setTx.insert(GetRandHash());
+
+    // The shared keys give the same order as the mempool itself
+    CTxRelayOrder relayOrder;
+    int64_t nNow = RELAY_ORDER_SNAPSHOT_INTERVAL;
+    std::vector<TxRelayCandidate> vCandidates;
+    relayOrder.GetCandidates(pool, setTx, vCandidates, nNow);
+    BOOST_CHECK_EQUAL(vCandidates.size(), setTx.size());
+    std::sort(vCandidates.begin(), vCandidates.end(), [](const TxRelayCandidate& a, const TxRelayCandidate& b) {
+        return RelayBefore(*a.first, *b.first);
+    });
+    std::vector<uint256> vExpected(setTx.begin(), setTx.end());
+    std::sort(vExpected.begin(), vExpected.end(), [&pool](const uint256& a, const uint256& b) {
+        return pool.CompareDepthAndScore(a, b);
+    });
+    for (unsigned int i = 0; i < vExpected.size(); i++)
+        BOOST_CHECK(*vCandidates[i].second == vExpected[i]);
+    BOOST_CHECK(*vCandidates[0].second == vTx[1].GetHash());
+    BOOST_CHECK(*vCandidates[3].second == vTx[3].GetHash());
+
+    // Another peer's candidates share the same keys
+    std::set<uint256> setOther;
+    setOther.insert(vTx[2].GetHash());
+    std::vector<TxRelayCandidate> vOther;
+    relayOrder.GetCandidates(pool, setOther, vOther, nNow);
+    BOOST_CHECK_EQUAL(vOther.size(), 1U);
+    for (unsigned int i = 0; i < vCandidates.size(); i++) {
+        if (*vCandidates[i].second == vTx[2].GetHash())
+            BOOST_CHECK(vOther[0].first == vCandidates[i].first);
+    }
+
+    // Fee changes show once the snapshot is rebuilt
+    pool.PrioritiseTransaction(vTx[2].GetHash(), vTx[2].GetHash().ToString(), 0, 100000);
+    vOther.clear();
+    relayOrder.GetCandidates(pool, setOther, vOther, nNow + RELAY_ORDER_SNAPSHOT_INTERVAL - 1);
+    BOOST_CHECK_EQUAL(vOther[0].first->nModFee, 0);
+    vOther.clear();
+    relayOrder.GetCandidates(pool, setOther, vOther, nNow + RELAY_ORDER_SNAPSHOT_INTERVAL);
+    BOOST_CHECK_EQUAL(vOther[0].first->nModFee, 100000);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
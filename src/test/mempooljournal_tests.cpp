@@ -0,0 +1,248 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "consensus/validation.h"
+#include "key.h"
+#include "mempooljournal.h"
+#include "txmempool.h"
+#include "util.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+static CMutableTransaction MakeJournalTx(uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 1000;
+    return tx;
+}
+
+static void AddJournalTx(CTxMemPool& pool, const CMutableTransaction& tx)
+{
+    TestMemPoolEntryHelper entry;
+    LOCK(cs_main);
+    pool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+}
+
+static std::vector<MempoolJournalEntry> LoadJournal(std::map<uint256, CAmount>& mapDeltas)
+{
+    CMempoolJournal journal;
+    std::vector<MempoolJournalEntry> vEntries;
+    BOOST_CHECK(journal.Load(vEntries, mapDeltas));
+    return vEntries;
+}
+
+static std::vector<MempoolJournalEntry> LoadJournal()
+{
+    std::map<uint256, CAmount> mapDeltas;
+    return LoadJournal(mapDeltas);
+}
+
+BOOST_FIXTURE_TEST_SUITE(mempooljournal_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(mempooljournal_replay)
+{
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<CMutableTransaction> vTxns;
+    for (uint32_t i = 0; i < 5; i++)
+        vTxns.push_back(MakeJournalTx(i));
+
+    // Nothing on disk yet
+    BOOST_CHECK(LoadJournal().empty());
+
+    {
+        CMempoolJournal journal;
+        std::vector<MempoolJournalEntry> vEntries;
+        std::map<uint256, CAmount> mapDeltas;
+        BOOST_CHECK(journal.Load(vEntries, mapDeltas));
+        BOOST_CHECK(journal.Open(pool));
+        for (unsigned int i = 0; i < 3; i++)
+            AddJournalTx(pool, vTxns[i]);
+        {
+            LOCK(cs_main);
+            pool.removeRecursive(vTxns[1]);
+        }
+        journal.Close();
+    }
+
+    // Removed transactions are tombstoned, the others come back in order
+    std::vector<MempoolJournalEntry> vEntries = LoadJournal();
+    BOOST_CHECK_EQUAL(vEntries.size(), 2U);
+    BOOST_CHECK(vEntries[0].tx->GetHash() == vTxns[0].GetHash());
+    BOOST_CHECK(vEntries[1].tx->GetHash() == vTxns[2].GetHash());
+
+    // Compaction folds the journal into the snapshot, and later records
+    // go to a fresh journal
+    {
+        CMempoolJournal journal;
+        std::vector<MempoolJournalEntry> vLoaded;
+        std::map<uint256, CAmount> mapDeltas;
+        BOOST_CHECK(journal.Load(vLoaded, mapDeltas));
+        BOOST_CHECK(journal.Open(pool));
+        AddJournalTx(pool, vTxns[3]);
+        BOOST_CHECK(!journal.NeedsCompaction(pool));
+        BOOST_CHECK(journal.Compact(pool));
+        BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "mempool.journal.old"));
+        AddJournalTx(pool, vTxns[4]);
+        {
+            LOCK(cs_main);
+            pool.removeRecursive(vTxns[0]);
+        }
+        journal.Close();
+    }
+
+    // The snapshot is in mempool order, which ties between these break by txid
+    vEntries = LoadJournal();
+    BOOST_CHECK_EQUAL(vEntries.size(), 3U);
+    std::set<uint256> setLoaded;
+    BOOST_FOREACH(const MempoolJournalEntry& entry, vEntries)
+        setLoaded.insert(entry.tx->GetHash());
+    BOOST_CHECK(!setLoaded.count(vTxns[0].GetHash()));
+    BOOST_CHECK(setLoaded.count(vTxns[2].GetHash()));
+    BOOST_CHECK(setLoaded.count(vTxns[3].GetHash()));
+    BOOST_CHECK(vEntries[2].tx->GetHash() == vTxns[4].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(mempooljournal_damaged_tail)
+{
+    CTxMemPool pool(CFeeRate(0));
+    {
+        CMempoolJournal journal;
+        std::vector<MempoolJournalEntry> vEntries;
+        std::map<uint256, CAmount> mapDeltas;
+        BOOST_CHECK(journal.Load(vEntries, mapDeltas));
+        BOOST_CHECK(journal.Open(pool));
+        AddJournalTx(pool, MakeJournalTx(0));
+        journal.Close();
+    }
+
+    // A record cut short by a crash is skipped, and overwritten once the
+    // journal is reopened
+    FILE* file = fopen((GetDataDir() / "mempool.journal").string().c_str(), "ab");
+    BOOST_CHECK(file);
+    const unsigned char vchPartial[] = {0, 42, 0, 0};
+    fwrite(vchPartial, 1, sizeof(vchPartial), file);
+    fclose(file);
+
+    {
+        CMempoolJournal journal;
+        std::vector<MempoolJournalEntry> vEntries;
+        std::map<uint256, CAmount> mapDeltas;
+        BOOST_CHECK(journal.Load(vEntries, mapDeltas));
+        BOOST_CHECK_EQUAL(vEntries.size(), 1U);
+        BOOST_CHECK(journal.Open(pool));
+        AddJournalTx(pool, MakeJournalTx(1));
+        journal.Close();
+    }
+
+    BOOST_CHECK_EQUAL(LoadJournal().size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(mempooljournal_fee_deltas)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CMutableTransaction txA = MakeJournalTx(0);
+    CMutableTransaction txB = MakeJournalTx(1);
+    CMutableTransaction txC = MakeJournalTx(2);
+    double prioritydummy = 0;
+    {
+        CMempoolJournal journal;
+        std::vector<MempoolJournalEntry> vEntries;
+        std::map<uint256, CAmount> mapDeltas;
+        BOOST_CHECK(journal.Load(vEntries, mapDeltas));
+        BOOST_CHECK(journal.Open(pool));
+        AddJournalTx(pool, txA);
+        AddJournalTx(pool, txB);
+        pool.PrioritiseTransaction(txA.GetHash(), txA.GetHash().ToString(), prioritydummy, 100);
+        pool.PrioritiseTransaction(txA.GetHash(), txA.GetHash().ToString(), prioritydummy, 50);
+        pool.PrioritiseTransaction(txB.GetHash(), txB.GetHash().ToString(), prioritydummy, 300);
+        pool.PrioritiseTransaction(txB.GetHash(), txB.GetHash().ToString(), prioritydummy, -300);
+        // Not in the mempool (yet)
+        pool.PrioritiseTransaction(txC.GetHash(), txC.GetHash().ToString(), prioritydummy, 200);
+        journal.Close();
+    }
+
+    // Deltas survive a restart without a snapshot being written
+    std::map<uint256, CAmount> mapDeltas;
+    std::vector<MempoolJournalEntry> vEntries = LoadJournal(mapDeltas);
+    BOOST_CHECK_EQUAL(vEntries.size(), 2U);
+    BOOST_CHECK(vEntries[0].tx->GetHash() == txA.GetHash());
+    BOOST_CHECK_EQUAL(vEntries[0].nFeeDelta, 150);
+    BOOST_CHECK_EQUAL(vEntries[1].nFeeDelta, 0);
+    BOOST_CHECK_EQUAL(mapDeltas.size(), 1U);
+    BOOST_CHECK_EQUAL(mapDeltas[txC.GetHash()], 200);
+
+    // A delta recorded before its transaction arrived applies to it, and one
+    // the snapshot holds is cleared once its transaction is mined
+    {
+        CMempoolJournal journal;
+        std::vector<MempoolJournalEntry> vLoaded;
+        std::map<uint256, CAmount> mapLoaded;
+        BOOST_CHECK(journal.Load(vLoaded, mapLoaded));
+        BOOST_CHECK(journal.Open(pool));
+        BOOST_CHECK(journal.Compact(pool));
+        AddJournalTx(pool, txC);
+        {
+            LOCK(cs_main);
+            pool.removeRecursive(txA);
+        }
+        pool.ClearPrioritisation(txA.GetHash());
+        journal.Close();
+    }
+
+    mapDeltas.clear();
+    vEntries = LoadJournal(mapDeltas);
+    BOOST_CHECK_EQUAL(vEntries.size(), 2U);
+    BOOST_CHECK(mapDeltas.empty());
+    BOOST_FOREACH(const MempoolJournalEntry& entry, vEntries)
+        BOOST_CHECK_EQUAL(entry.nFeeDelta, entry.tx->GetHash() == txC.GetHash() ? 200 : 0);
+}
+
+BOOST_AUTO_TEST_CASE(mempooljournal_load_verifies_scripts)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    std::vector<uint256> vFunding;
+    for (uint32_t i = 0; i < 2; i++)
+        vFunding.push_back(AddTestCoinsToKey(key, i));
+
+    // A valid transaction, one with a bad signature and a child of the first
+    CMutableTransaction txValid = CreateSignedTestSpend(key, vFunding[0], 90*CENT, CScript(), false);
+    CMutableTransaction txInvalid = CreateSignedTestSpend(key, vFunding[1], 90*CENT, CScript(), true);
+    CMutableTransaction txChild = CreateSignedTestSpend(key, txValid.GetHash(), 80*CENT, CScript(), false);
+    {
+        CTxMemPool pool(CFeeRate(0));
+        CMempoolJournal journal;
+        std::vector<MempoolJournalEntry> vEntries;
+        std::map<uint256, CAmount> mapDeltas;
+        BOOST_CHECK(journal.Load(vEntries, mapDeltas));
+        BOOST_CHECK(journal.Open(pool));
+        AddJournalTx(pool, txValid);
+        AddJournalTx(pool, txInvalid);
+        AddJournalTx(pool, txChild);
+        journal.Close();
+    }
+
+    // Scripts are verified before anything enters the mempool, so the
+    // invalid transaction is never there to be relayed or mined
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK(mempool.exists(txValid.GetHash()));
+    BOOST_CHECK(mempool.exists(txChild.GetHash()));
+    BOOST_CHECK(!mempool.exists(txInvalid.GetHash()));
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+
+    DumpMempool();
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "validation.h"
 #include "miner.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "pubkey.h"
 #include "script/standard.h"
 #include "txmempool.h"
@@ -493,4 +494,95 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(BlockTemplateEngine_incremental)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    entry.nHeight = 1;
+
+    mempool.clear();
+    BlockTemplateEngine engine(chainparams, NULL);
+    LOCK(cs_main);
+
+    CMutableTransaction txA;
+    txA.vin.resize(1);
+    txA.vin[0].prevout.hash = uint256S("01");
+    txA.vin[0].scriptSig = CScript() << OP_1;
+    txA.vout.resize(1);
+    txA.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    txA.vout[0].nValue = 5000000000LL;
+    mempool.addUnchecked(txA.GetHash(), entry.Fee(10000).FromTx(txA));
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = engine.GetTemplate(scriptPubKey, true);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txA.GetHash());
+
+    // A child of the selected transaction and an unrelated one are added to
+    // the kept selection
+    CMutableTransaction txB;
+    txB.vin.resize(1);
+    txB.vin[0].prevout = COutPoint(txA.GetHash(), 0);
+    txB.vin[0].scriptSig = CScript() << OP_1;
+    txB.vout.resize(1);
+    txB.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    txB.vout[0].nValue = 4000000000LL;
+    mempool.addUnchecked(txB.GetHash(), entry.Fee(20000).FromTx(txB));
+
+    CMutableTransaction txC(txA);
+    txC.vin[0].prevout.hash = uint256S("02");
+    mempool.addUnchecked(txC.GetHash(), entry.Fee(5000).FromTx(txC));
+
+    pblocktemplate = engine.GetTemplate(scriptPubKey, true);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txA.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == txB.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == txC.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -35000);
+
+    // Without changes the same transactions are served again
+    pblocktemplate = engine.GetTemplate(scriptPubKey, true);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+
+    // Once a selected transaction leaves the mempool, the template starts over
+    mempool.removeRecursive(txA);
+    pblocktemplate = engine.GetTemplate(scriptPubKey, true);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txC.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -5000);
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(ScanNonces_threads)
+{
+    // A target that about every other hash meets
+    Consensus::Params consensusParams = Params().GetConsensus();
+    consensusParams.powLimit = uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = uint256S("01");
+    header.nTime = 1500000000;
+    header.nBits = 0x207fffff;
+
+    for (uint32_t nStart = 0; nStart < 8; nStart++) {
+        header.nNonce = nStart;
+        uint32_t nExpected = nStart;
+        while (!CheckProofOfWork(header.GetPoWHash(), header.nBits, consensusParams))
+            header.nNonce = ++nExpected;
+
+        // Any number of threads finds the lowest solution in the range
+        for (int nThreads = 1; nThreads <= 4; nThreads++) {
+            header.nNonce = nStart;
+            BOOST_CHECK(ScanNonces(&header, nStart + 32, nThreads, consensusParams));
+            BOOST_CHECK_EQUAL(header.nNonce, nExpected);
+        }
+
+        // A range ending before the solution has none
+        header.nNonce = nStart;
+        BOOST_CHECK(!ScanNonces(&header, nExpected, 4, consensusParams));
+        BOOST_CHECK_EQUAL(header.nNonce, nStart);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
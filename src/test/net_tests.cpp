@@ -11,6 +11,8 @@
 #include "net.h"
 #include "netbase.h"
 #include "chainparams.h"
+#include "consensus/consensus.h"
+#include "netmessagemaker.h"
 
 class CAddrManSerializationMock : public CAddrMan
 {
@@ -172,4 +174,103 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_shared_send_payload)
+{
+    CConnman connman(0x1337, 0x1337);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode1(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true));
+    std::unique_ptr<CNode> pnode2(new CNode(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 1, 1, "", true));
+
+    CSharedNetMsg msg(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::PING, (uint64_t)42));
+    BOOST_CHECK(msg.hash == Hash(msg.data->begin(), msg.data->end()));
+    connman.PushMessage(pnode1.get(), msg);
+    connman.PushMessage(pnode2.get(), msg);
+
+    // Each node queues its own header, followed by the one shared payload
+    BOOST_CHECK_EQUAL(pnode1->vSendMsg.size(), 2U);
+    BOOST_CHECK_EQUAL(pnode2->vSendMsg.size(), 2U);
+    BOOST_CHECK(pnode1->vSendMsg[1] == msg.data);
+    BOOST_CHECK(pnode2->vSendMsg[1] == msg.data);
+    BOOST_CHECK_EQUAL(pnode1->nSendSize, CMessageHeader::HEADER_SIZE + msg.data->size());
+
+    CMessageHeader hdr(Params().MessageStart());
+    CDataStream ssHeader(*pnode1->vSendMsg[0], SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::PING);
+    BOOST_CHECK(memcmp(hdr.pchChecksum, msg.hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(cnetmessage_receive_in_place)
+{
+    std::vector<unsigned char> vPayload(3 * RECV_SCRATCH_SIZE + 123);
+    for (unsigned int i = 0; i < vPayload.size(); i++)
+        vPayload[i] = i * 7;
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::BLOCK, vPayload.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << hdr;
+
+    std::shared_ptr<CNetMessageBufferPool> pool = std::make_shared<CNetMessageBufferPool>();
+    {
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION, pool);
+        BOOST_CHECK_EQUAL(msg.readHeader(&ssHeader[0], ssHeader.size()), (int)ssHeader.size());
+        BOOST_CHECK(msg.in_data);
+        // Nothing is allocated for the payload before it arrives
+        BOOST_CHECK_EQUAL(msg.vRecv.capacity(), 0U);
+
+        // Part of the payload arrives along with the header, the rest is written in place
+        BOOST_CHECK_EQUAL(msg.readData((const char*)vPayload.data(), 100), 100);
+        while (!msg.complete()) {
+            unsigned int nSize;
+            char* pch = msg.GetDataBuffer(RECV_SCRATCH_SIZE, nSize);
+            BOOST_CHECK(nSize > 0 && nSize <= RECV_SCRATCH_SIZE);
+            memcpy(pch, vPayload.data() + msg.nDataPos, nSize);
+            msg.DataReceived(nSize);
+            BOOST_CHECK(msg.vRecv.capacity() <= msg.nDataPos + 2 * RECV_ALLOC_STEP);
+        }
+        BOOST_CHECK(msg.GetMessageHash() == hash);
+        BOOST_CHECK(memcmp(vPayload.data(), msg.vRecv.data(), vPayload.size()) == 0);
+    }
+
+    // The payload buffer went back to the pool, and is handed out again for a message it can hold
+    CSerializeData vch = pool->Get(vPayload.size());
+    BOOST_CHECK(vch.capacity() >= vPayload.size());
+    BOOST_CHECK(pool->Get(1).capacity() == 0);
+
+    // Buffers are picked by the best fit, and small ones are not kept
+    CSerializeData vchSmall, vchMedium, vchLarge;
+    vchSmall.reserve(100);
+    vchMedium.reserve(2 * RECV_SCRATCH_SIZE);
+    vchLarge.reserve(8 * RECV_SCRATCH_SIZE);
+    pool->Put(std::move(vchSmall));
+    pool->Put(std::move(vchLarge));
+    pool->Put(std::move(vchMedium));
+    BOOST_CHECK_EQUAL(pool->Get(RECV_SCRATCH_SIZE).capacity(), 2 * RECV_SCRATCH_SIZE);
+    BOOST_CHECK_EQUAL(pool->Get(16 * RECV_SCRATCH_SIZE).capacity(), 8 * RECV_SCRATCH_SIZE);
+    BOOST_CHECK_EQUAL(pool->Get(1).capacity(), 0U);
+
+    // A block-sized buffer is kept, and only taken once its message's data arrives
+    CSerializeData vchBlock;
+    vchBlock.reserve(MAX_BLOCK_SERIALIZED_SIZE);
+    pool->Put(std::move(vchBlock));
+    CMessageHeader hdrBlock(Params().MessageStart(), NetMsgType::BLOCK, MAX_BLOCK_SERIALIZED_SIZE);
+    CDataStream ssBlockHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlockHeader << hdrBlock;
+    {
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION, pool);
+        msg.readHeader(&ssBlockHeader[0], ssBlockHeader.size());
+        BOOST_CHECK_EQUAL(msg.vRecv.capacity(), 0U);
+        unsigned int nSize;
+        msg.GetDataBuffer(RECV_SCRATCH_SIZE, nSize);
+        BOOST_CHECK_EQUAL(msg.vRecv.capacity(), MAX_BLOCK_SERIALIZED_SIZE);
+        BOOST_CHECK_EQUAL(pool->Get(1).capacity(), 0U);
+    }
+    BOOST_CHECK_EQUAL(pool->Get(1).capacity(), MAX_BLOCK_SERIALIZED_SIZE);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
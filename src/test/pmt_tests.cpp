@@ -124,4 +124,40 @@ BOOST_AUTO_TEST_CASE(pmt_malleability)
     BOOST_CHECK(tree.ExtractMatches(vTxid, vIndex).IsNull());
 }
 
+BOOST_AUTO_TEST_CASE(pmt_block_merkle_tree_cache)
+{
+    CBlock block;
+    for (unsigned int j = 0; j < 37; j++) {
+        CMutableTransaction tx;
+        tx.nLockTime = j;
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    // Every level of the tree, ending in the block's merkle root
+    std::shared_ptr<const MerkleTree> tree = GetBlockMerkleTree(block);
+    BOOST_CHECK_EQUAL(tree->size(), 7U);
+    BOOST_CHECK_EQUAL(tree->back().size(), 1U);
+    BOOST_CHECK(tree->back()[0] == BlockMerkleRoot(block));
+    for (unsigned int j = 0; j < block.vtx.size(); j++)
+        BOOST_CHECK(ComputeMerkleBranch(*tree, j) == BlockMerkleBranch(block, j));
+
+    // A recently used block is served from the cache
+    BOOST_CHECK(GetBlockMerkleTree(block) == tree);
+
+    // Building from the tree gives the same partial tree as building from the txids
+    std::vector<bool> vMatch(block.vtx.size(), false);
+    vMatch[3] = vMatch[36] = true;
+    CDataStream ssTree(SER_NETWORK, PROTOCOL_VERSION), ssTxid(SER_NETWORK, PROTOCOL_VERSION);
+    ssTree << CPartialMerkleTree(*tree, vMatch);
+    ssTxid << CPartialMerkleTree(tree->front(), vMatch);
+    BOOST_CHECK(ssTree.str() == ssTxid.str());
+
+    // A mutated block with the same header does not hit the cached tree
+    CBlock mutated(block);
+    mutated.vtx.push_back(mutated.vtx.back());
+    std::shared_ptr<const MerkleTree> mutatedTree = GetBlockMerkleTree(mutated);
+    BOOST_CHECK(mutatedTree != tree);
+    BOOST_CHECK_EQUAL(mutatedTree->front().size(), 38U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,12 +4,18 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/jsonstream.h"
 
 #include "base58.h"
+#include "chainparams.h"
 #include "netbase.h"
+#include "txmempool.h"
+#include "validation.h"
 
 #include "test/test_bitcoin.h"
 
+#include <thread>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/list_of.hpp>
 #include <boost/test/unit_test.hpp>
@@ -38,6 +44,11 @@ UniValue CallRPC(std::string args)
 }
 
 
+extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSON(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSON(CJSONStreamWriter& writer, bool fVerbose = false);
+
 BOOST_FIXTURE_TEST_SUITE(rpc_tests, TestingSetup)
 
 BOOST_AUTO_TEST_CASE(rpc_rawparams)
@@ -343,4 +354,189 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+static bool QueueOnNewThread(std::vector<std::thread>* pvThreads, size_t nMaxThreads, const std::function<void(void)>& func)
+{
+    if (pvThreads->size() >= nMaxThreads)
+        return false;
+    pvThreads->push_back(std::thread(func));
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    // Replies come back in request order, each failure at its own request
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 20; i++) {
+        if (i % 7 == 3)
+            vReq.push_back(i);
+        else
+            vReq.push_back(JSONRPCRequestObj("getblockcount", NullUniValue, i));
+    }
+    std::string strSerial = JSONRPCExecBatch(vReq);
+
+    std::vector<std::thread> vThreads;
+    std::string strParallel = JSONRPCExecBatch(vReq, std::bind(&QueueOnNewThread, &vThreads, 3, std::placeholders::_1), 4);
+    BOOST_CHECK_EQUAL(vThreads.size(), 3U);
+    for (std::thread& thread : vThreads)
+        thread.join();
+    BOOST_CHECK_EQUAL(strParallel, strSerial);
+
+    UniValue vReply;
+    BOOST_CHECK(vReply.read(strParallel));
+    BOOST_CHECK_EQUAL(vReply.size(), vReq.size());
+    for (int i = 0; i < 20; i++) {
+        const UniValue& error = find_value(vReply[i], "error");
+        if (i % 7 == 3) {
+            BOOST_CHECK_EQUAL(find_value(error, "code").get_int(), RPC_INVALID_REQUEST);
+        } else {
+            BOOST_CHECK_EQUAL(find_value(vReply[i], "id").get_int(), i);
+        }
+    }
+
+    // Without helpers the batch still completes on the calling thread
+    vThreads.clear();
+    BOOST_CHECK_EQUAL(JSONRPCExecBatch(vReq, std::bind(&QueueOnNewThread, &vThreads, 0, std::placeholders::_1), 4), strSerial);
+}
+
+static UniValue MakeBatchRequest(const std::string& strMethod, const std::string& strParam1, const std::string& strParam2, int id)
+{
+    UniValue params(UniValue::VARR);
+    if (!strParam1.empty())
+        params.push_back(strParam1);
+    if (!strParam2.empty())
+        params.push_back(strParam2);
+    return JSONRPCRequestObj(strMethod, params, id);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    // Requests that change state take effect in request order, and the
+    // read-only requests around them see the state they leave
+    UniValue vReq(UniValue::VARR);
+    vReq.push_back(MakeBatchRequest("listbanned", "", "", 0));
+    vReq.push_back(MakeBatchRequest("setban", "127.0.0.0", "add", 1));
+    vReq.push_back(MakeBatchRequest("listbanned", "", "", 2));
+    vReq.push_back(MakeBatchRequest("getblockcount", "", "", 3));
+    vReq.push_back(MakeBatchRequest("setban", "127.0.0.0", "add", 4));
+    vReq.push_back(MakeBatchRequest("listbanned", "", "", 5));
+    vReq.push_back(MakeBatchRequest("clearbanned", "", "", 6));
+    vReq.push_back(MakeBatchRequest("listbanned", "", "", 7));
+    UniValue heightParams(UniValue::VARR);
+    heightParams.push_back(-1);
+    vReq.push_back(JSONRPCRequestObj("getblockhash", heightParams, 8));
+    vReq.push_back(9);
+    vReq.push_back(MakeBatchRequest("listbanned", "", "", 10));
+
+    if (RPCIsInWarmup(NULL))
+        SetRPCWarmupFinished();
+    BOOST_CHECK_NO_THROW(CallRPC("clearbanned"));
+    std::string strSerial = JSONRPCExecBatch(vReq);
+    for (int n = 0; n < 10; n++) {
+        std::vector<std::thread> vThreads;
+        std::string strParallel = JSONRPCExecBatch(vReq, std::bind(&QueueOnNewThread, &vThreads, 3, std::placeholders::_1), 4);
+        for (std::thread& thread : vThreads)
+            thread.join();
+        BOOST_CHECK_EQUAL(strParallel, strSerial);
+    }
+
+    UniValue vReply;
+    BOOST_CHECK(vReply.read(strSerial));
+    BOOST_CHECK_EQUAL(vReply.size(), vReq.size());
+    BOOST_CHECK_EQUAL(find_value(vReply[0], "result").size(), 0U);
+    BOOST_CHECK_EQUAL(find_value(vReply[2], "result").size(), 1U);
+    BOOST_CHECK_EQUAL(find_value(find_value(vReply[4], "error"), "code").get_int(), RPC_CLIENT_NODE_ALREADY_ADDED);
+    BOOST_CHECK_EQUAL(find_value(vReply[5], "result").size(), 1U);
+    BOOST_CHECK_EQUAL(find_value(vReply[7], "result").size(), 0U);
+    BOOST_CHECK_EQUAL(find_value(find_value(vReply[8], "error"), "code").get_int(), RPC_INVALID_PARAMETER);
+    BOOST_CHECK_EQUAL(find_value(find_value(vReply[9], "error"), "code").get_int(), RPC_INVALID_REQUEST);
+    BOOST_CHECK_EQUAL(find_value(vReply[10], "result").size(), 0U);
+    for (unsigned int i = 0; i < vReply.size(); i++) {
+        if (i != 9)
+            BOOST_CHECK_EQUAL(find_value(vReply[i], "id").get_int(), (int)i);
+    }
+}
+
+static void AppendChunk(std::vector<std::string>* pvChunks, const std::string& strChunk)
+{
+    pvChunks->push_back(strChunk);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    // Streamed output matches UniValue::write, and is handed over in chunks
+    std::vector<std::string> vChunks;
+    CJSONStreamWriter writer(std::bind(&AppendChunk, &vChunks, std::placeholders::_1));
+    UniValue expected(UniValue::VOBJ);
+    UniValue arr(UniValue::VARR);
+    std::string strLong(1000, 'x');
+    writer.BeginObject();
+    writer.Pair("a \"quoted\" key", 1);
+    writer.Key("list");
+    writer.BeginArray();
+    for (int i = 0; i < 200; i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("n", i));
+        entry.push_back(Pair("s", strLong));
+        writer.Value(entry);
+        arr.push_back(entry);
+    }
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginObject();
+    writer.EndObject();
+    writer.EndObject();
+    BOOST_CHECK(writer.IsUsed());
+    writer.Flush();
+    expected.push_back(Pair("a \"quoted\" key", 1));
+    expected.push_back(Pair("list", arr));
+    expected.push_back(Pair("empty", UniValue(UniValue::VOBJ)));
+    BOOST_CHECK(vChunks.size() > 1);
+    BOOST_CHECK_EQUAL(boost::algorithm::join(vChunks, ""), expected.write());
+
+    // A streamed block is the same as a converted one
+    CBlock block;
+    const CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    vChunks.clear();
+    CJSONStreamWriter blockWriter(std::bind(&AppendChunk, &vChunks, std::placeholders::_1));
+    blockToJSON(blockWriter, block, pindex, true);
+    blockWriter.Flush();
+    BOOST_CHECK_EQUAL(boost::algorithm::join(vChunks, ""), blockToJSON(block, pindex, true).write());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream_mempool)
+{
+    // Enough entries for the verbose form to span several chunks
+    TestMemPoolEntryHelper entry;
+    for (uint32_t i = 0; i < 300; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 1000 + i;
+        LOCK(cs_main);
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(1000 + i).FromTx(tx));
+    }
+
+    // A streamed mempool is the same as a converted one, in either form
+    for (int nVerbose = 0; nVerbose < 2; nVerbose++) {
+        std::vector<std::string> vChunks;
+        CJSONStreamWriter writer(std::bind(&AppendChunk, &vChunks, std::placeholders::_1));
+        mempoolToJSON(writer, nVerbose);
+        writer.Flush();
+        BOOST_CHECK(!nVerbose || vChunks.size() > 1);
+        BOOST_CHECK_EQUAL(boost::algorithm::join(vChunks, ""), mempoolToJSON(nVerbose).write());
+    }
+
+    // So is an empty one
+    mempool.clear();
+    std::vector<std::string> vChunks;
+    CJSONStreamWriter writer(std::bind(&AppendChunk, &vChunks, std::placeholders::_1));
+    mempoolToJSON(writer, true);
+    writer.Flush();
+    BOOST_CHECK_EQUAL(boost::algorithm::join(vChunks, ""), "{}");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,8 +1,11 @@
 #include <boost/test/unit_test.hpp>
 
+#include "primitives/block.h"
+#include "streams.h"
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "version.h"
 #include "crypto/scrypt.h"
 
 BOOST_AUTO_TEST_SUITE(scrypt_tests)
@@ -29,7 +32,28 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
         // Test generic scrypt
         scrypt_1024_1_1_256_sp_generic((const char*)&inputbytes[0], BEGIN(scrypthash), scratchpad);
         BOOST_CHECK_EQUAL(scrypthash.ToString().c_str(), expected[i]);
+        // Test scrypt from the midstate of the first 64 bytes
+        scrypt_midstate midstate;
+        scrypt_midstate_init(&midstate, (const char*)&inputbytes[0]);
+        scrypt_1024_1_1_256_sp_midstate(&midstate, (const char*)&inputbytes[0], BEGIN(scrypthash), scratchpad);
+        BOOST_CHECK_EQUAL(scrypthash.ToString().c_str(), expected[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_grindcontext)
+{
+    CBlockHeader header;
+    CDataStream ss(ParseHex("020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659"), SER_NETWORK, PROTOCOL_VERSION);
+    ss >> header;
+    const uint32_t nNonce = header.nNonce;
+
+    // The context hashes the header it was made from with any nonce
+    CPoWGrindContext context(header);
+    for (uint32_t i = 0; i < 4; i++) {
+        header.nNonce = nNonce + i;
+        BOOST_CHECK(context.GetPoWHash(header.nNonce) == header.GetPoWHash());
     }
+    BOOST_CHECK_EQUAL(context.GetPoWHash(nNonce).ToString(), "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806");
 }
 
 BOOST_AUTO_TEST_SUITE_END()
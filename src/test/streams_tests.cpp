@@ -72,6 +72,70 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_vector_reader)
+{
+    std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+
+    CVectorReader reader(SER_NETWORK, INIT_PROTO_VERSION, vch, 0);
+    BOOST_CHECK_EQUAL(reader.size(), 6);
+    BOOST_CHECK(!reader.empty());
+
+    // Read a single byte as an unsigned char.
+    unsigned char a;
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(reader.size(), 5);
+
+    // Read a 4 bytes as an unsigned int.
+    unsigned int b;
+    reader >> b;
+    BOOST_CHECK_EQUAL(b, 84149247); // 0x050403FF in little-endian
+    BOOST_CHECK_EQUAL(reader.size(), 1);
+
+    // Reading past the end throws
+    BOOST_CHECK_THROW(reader >> b, std::ios_base::failure);
+
+    // Starting past the end of the vector also throws
+    BOOST_CHECK_THROW(CVectorReader(SER_NETWORK, INIT_PROTO_VERSION, vch, 7), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(bitstream_reader_writer)
+{
+    CDataStream data(SER_NETWORK, INIT_PROTO_VERSION);
+
+    {
+        BitStreamWriter<CDataStream> bit_writer(data);
+        bit_writer.Write(0, 1);
+        bit_writer.Write(2, 2);
+        bit_writer.Write(6, 3);
+        bit_writer.Write(11, 4);
+        bit_writer.Write(1, 5);
+        bit_writer.Write(32, 6);
+        bit_writer.Write(7, 7);
+        bit_writer.Write(30497, 16);
+        bit_writer.Flush();
+    }
+
+    CDataStream data_copy(data);
+    uint32_t serialized_int1;
+    data >> serialized_int1;
+    BOOST_CHECK_EQUAL(serialized_int1, (uint32_t)0x7700C35A); // NOTE: Serialized as LE
+    uint16_t serialized_int2;
+    data >> serialized_int2;
+    BOOST_CHECK_EQUAL(serialized_int2, (uint16_t)0x1072); // NOTE: Serialized as LE
+
+    BitStreamReader<CDataStream> bit_reader(data_copy);
+    BOOST_CHECK_EQUAL(bit_reader.Read(1), 0);
+    BOOST_CHECK_EQUAL(bit_reader.Read(2), 2);
+    BOOST_CHECK_EQUAL(bit_reader.Read(3), 6);
+    BOOST_CHECK_EQUAL(bit_reader.Read(4), 11);
+    BOOST_CHECK_EQUAL(bit_reader.Read(5), 1);
+    BOOST_CHECK_EQUAL(bit_reader.Read(6), 32);
+    BOOST_CHECK_EQUAL(bit_reader.Read(7), 7);
+    BOOST_CHECK_EQUAL(bit_reader.Read(16), 30497);
+    BOOST_CHECK_THROW(bit_reader.Read(8), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
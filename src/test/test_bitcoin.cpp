@@ -9,6 +9,7 @@
 #include "chainparams.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -20,6 +21,7 @@
 #include "ui_interface.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/interpreter.h"
 #include "script/sigcache.h"
 
 #include "test/testutil.h"
@@ -38,6 +40,7 @@ extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
+        SHA256AutoDetect();
         ECC_Start();
         SetupEnvironment();
         SetupNetworking();
@@ -154,6 +157,41 @@ CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CTransaction &txn, CTxMemPo
                            inChainValue, spendsCoinbase, sigOpCost, lp);
 }
 
+uint256 AddTestCoinsToKey(const CKey& key, uint32_t n)
+{
+    CMutableTransaction funding;
+    funding.vin.resize(1);
+    funding.vin[0].prevout.n = n;
+    funding.vout.resize(1);
+    funding.vout[0].nValue = COIN;
+    funding.vout[0].scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    LOCK(cs_main);
+    *pcoinsTip->ModifyNewCoins(funding.GetHash(), false) = CCoins(funding, 0);
+    return funding.GetHash();
+}
+
+CMutableTransaction CreateSignedTestSpend(const CKey& key, const uint256& hashPrev, CAmount nValue, const CScript& scriptSigPrefix, bool fCorruptSig)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = hashPrev;
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    if (fCorruptSig)
+        vchSig[10] ^= 1;
+    tx.vin[0].scriptSig = scriptSigPrefix;
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
 void Shutdown(void* parg)
 {
   exit(0);
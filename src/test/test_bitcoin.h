@@ -89,4 +89,17 @@ struct TestMemPoolEntryHelper
     TestMemPoolEntryHelper &SpendsCoinbase(bool _flag) { spendsCoinbase = _flag; return *this; }
     TestMemPoolEntryHelper &SigOpsCost(unsigned int _sigopsCost) { sigOpCost = _sigopsCost; return *this; }
 };
+
+/**
+ * Add an output of one coin paying to key's public key to pcoinsTip, as if
+ * mined at height 0, and return the txid holding it. Different values of n
+ * give different txids.
+ */
+uint256 AddTestCoinsToKey(const CKey& key, uint32_t n);
+
+/**
+ * Spend output 0 of hashPrev, paying nValue back to key's public key. The
+ * signature is pushed after scriptSigPrefix, and broken if fCorruptSig.
+ */
+CMutableTransaction CreateSignedTestSpend(const CKey& key, const uint256& hashPrev, CAmount nValue, const CScript& scriptSigPrefix, bool fCorruptSig);
 #endif
@@ -0,0 +1,154 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "index/txcommentindex.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "uint256.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+static CTransactionRef MakeCommentTx(const std::string& strTxComment, uint32_t nLockTime)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 2;
+    tx.nLockTime = nLockTime; // only to make the txids distinct
+    tx.strTxComment = strTxComment;
+    return MakeTransactionRef(std::move(tx));
+}
+
+static CBlock MakeCommentBlock(const std::vector<std::string>& vComments)
+{
+    CBlock block;
+    for (unsigned int i = 0; i < vComments.size(); i++)
+        block.vtx.push_back(MakeCommentTx(vComments[i], i));
+    return block;
+}
+
+static bool WriteCommentBlock(CTxCommentDB& db, const CBlock& block, int nHeight)
+{
+    CDBBatch batch(db);
+    db.WriteBlock(batch, block, nHeight);
+    return db.WriteBatch(batch);
+}
+
+BOOST_FIXTURE_TEST_SUITE(txcomment_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(txcomment_prefix)
+{
+    CTxCommentDB db(1 << 20, true);
+    std::vector<std::string> vComments;
+    vComments.push_back("solar");
+    vComments.push_back("");
+    vComments.push_back("solarcoin");
+    vComments.push_back("sol");
+    vComments.push_back(std::string("solar\0x", 7));
+    vComments.push_back("lunar");
+    BOOST_CHECK(WriteCommentBlock(db, MakeCommentBlock(vComments), 10));
+
+    std::vector<std::string> vComments2;
+    vComments2.push_back("solar");
+    BOOST_CHECK(WriteCommentBlock(db, MakeCommentBlock(vComments2), 2));
+
+    std::vector<CTxCommentEntry> vEntries;
+    BOOST_CHECK(db.FindByPrefix("solar", NULL, 100, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 4U);
+    // Sorted by comment text, then by height
+    BOOST_CHECK_EQUAL(vEntries[0].strTxComment, "solar");
+    BOOST_CHECK_EQUAL(vEntries[0].nHeight, 2);
+    BOOST_CHECK_EQUAL(vEntries[1].strTxComment, "solar");
+    BOOST_CHECK_EQUAL(vEntries[1].nHeight, 10);
+    BOOST_CHECK(vEntries[2].strTxComment == std::string("solar\0x", 7));
+    BOOST_CHECK_EQUAL(vEntries[3].strTxComment, "solarcoin");
+
+    // Page through the same results two at a time
+    std::vector<CTxCommentEntry> vPage;
+    BOOST_CHECK(db.FindByPrefix("solar", NULL, 2, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    CTxCommentEntry next = vPage.back();
+    vPage.clear();
+    BOOST_CHECK(db.FindByPrefix("solar", &next, 3, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 3U);
+    BOOST_CHECK(vPage[0].txid == vEntries[1].txid);
+    BOOST_CHECK_EQUAL(vPage[2].strTxComment, "solarcoin");
+
+    vEntries.clear();
+    BOOST_CHECK(db.FindByPrefix("", NULL, 100, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 6U);
+    BOOST_CHECK_EQUAL(vEntries[0].strTxComment, "lunar");
+
+    vEntries.clear();
+    BOOST_CHECK(db.FindByPrefix("solx", NULL, 100, vEntries));
+    BOOST_CHECK(vEntries.empty());
+}
+
+BOOST_AUTO_TEST_CASE(txcomment_height)
+{
+    CTxCommentDB db(1 << 20, true);
+    std::vector<CBlock> vBlocks;
+    for (int nHeight = 0; nHeight < 5; nHeight++) {
+        std::vector<std::string> vComments;
+        vComments.push_back("");
+        vComments.push_back(strprintf("block %d a", nHeight));
+        vComments.push_back(strprintf("block %d b", nHeight));
+        vBlocks.push_back(MakeCommentBlock(vComments));
+        BOOST_CHECK(WriteCommentBlock(db, vBlocks.back(), nHeight));
+    }
+
+    std::vector<CTxCommentEntry> vEntries;
+    BOOST_CHECK(db.FindByHeight(1, 3, NULL, 100, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 6U);
+    BOOST_CHECK_EQUAL(vEntries.front().nHeight, 1);
+    BOOST_CHECK_EQUAL(vEntries.back().nHeight, 3);
+    for (unsigned int i = 1; i < vEntries.size(); i++)
+        BOOST_CHECK(vEntries[i - 1].nHeight <= vEntries[i].nHeight);
+
+    std::vector<CTxCommentEntry> vPage;
+    BOOST_CHECK(db.FindByHeight(1, 3, &vEntries[4], 100, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    BOOST_CHECK(vPage[0].txid == vEntries[4].txid);
+
+    // Disconnecting the tip removes it from both halves of the index
+    CDBBatch batch(db);
+    db.EraseBlock(batch, vBlocks[4], 4);
+    BOOST_CHECK(db.WriteBatch(batch));
+    vEntries.clear();
+    BOOST_CHECK(db.FindByHeight(0, 10, NULL, 100, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 8U);
+    vEntries.clear();
+    BOOST_CHECK(db.FindByPrefix("block 4", NULL, 100, vEntries));
+    BOOST_CHECK(vEntries.empty());
+    vEntries.clear();
+    BOOST_CHECK(db.FindByPrefix("block 3", NULL, 100, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(txcomment_index_sync)
+{
+    CTxCommentIndex index(1 << 20, true);
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(index.Start());
+
+    // Catching up with the active chain happens in the background
+    int64_t nTimeout = GetTimeMillis() + 10000;
+    while (!index.IsSynced() && GetTimeMillis() < nTimeout)
+        MilliSleep(10);
+    BOOST_CHECK(index.IsSynced());
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(index.GetBestHeight(), chainActive.Height());
+    }
+
+    CBlockLocator locator;
+    BOOST_CHECK(index.GetDB().ReadBestBlock(locator));
+    BOOST_CHECK(locator.vHave.front() == Params().GetConsensus().hashGenesisBlock);
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
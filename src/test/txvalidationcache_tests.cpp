@@ -84,4 +84,128 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_script_precheck, TestingSetup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    // Coins to spend, one per case
+    std::vector<uint256> vFunding;
+    for (int i = 0; i < 5; i++)
+        vFunding.push_back(AddTestCoinsToKey(key, i));
+
+    // A valid transaction is verified ahead, and accepted with the result
+    CTransactionRef tx = MakeTransactionRef(CreateSignedTestSpend(key, vFunding[0], 90*CENT, CScript(), false));
+    {
+        CTxScriptPrecheck precheck;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(PrepareTxScriptPrecheck(mempool, tx, true, precheck));
+        }
+        BOOST_CHECK(precheck.fPrepared && !precheck.fVerified);
+        RunTxScriptPrecheck(*tx, precheck);
+        BOOST_CHECK(precheck.fVerified && precheck.fValid);
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, tx, true, NULL, NULL, false, 0, &precheck));
+        BOOST_CHECK(mempool.exists(tx->GetHash()));
+    }
+
+    // A transaction rejected before its scripts are reached is not verified at all
+    {
+        CMutableTransaction txNonStandard = CreateSignedTestSpend(key, vFunding[1], 90*CENT, CScript(), false);
+        txNonStandard.vout[0].scriptPubKey = CScript() << OP_1 << OP_DROP;
+        CTxScriptPrecheck precheck;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(!PrepareTxScriptPrecheck(mempool, MakeTransactionRef(txNonStandard), true, precheck));
+        }
+        RunTxScriptPrecheck(txNonStandard, precheck);
+        BOOST_CHECK(!precheck.fPrepared && !precheck.fVerified);
+    }
+
+    // Scripts prevalidated against the standard flags are not verified
+    // against them again: this one has an extra stack element, which only
+    // the standard flags reject
+    tx = MakeTransactionRef(CreateSignedTestSpend(key, vFunding[2], 90*CENT, CScript() << OP_1, false));
+    {
+        CTxScriptPrecheck precheck;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(PrepareTxScriptPrecheck(mempool, tx, true, precheck));
+        }
+        RunTxScriptPrecheck(*tx, precheck);
+        BOOST_CHECK(precheck.fVerified && !precheck.fValid);
+        BOOST_CHECK_EQUAL(precheck.state.GetRejectCode(), REJECT_NONSTANDARD);
+        precheck.fValid = true;
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, tx, true, NULL, NULL, false, 0, &precheck));
+    }
+
+    // An invalid transaction is rejected with the precheck's result, without
+    // verifying its scripts once more
+    tx = MakeTransactionRef(CreateSignedTestSpend(key, vFunding[3], 90*CENT, CScript(), true));
+    {
+        CTxScriptPrecheck precheck;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(PrepareTxScriptPrecheck(mempool, tx, true, precheck));
+        }
+        RunTxScriptPrecheck(*tx, precheck);
+        BOOST_CHECK(precheck.fVerified && !precheck.fValid);
+        BOOST_CHECK_EQUAL(precheck.state.GetRejectCode(), REJECT_INVALID);
+        BOOST_CHECK_EQUAL(precheck.state.GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, tx, true, NULL, NULL, false, 0, &precheck));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), precheck.state.GetRejectReason());
+        int nDoS;
+        BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    }
+    {
+        // The result is taken as it is, so a valid transaction reported
+        // invalid is rejected too
+        tx = MakeTransactionRef(CreateSignedTestSpend(key, vFunding[4], 90*CENT, CScript(), false));
+        CTxScriptPrecheck precheck;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(PrepareTxScriptPrecheck(mempool, tx, true, precheck));
+        }
+        RunTxScriptPrecheck(*tx, precheck);
+        BOOST_CHECK(precheck.fValid);
+        precheck.fValid = false;
+        precheck.state.DoS(100, false, REJECT_INVALID, "precheck-failed");
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, tx, true, NULL, NULL, false, 0, &precheck));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "precheck-failed");
+
+        // Without it, the transaction is verified and accepted
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, tx, true, NULL, NULL, false, 0));
+    }
+
+    // Coins fetched for a transaction that never reaches AcceptToMemoryPool
+    // do not stay in the coins cache
+    {
+        uint256 hashFunding = AddTestCoinsToKey(key, 5);
+        {
+            LOCK(cs_main);
+            pcoinsTip->Flush();
+            BOOST_CHECK(!pcoinsTip->HaveCoinsInCache(hashFunding));
+        }
+        tx = MakeTransactionRef(CreateSignedTestSpend(key, hashFunding, 90*CENT, CScript(), false));
+        {
+            CTxScriptPrecheck precheck;
+            LOCK(cs_main);
+            BOOST_CHECK(PrepareTxScriptPrecheck(mempool, tx, true, precheck));
+            BOOST_CHECK(pcoinsTip->HaveCoinsInCache(hashFunding));
+        }
+        LOCK(cs_main);
+        BOOST_CHECK(!pcoinsTip->HaveCoinsInCache(hashFunding));
+    }
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "primitives/transaction.h"
+#include "scheduler.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+/** Records the notifications it receives and the threads delivering them */
+class CRecordingInterface : public CValidationInterface
+{
+public:
+    std::vector<uint256> vHashes;
+    std::set<boost::thread::id> setThreads;
+
+protected:
+    void UpdatedTransaction(const uint256& hash) override
+    {
+        vHashes.push_back(hash);
+        setThreads.insert(boost::this_thread::get_id());
+        MilliSleep(1);
+    }
+    void SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, int posInBlock) override
+    {
+        vHashes.push_back(tx.GetHash());
+        setThreads.insert(boost::this_thread::get_id());
+    }
+};
+
+static void SignalNotifications(std::vector<uint256>& vExpected, int nCount)
+{
+    for (int i = 0; i < nCount; i++) {
+        CMutableTransaction mtx;
+        mtx.nLockTime = i;
+        CTransactionRef ptx = MakeTransactionRef(mtx);
+        GetMainSignals().SyncTransaction(ptx, NULL, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+        vExpected.push_back(ptx->GetHash());
+        uint256 hash = ArithToUint256(arith_uint256(i + 1));
+        GetMainSignals().UpdatedTransaction(hash);
+        vExpected.push_back(hash);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(validationinterface_async_order)
+{
+    CScheduler scheduler;
+    boost::thread_group threads;
+    for (int i = 0; i < 3; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    while (!scheduler.AreThreadsServicingQueue())
+        MilliSleep(1);
+    RegisterBackgroundSignalScheduler(scheduler);
+
+    // Notifications reach each asynchronous subscriber in the order they were
+    // signalled, off the signalling thread, and the sync point waits for them
+    CRecordingInterface first, second, sync;
+    RegisterValidationInterface(&first, true);
+    RegisterValidationInterface(&second, true);
+    RegisterValidationInterface(&sync);
+    std::vector<uint256> vExpected;
+    SignalNotifications(vExpected, 50);
+    BOOST_CHECK(sync.vHashes == vExpected);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(first.vHashes == vExpected);
+    BOOST_CHECK(second.vHashes == vExpected);
+    BOOST_CHECK(!first.setThreads.count(boost::this_thread::get_id()));
+
+    // Unregistering delivers what is still queued, and nothing afterwards
+    SignalNotifications(vExpected, 10);
+    UnregisterValidationInterface(&first);
+    BOOST_CHECK(first.vHashes == vExpected);
+    std::vector<uint256> vIgnored;
+    SignalNotifications(vIgnored, 1);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(first.vHashes == vExpected);
+    BOOST_CHECK_EQUAL(second.vHashes.size(), vExpected.size() + 2);
+
+    // Once the scheduler stops, notifications are delivered synchronously
+    threads.interrupt_all();
+    threads.join_all();
+    CRecordingInterface late;
+    RegisterValidationInterface(&late, true);
+    std::vector<uint256> vLate;
+    SignalNotifications(vLate, 5);
+    BOOST_CHECK(late.vHashes == vLate);
+    BOOST_CHECK(late.setThreads.count(boost::this_thread::get_id()));
+
+    UnregisterBackgroundSignalScheduler();
+    UnregisterAllValidationInterfaces();
+    BOOST_CHECK_EQUAL(second.vHashes.size(), vExpected.size() + 2 + vLate.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,7 +9,9 @@
 #include "hash.h"
 #include "pow.h"
 #include "uint256.h"
+#include "undo.h"
 
+#include <set>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -24,8 +26,17 @@ static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
+static const char DB_TXCOMMENT = 'c';
+static const char DB_TXCOMMENT_HEIGHT = 'h';
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+static const char DB_ADDRESS_DELTA = 'a';
+static const char DB_ADDRESS_UNSPENT = 'u';
+static const char DB_SPENT = 's';
+
+static const char DB_BLOCK_FILTER = 'f';
+
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, DB_NAME_CHAINSTATE) 
 {
 }
 
@@ -67,7 +78,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, DB_NAME_BLOCK_INDEX) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -217,3 +228,397 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
 
     return true;
 }
+
+namespace {
+
+/**
+ * Key of the by-comment half of the comment index. The comment text is
+ * written unprefixed, with NUL bytes escaped as 00 ff and terminated by
+ * 00 01, so that keys sort by comment text and the key of a prefix is a
+ * prefix of the keys of all the comments that start with it. The height is
+ * big endian for the same reason.
+ */
+struct CommentKey
+{
+    CTxCommentEntry entry;
+    bool fPrefixOnly;
+
+    CommentKey() : fPrefixOnly(false) {}
+    CommentKey(const CTxCommentEntry& entryIn) : entry(entryIn), fPrefixOnly(false) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_TXCOMMENT);
+        for (std::string::const_iterator it = entry.strTxComment.begin(); it != entry.strTxComment.end(); ++it) {
+            ser_writedata8(s, *it);
+            if (*it == 0)
+                ser_writedata8(s, 0xff);
+        }
+        if (fPrefixOnly)
+            return;
+        ser_writedata8(s, 0);
+        ser_writedata8(s, 1);
+        ser_writedata32be(s, entry.nHeight);
+        s << entry.txid;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        if (ser_readdata8(s) != DB_TXCOMMENT)
+            throw std::ios_base::failure("Invalid comment index key");
+        entry.strTxComment.clear();
+        while (true) {
+            uint8_t ch = ser_readdata8(s);
+            if (ch == 0) {
+                uint8_t escape = ser_readdata8(s);
+                if (escape == 1)
+                    break;
+                if (escape != 0xff)
+                    throw std::ios_base::failure("Invalid comment index key escape");
+            }
+            entry.strTxComment.push_back(ch);
+        }
+        entry.nHeight = ser_readdata32be(s);
+        s >> entry.txid;
+    }
+};
+
+/** Key of the by-height half of the comment index, which maps to the comment text. */
+struct CommentHeightKey
+{
+    int nHeight;
+    uint256 txid;
+
+    CommentHeightKey() : nHeight(0) {}
+    CommentHeightKey(int nHeightIn, const uint256& txidIn) : nHeight(nHeightIn), txid(txidIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_TXCOMMENT_HEIGHT);
+        ser_writedata32be(s, nHeight);
+        s << txid;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        if (ser_readdata8(s) != DB_TXCOMMENT_HEIGHT)
+            throw std::ios_base::failure("Invalid comment index key");
+        nHeight = ser_readdata32be(s);
+        s >> txid;
+    }
+};
+
+}
+
+CIndexDB::CIndexDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const std::string& strName) : CDBWrapper(path, nCacheSize, fMemory, fWipe, false, strName) {
+}
+
+bool CIndexDB::ReadBestBlock(CBlockLocator& locator) {
+    return Read(DB_BEST_BLOCK, locator);
+}
+
+void CIndexDB::WriteBestBlock(CDBBatch& batch, const CBlockLocator& locator) {
+    batch.Write(DB_BEST_BLOCK, locator);
+}
+
+CTxCommentDB::CTxCommentDB(size_t nCacheSize, bool fMemory, bool fWipe) : CIndexDB(GetDataDir() / "blocks" / "txcomment", nCacheSize, fMemory, fWipe, DB_NAME_TX_COMMENT) {
+}
+
+void CTxCommentDB::WriteBlock(CDBBatch& batch, const CBlock& block, int nHeight) {
+    for (const auto& tx : block.vtx) {
+        if (tx->strTxComment.empty())
+            continue;
+        CTxCommentEntry entry(tx->strTxComment, nHeight, tx->GetHash());
+        batch.Write(CommentKey(entry), '1');
+        batch.Write(CommentHeightKey(nHeight, entry.txid), entry.strTxComment);
+    }
+}
+
+void CTxCommentDB::EraseBlock(CDBBatch& batch, const CBlock& block, int nHeight) {
+    for (const auto& tx : block.vtx) {
+        if (tx->strTxComment.empty())
+            continue;
+        CTxCommentEntry entry(tx->strTxComment, nHeight, tx->GetHash());
+        batch.Erase(CommentKey(entry));
+        batch.Erase(CommentHeightKey(nHeight, entry.txid));
+    }
+}
+
+bool CTxCommentDB::FindByPrefix(const std::string& strPrefix, const CTxCommentEntry* pstart, size_t nCount, std::vector<CTxCommentEntry>& vEntries) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (pstart) {
+        pcursor->Seek(CommentKey(*pstart));
+    } else {
+        CommentKey keyPrefix(CTxCommentEntry(strPrefix, 0, uint256()));
+        keyPrefix.fPrefixOnly = true;
+        pcursor->Seek(keyPrefix);
+    }
+
+    while (pcursor->Valid() && vEntries.size() < nCount) {
+        boost::this_thread::interruption_point();
+        CommentKey key;
+        if (!pcursor->GetKey(key) || key.entry.strTxComment.compare(0, strPrefix.size(), strPrefix) != 0)
+            break;
+        vEntries.push_back(key.entry);
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CTxCommentDB::FindByHeight(int nStartHeight, int nEndHeight, const CTxCommentEntry* pstart, size_t nCount, std::vector<CTxCommentEntry>& vEntries) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (pstart && pstart->nHeight >= nStartHeight)
+        pcursor->Seek(CommentHeightKey(pstart->nHeight, pstart->txid));
+    else
+        pcursor->Seek(CommentHeightKey(nStartHeight, uint256()));
+
+    while (pcursor->Valid() && vEntries.size() < nCount) {
+        boost::this_thread::interruption_point();
+        CommentHeightKey key;
+        if (!pcursor->GetKey(key) || key.nHeight > nEndHeight)
+            break;
+        CTxCommentEntry entry(std::string(), key.nHeight, key.txid);
+        if (!pcursor->GetValue(entry.strTxComment))
+            return error("%s: failed to read value", __func__);
+        vEntries.push_back(entry);
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+namespace {
+
+/** Key of a balance change in the address index, which maps to the amount. */
+struct AddressDeltaKey
+{
+    CAddressDelta delta;
+
+    AddressDeltaKey() {}
+    AddressDeltaKey(const CAddressDelta& deltaIn) : delta(deltaIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_ADDRESS_DELTA);
+        s << delta.scriptHash;
+        ser_writedata32be(s, delta.nHeight);
+        s << delta.txid;
+        ser_writedata32be(s, delta.nIndex);
+        ser_writedata8(s, delta.fSpending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        if (ser_readdata8(s) != DB_ADDRESS_DELTA)
+            throw std::ios_base::failure("Invalid address index key");
+        s >> delta.scriptHash;
+        delta.nHeight = ser_readdata32be(s);
+        s >> delta.txid;
+        delta.nIndex = ser_readdata32be(s);
+        delta.fSpending = ser_readdata8(s);
+    }
+};
+
+/** Key of an unspent output in the address index, which maps to its amount and height. */
+struct AddressUnspentKey
+{
+    uint256 scriptHash;
+    COutPoint outpoint;
+
+    AddressUnspentKey() {}
+    AddressUnspentKey(const uint256& scriptHashIn, const COutPoint& outpointIn) : scriptHash(scriptHashIn), outpoint(outpointIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, DB_ADDRESS_UNSPENT);
+        s << scriptHash;
+        s << outpoint.hash;
+        ser_writedata32be(s, outpoint.n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        if (ser_readdata8(s) != DB_ADDRESS_UNSPENT)
+            throw std::ios_base::failure("Invalid address index key");
+        s >> scriptHash;
+        s >> outpoint.hash;
+        outpoint.n = ser_readdata32be(s);
+    }
+};
+
+}
+
+CAddressIndexDB::CAddressIndexDB(size_t nCacheSize, bool fMemory, bool fWipe) : CIndexDB(GetDataDir() / "blocks" / "addrindex", nCacheSize, fMemory, fWipe, DB_NAME_ADDRESS_INDEX) {
+}
+
+uint256 CAddressIndexDB::GetScriptHash(const CScript& scriptPubKey) {
+    return Hash(scriptPubKey.begin(), scriptPubKey.end());
+}
+
+bool CAddressIndexDB::WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockUndo& blockundo, int nHeight) {
+    // Outputs spent in the same block they were created in are not in the
+    // database yet, but their height is known.
+    std::set<uint256> setBlockTxids;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        setBlockTxids.insert(tx.GetHash());
+        const uint256& txid = tx.GetHash();
+
+        if (!tx.IsCoinBase()) {
+            if (i > blockundo.vtxundo.size() || blockundo.vtxundo[i - 1].vprevout.size() != tx.vin.size())
+                return error("%s: undo data does not match block", __func__);
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (uint32_t j = 0; j < tx.vin.size(); j++) {
+                const CTxOut& prevout = txundo.vprevout[j].txout;
+                CSpentIndexValue spent;
+                spent.txid = txid;
+                spent.nInput = j;
+                spent.nHeight = nHeight;
+                spent.nValue = prevout.nValue;
+                spent.scriptHash = GetScriptHash(prevout.scriptPubKey);
+                std::pair<CAmount, int> unspent;
+                if (setBlockTxids.count(tx.vin[j].prevout.hash))
+                    spent.nPrevHeight = nHeight;
+                else if (Read(AddressUnspentKey(spent.scriptHash, tx.vin[j].prevout), unspent))
+                    spent.nPrevHeight = unspent.second;
+                else
+                    return error("%s: unspent index entry for %s not found", __func__, tx.vin[j].prevout.ToString());
+                batch.Write(AddressDeltaKey(CAddressDelta(spent.scriptHash, nHeight, txid, j, true, 0)), -prevout.nValue);
+                batch.Erase(AddressUnspentKey(spent.scriptHash, tx.vin[j].prevout));
+                batch.Write(std::make_pair(DB_SPENT, tx.vin[j].prevout), spent);
+            }
+        }
+
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            const CTxOut& out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable())
+                continue;
+            const uint256 scriptHash = GetScriptHash(out.scriptPubKey);
+            batch.Write(AddressDeltaKey(CAddressDelta(scriptHash, nHeight, txid, n, false, 0)), out.nValue);
+            batch.Write(AddressUnspentKey(scriptHash, COutPoint(txid, n)), std::make_pair(out.nValue, nHeight));
+        }
+    }
+    return true;
+}
+
+bool CAddressIndexDB::EraseBlock(CDBBatch& batch, const CBlock& block, int nHeight) {
+    // Undo in the reverse order, so that outputs created and spent within
+    // the block are restored and then erased again.
+    for (size_t i = block.vtx.size(); i-- > 0; ) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            const CTxOut& out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable())
+                continue;
+            const uint256 scriptHash = GetScriptHash(out.scriptPubKey);
+            batch.Erase(AddressDeltaKey(CAddressDelta(scriptHash, nHeight, txid, n, false, 0)));
+            batch.Erase(AddressUnspentKey(scriptHash, COutPoint(txid, n)));
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+        for (uint32_t j = tx.vin.size(); j-- > 0; ) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            CSpentIndexValue spent;
+            if (!ReadSpent(prevout, spent))
+                return error("%s: spent index entry for %s not found", __func__, prevout.ToString());
+            batch.Erase(AddressDeltaKey(CAddressDelta(spent.scriptHash, nHeight, txid, j, true, 0)));
+            batch.Erase(std::make_pair(DB_SPENT, prevout));
+            batch.Write(AddressUnspentKey(spent.scriptHash, prevout), std::make_pair(spent.nValue, spent.nPrevHeight));
+        }
+    }
+    return true;
+}
+
+bool CAddressIndexDB::ReadDeltas(const uint256& scriptHash, int nStartHeight, int nEndHeight, const CAddressDelta* pstart, size_t nCount, std::vector<CAddressDelta>& vDeltas) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (pstart && pstart->nHeight >= nStartHeight) {
+        CAddressDelta start(*pstart);
+        start.scriptHash = scriptHash;
+        pcursor->Seek(AddressDeltaKey(start));
+    } else {
+        pcursor->Seek(AddressDeltaKey(CAddressDelta(scriptHash, nStartHeight, uint256(), 0, false, 0)));
+    }
+
+    while (pcursor->Valid() && vDeltas.size() < nCount) {
+        boost::this_thread::interruption_point();
+        AddressDeltaKey key;
+        if (!pcursor->GetKey(key) || key.delta.scriptHash != scriptHash || key.delta.nHeight > nEndHeight)
+            break;
+        if (!pcursor->GetValue(key.delta.nValue))
+            return error("%s: failed to read value", __func__);
+        vDeltas.push_back(key.delta);
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CAddressIndexDB::ReadUnspent(const uint256& scriptHash, const CAddressUnspent* pstart, size_t nCount, std::vector<CAddressUnspent>& vUnspent) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(AddressUnspentKey(scriptHash, pstart ? pstart->outpoint : COutPoint(uint256(), 0)));
+
+    while (pcursor->Valid() && vUnspent.size() < nCount) {
+        boost::this_thread::interruption_point();
+        AddressUnspentKey key;
+        if (!pcursor->GetKey(key) || key.scriptHash != scriptHash)
+            break;
+        std::pair<CAmount, int> value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read value", __func__);
+        vUnspent.push_back(CAddressUnspent(scriptHash, key.outpoint, value.first, value.second));
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CAddressIndexDB::ReadBalance(const uint256& scriptHash, CAmount& nBalance, CAmount& nReceived) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    nBalance = 0;
+    nReceived = 0;
+    pcursor->Seek(AddressDeltaKey(CAddressDelta(scriptHash, 0, uint256(), 0, false, 0)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        AddressDeltaKey key;
+        if (!pcursor->GetKey(key) || key.delta.scriptHash != scriptHash)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to read value", __func__);
+        nBalance += nValue;
+        if (!key.delta.fSpending)
+            nReceived += nValue;
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CAddressIndexDB::ReadSpent(const COutPoint& outpoint, CSpentIndexValue& value) {
+    return Read(std::make_pair(DB_SPENT, outpoint), value);
+}
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CIndexDB(GetDataDir() / "blocks" / "filter", nCacheSize, fMemory, fWipe, DB_NAME_BLOCK_FILTER) {
+}
+
+void CBlockFilterDB::WriteFilter(CDBBatch& batch, const uint256& blockHash, const CBlockFilterEntry& entry) {
+    batch.Write(std::make_pair(DB_BLOCK_FILTER, blockHash), entry);
+}
+
+void CBlockFilterDB::EraseFilter(CDBBatch& batch, const uint256& blockHash) {
+    batch.Erase(std::make_pair(DB_BLOCK_FILTER, blockHash));
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& blockHash, CBlockFilterEntry& entry) {
+    return Read(std::make_pair(DB_BLOCK_FILTER, blockHash), entry);
+}
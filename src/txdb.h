@@ -18,6 +18,7 @@
 #include <boost/function.hpp>
 
 class CBlockIndex;
+class CBlockUndo;
 class CCoinsViewDBCursor;
 class uint256;
 
@@ -41,6 +42,19 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the transaction comment index cache, if -txcommentindex (MiB)
+static const int64_t nMaxTxCommentDBCache = 64;
+//! Max memory allocated to the address index cache, if -addressindex (MiB)
+static const int64_t nMaxAddressDBCache = 256;
+//! Max memory allocated to the block filter index cache, if -blockfilterindex (MiB)
+static const int64_t nMaxBlockFilterDBCache = 64;
+
+//! Names of the databases, by which -dbprofile selects their profiles
+static const char* const DB_NAME_CHAINSTATE = "chainstate";
+static const char* const DB_NAME_BLOCK_INDEX = "blockindex";
+static const char* const DB_NAME_TX_COMMENT = "txcomment";
+static const char* const DB_NAME_ADDRESS_INDEX = "addrindex";
+static const char* const DB_NAME_BLOCK_FILTER = "blockfilter";
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -125,4 +139,216 @@ public:
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
+/**
+ * Database of an index that is built in the background (see index/base.h).
+ * Besides the index itself it records a locator of the block the index is
+ * synced to, which is written in the same batch as the index entries.
+ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const std::string& strName);
+
+    bool ReadBestBlock(CBlockLocator& locator);
+    void WriteBestBlock(CDBBatch& batch, const CBlockLocator& locator);
+};
+
+/** A transaction comment, as stored in the comment index */
+struct CTxCommentEntry
+{
+    std::string strTxComment;
+    int nHeight;
+    uint256 txid;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(strTxComment);
+        READWRITE(nHeight);
+        READWRITE(txid);
+    }
+
+    CTxCommentEntry() : nHeight(0) {}
+    CTxCommentEntry(const std::string& strTxCommentIn, int nHeightIn, const uint256& txidIn) :
+        strTxComment(strTxCommentIn), nHeight(nHeightIn), txid(txidIn) {}
+};
+
+/**
+ * Access to the transaction comment index (blocks/txcomment/).
+ * Every transaction with a non-empty strTxComment in the active chain is
+ * indexed twice: by comment text then height, for prefix searches, and by
+ * height, for range scans.
+ */
+class CTxCommentDB : public CIndexDB
+{
+public:
+    CTxCommentDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CTxCommentDB(const CTxCommentDB&);
+    void operator=(const CTxCommentDB&);
+public:
+    void WriteBlock(CDBBatch& batch, const CBlock& block, int nHeight);
+    void EraseBlock(CDBBatch& batch, const CBlock& block, int nHeight);
+    /**
+     * Find comments starting with strPrefix, in comment then height order.
+     * The scan starts at pstart (if given) and returns at most nCount entries.
+     */
+    bool FindByPrefix(const std::string& strPrefix, const CTxCommentEntry* pstart, size_t nCount, std::vector<CTxCommentEntry>& vEntries);
+    /**
+     * Find comments in blocks nStartHeight to nEndHeight (inclusive), in
+     * height order. The scan starts at pstart (if given) and returns at most
+     * nCount entries.
+     */
+    bool FindByHeight(int nStartHeight, int nEndHeight, const CTxCommentEntry* pstart, size_t nCount, std::vector<CTxCommentEntry>& vEntries);
+};
+
+/** A change to the balance of a script, as stored in the address index */
+struct CAddressDelta
+{
+    uint256 scriptHash;
+    int nHeight;
+    uint256 txid;
+    uint32_t nIndex; //!< The output index, or the input index if fSpending
+    bool fSpending;
+    CAmount nValue;  //!< Negative if fSpending
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(scriptHash);
+        READWRITE(nHeight);
+        READWRITE(txid);
+        READWRITE(nIndex);
+        READWRITE(fSpending);
+        READWRITE(nValue);
+    }
+
+    CAddressDelta() : nHeight(0), nIndex(0), fSpending(false), nValue(0) {}
+    CAddressDelta(const uint256& scriptHashIn, int nHeightIn, const uint256& txidIn, uint32_t nIndexIn, bool fSpendingIn, CAmount nValueIn) :
+        scriptHash(scriptHashIn), nHeight(nHeightIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn), nValue(nValueIn) {}
+};
+
+/** An unspent output of a script, as stored in the address index */
+struct CAddressUnspent
+{
+    uint256 scriptHash;
+    COutPoint outpoint;
+    CAmount nValue;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(scriptHash);
+        READWRITE(outpoint);
+        READWRITE(nValue);
+        READWRITE(nHeight);
+    }
+
+    CAddressUnspent() : nValue(0), nHeight(0) {}
+    CAddressUnspent(const uint256& scriptHashIn, const COutPoint& outpointIn, CAmount nValueIn, int nHeightIn) :
+        scriptHash(scriptHashIn), outpoint(outpointIn), nValue(nValueIn), nHeight(nHeightIn) {}
+};
+
+/** Where an output was spent, as stored in the spent index */
+struct CSpentIndexValue
+{
+    uint256 txid;        //!< The spending transaction
+    uint32_t nInput;     //!< The spending input
+    int nHeight;         //!< The height of the block containing the spending transaction
+    CAmount nValue;      //!< The value of the spent output
+    uint256 scriptHash;  //!< The script hash of the spent output
+    int nPrevHeight;     //!< The height of the block containing the spent output
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(nInput);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+        READWRITE(scriptHash);
+        READWRITE(nPrevHeight);
+    }
+
+    CSpentIndexValue() : nInput(0), nHeight(0), nValue(0), nPrevHeight(0) {}
+};
+
+/**
+ * Access to the address and spent output index (blocks/addrindex/).
+ * Scripts are identified by the hash of the scriptPubKey, so that any
+ * script, not only those with an address, can be looked up. The spent
+ * index also records what each spent output paid to, which is what lets a
+ * block be removed from the index again without its undo data.
+ */
+class CAddressIndexDB : public CIndexDB
+{
+public:
+    CAddressIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CAddressIndexDB(const CAddressIndexDB&);
+    void operator=(const CAddressIndexDB&);
+public:
+    static uint256 GetScriptHash(const CScript& scriptPubKey);
+
+    /**
+     * Index a block being connected. The outputs spent by the block are
+     * taken from its undo data, and their heights from the index itself.
+     */
+    bool WriteBlock(CDBBatch& batch, const CBlock& block, const CBlockUndo& blockundo, int nHeight);
+    bool EraseBlock(CDBBatch& batch, const CBlock& block, int nHeight);
+
+    /**
+     * Find the balance changes of a script in blocks nStartHeight to
+     * nEndHeight (inclusive), in height order. The scan starts at pstart
+     * (if given) and returns at most nCount entries.
+     */
+    bool ReadDeltas(const uint256& scriptHash, int nStartHeight, int nEndHeight, const CAddressDelta* pstart, size_t nCount, std::vector<CAddressDelta>& vDeltas);
+    /** Find at most nCount unspent outputs of a script, starting at pstart (if given). */
+    bool ReadUnspent(const uint256& scriptHash, const CAddressUnspent* pstart, size_t nCount, std::vector<CAddressUnspent>& vUnspent);
+    /** Sum the balance of a script, and everything it has ever received. */
+    bool ReadBalance(const uint256& scriptHash, CAmount& nBalance, CAmount& nReceived);
+    bool ReadSpent(const COutPoint& outpoint, CSpentIndexValue& value);
+};
+
+/** A block filter and its place in the filter header chain, as stored in the filter index */
+struct CBlockFilterEntry
+{
+    uint256 filterHash;
+    uint256 header;
+    std::vector<unsigned char> vchFilter;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(filterHash);
+        READWRITE(header);
+        READWRITE(vchFilter);
+    }
+};
+
+/**
+ * Access to the block filter index (-blockfilterindex). The basic filter of
+ * every block in the active chain is stored under its block hash, together
+ * with its filter header, so headers and filters can be served to peers
+ * without touching the block files.
+ */
+class CBlockFilterDB : public CIndexDB
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+public:
+    void WriteFilter(CDBBatch& batch, const uint256& blockHash, const CBlockFilterEntry& entry);
+    void EraseFilter(CDBBatch& batch, const uint256& blockHash);
+    bool ReadFilter(const uint256& blockHash, CBlockFilterEntry& entry);
+};
+
 #endif // BITCOIN_TXDB_H
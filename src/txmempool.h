@@ -158,6 +158,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t nEpoch; //!< Last mempool traversal that visited this entry, see CTxMemPool::Visited
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -442,6 +443,9 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    mutable uint64_t nEpoch; //!< current traversal, entries with this nEpoch have been visited by it
+    mutable bool fHasEpochGuard; //!< whether a traversal is in progress
+
     void trackPackageRemoved(const CFeeRate& rate);
 
 public:
@@ -492,15 +496,18 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    /** The in-mempool parents or children of an entry, sorted by CompareIteratorByHash. Most
+     *  entries have only a few, so a flat vector is cheaper to keep up than a node-based set. */
+    typedef std::vector<txiter> linkEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    const linkEntries & GetMemPoolParents(txiter entry) const;
+    const linkEntries & GetMemPoolChildren(txiter entry) const;
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        linkEntries parents;
+        linkEntries children;
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
@@ -508,6 +515,30 @@ private:
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
+    /** Add or remove an entry in a sorted linkEntries, keeping cachedInnerUsage up to date */
+    void UpdateLinks(linkEntries& links, txiter entry, bool add);
+
+    /**
+     * Traversals of the ancestors or descendants of an entry mark the entries
+     * they reach with a fresh epoch instead of collecting them in a temporary
+     * set. Only one traversal can be in progress at a time; an EpochGuard
+     * starts one and asserts that it is not nested in another.
+     */
+    class EpochGuard
+    {
+        const CTxMemPool& pool;
+    public:
+        EpochGuard(const CTxMemPool& poolIn);
+        ~EpochGuard();
+    };
+    /** Mark an entry visited by the current traversal, returning whether it already was. Requires an EpochGuard. */
+    bool Visited(txiter it) const
+    {
+        assert(fHasEpochGuard);
+        bool fVisited = it->nEpoch == nEpoch;
+        it->nEpoch = nEpoch;
+        return fVisited;
+    }
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
@@ -665,6 +696,8 @@ public:
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    /** The fee delta of a transaction changed to the given total, 0 once cleared */
+    boost::signals2::signal<void (const uint256&, CAmount)> NotifyFeeDeltaChanged;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
@@ -14,6 +14,7 @@
 #include "consensus/validation.h"
 #include "hash.h"
 #include "init.h"
+#include "mempooljournal.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -86,6 +87,8 @@ CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 
 CTxMemPool mempool(::minRelayTxFee);
+/** Keeps mempool.dat up to date while the node runs */
+static CMempoolJournal mempoolJournal;
 
 static void CheckBlockIndex(const Consensus::Params& consensusParams);
 double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params);
@@ -187,7 +190,7 @@ public:
     ~MemPoolConflictRemovalTracker() {
         pool.NotifyEntryRemoved.disconnect(boost::bind(&MemPoolConflictRemovalTracker::NotifyEntryRemoved, this, _1, _2));
         for (const auto& tx : conflictedTxs) {
-            GetMainSignals().SyncTransaction(*tx, NULL, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+            GetMainSignals().SyncTransaction(tx, NULL, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
         }
         conflictedTxs.clear();
     }
@@ -575,9 +578,38 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
+/** Script verification flags for transactions entering the mempool */
+static unsigned int GetMempoolScriptVerifyFlags()
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
+/** Verify a transaction's inputs and scripts against the standard flags, as done before it enters the mempool */
+static bool CheckMempoolTxInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fCheckScripts, unsigned int scriptVerifyFlags, PrecomputedTransactionData& txdata)
+{
+    if (!CheckInputs(tx, state, view, fCheckScripts, scriptVerifyFlags, true, txdata)) {
+        // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
+        // need to turn both off, and compare against just turning off CLEANSTACK
+        // to see if the failure is specifically due to witness validation.
+        CValidationState stateDummy; // Want reported failures to be from first CheckInputs
+        if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
+            !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
+            // Only the witness is missing, so the transaction itself may be fine.
+            state.SetCorruptionPossible();
+        }
+        return false; // state filled in by CheckInputs
+    }
+    return true;
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, bool fCheckScripts, std::vector<uint256>& vHashTxnToUncache,
+                              CTxScriptPrecheck* pPrepare, const CTxScriptPrecheck* pPrecheck)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -659,8 +691,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
     }
 
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
+        // When preparing a script precheck, the coins are collected in it
+        CCoinsView dummyLocal;
+        CCoinsViewCache viewLocal(&dummyLocal);
+        CCoinsView& dummy = pPrepare ? pPrepare->dummy : dummyLocal;
+        CCoinsViewCache& view = pPrepare ? pPrepare->view : viewLocal;
 
         CAmount nValueIn = 0;
         LockPoints lp;
@@ -782,8 +817,10 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             // At default rate it would take over a month to fill 1GB
             if (dFreeCount + nSize >= GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000)
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
-            LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
-            dFreeCount += nSize;
+            if (!pPrepare) {
+                LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
+                dFreeCount += nSize;
+            }
         }
 
         if (nAbsurdFee && nFees > nAbsurdFee)
@@ -946,25 +983,27 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!Params().RequireStandard()) {
-            scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+        unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags();
+
+        // Everything but the scripts has been checked; leave those to RunTxScriptPrecheck
+        if (pPrepare) {
+            pPrepare->fPrepared = true;
+            return true;
         }
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
-            // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
-            // need to turn both off, and compare against just turning off CLEANSTACK
-            // to see if the failure is specifically due to witness validation.
-            CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
-                // Only the witness is missing, so the transaction itself may be fine.
-                state.SetCorruptionPossible();
+        if (pPrecheck && pPrecheck->fVerified && pPrecheck->view.GetBestBlock() == view.GetBestBlock()) {
+            // The scripts were verified against the same outputs and flags
+            // without cs_main, and the tip their inputs were checked against
+            // has not changed
+            if (!pPrecheck->fValid) {
+                state = pPrecheck->state;
+                return false;
             }
-            return false; // state filled in by CheckInputs
+        } else if (!CheckMempoolTxInputs(tx, state, view, fCheckScripts, scriptVerifyFlags, txdata)) {
+            return false; // state filled in by CheckMempoolTxInputs
         }
 
         // Check again against just the consensus-critical mandatory script
@@ -976,7 +1015,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        if (!CheckInputs(tx, state, view, fCheckScripts, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
@@ -1012,21 +1051,28 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         }
     }
 
-    GetMainSignals().SyncTransaction(tx, NULL, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+    GetMainSignals().SyncTransaction(ptx, NULL, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
 
     return true;
 }
 
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee, bool fCheckScripts,
+                        CTxScriptPrecheck* pPrecheck)
 {
     std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, fCheckScripts, vHashTxToUncache, NULL, pPrecheck);
     if (!res) {
         BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
             pcoinsTip->Uncache(hashTx);
+        if (pPrecheck) {
+            BOOST_FOREACH(const uint256& hashTx, pPrecheck->vHashTxToUncache)
+                pcoinsTip->Uncache(hashTx);
+        }
     }
+    if (pPrecheck)
+        pPrecheck->vHashTxToUncache.clear();
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
     CValidationState stateDummy;
     FlushStateToDisk(stateDummy, FLUSH_STATE_PERIODIC);
@@ -1035,9 +1081,44 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
-                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee, CTxScriptPrecheck* pPrecheck)
 {
-    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee);
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, true, pPrecheck);
+}
+
+CTxScriptPrecheck::~CTxScriptPrecheck()
+{
+    // The transaction was skipped before AcceptToMemoryPool decided on it
+    if (vHashTxToUncache.empty())
+        return;
+    LOCK(cs_main);
+    BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+        pcoinsTip->Uncache(hashTx);
+}
+
+bool PrepareTxScriptPrecheck(CTxMemPool& pool, const CTransactionRef& tx, bool fLimitFree, CTxScriptPrecheck& precheck)
+{
+    CValidationState state;
+    bool fMissingInputs;
+    std::vector<uint256> vHashTxToUncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, &fMissingInputs, GetTime(), NULL, false, 0, true, vHashTxToUncache, &precheck, NULL);
+    if (res) {
+        // Kept until AcceptToMemoryPool decides on the transaction
+        precheck.vHashTxToUncache.swap(vHashTxToUncache);
+    } else {
+        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+            pcoinsTip->Uncache(hashTx);
+    }
+    return res;
+}
+
+void RunTxScriptPrecheck(const CTransaction& tx, CTxScriptPrecheck& precheck)
+{
+    if (!precheck.fPrepared)
+        return;
+    PrecomputedTransactionData txdata(tx);
+    precheck.fValid = CheckMempoolTxInputs(tx, precheck.state, precheck.view, true, GetMempoolScriptVerifyFlags(), txdata);
+    precheck.fVerified = true;
 }
 
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
@@ -1554,6 +1635,14 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 
 } // anon namespace
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull() || !pindex->pprev)
+        return error("%s: no undo data available for %s", __func__, pindex->GetBlockHash().ToString());
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 /**
  * Apply the undo operation of a CTxInUndo to the given chain state.
  * @param undo The undo object.
@@ -2224,7 +2313,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     for (const auto& tx : block.vtx) {
-        GetMainSignals().SyncTransaction(*tx, pindexDelete->pprev, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+        GetMainSignals().SyncTransaction(tx, pindexDelete->pprev, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
     }
     return true;
 }
@@ -2532,7 +2621,7 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
                 assert(pair.second);
                 const CBlock& block = *(pair.second);
                 for (unsigned int i = 0; i < block.vtx.size(); i++)
-                    GetMainSignals().SyncTransaction(*block.vtx[i], pair.first, i);
+                    GetMainSignals().SyncTransaction(block.vtx[i], pair.first, i);
             }
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
@@ -3264,6 +3353,10 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 
     NotifyHeaderTip();
 
+    // Let asynchronous subscribers catch up before connecting more blocks,
+    // so their queues stay bounded however fast blocks arrive
+    LimitValidationInterfaceQueue();
+
     CValidationState state; // Only used to report errors, not invalidity - ignore it
     if (!ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed", __func__);
@@ -4194,119 +4287,159 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Outcome of verifying the scripts of a transaction read from disk */
+enum LoadedTxScripts
+{
+    //! Its inputs were not found, so AcceptToMemoryPool verifies them
+    LOADED_SCRIPTS_UNKNOWN,
+    LOADED_SCRIPTS_VALID,
+    LOADED_SCRIPTS_INVALID,
+};
 
-bool LoadMempool(void)
+/**
+ * Verify the scripts of the transactions read from disk before any of them
+ * enters the mempool, so that none can be relayed or mined unverified. Only
+ * fetching the outputs they spend takes cs_main. Outputs of other
+ * transactions read are taken from those, so transactions spending each
+ * other are verified before either is accepted.
+ */
+static std::vector<LoadedTxScripts> VerifyLoadedMempoolScripts(const std::vector<MempoolJournalEntry>& vEntries)
 {
-    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
-    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
-    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
-    if (file.IsNull()) {
-        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
-        return false;
-    }
+    std::map<uint256, const CTransaction*> mapLoaded;
+    BOOST_FOREACH(const MempoolJournalEntry& entry, vEntries)
+        mapLoaded[entry.tx->GetHash()] = entry.tx.get();
 
-    int64_t count = 0;
-    int64_t skipped = 0;
+    std::vector<LoadedTxScripts> vResults(vEntries.size(), LOADED_SCRIPTS_UNKNOWN);
+    unsigned int flags = GetMempoolScriptVerifyFlags();
     int64_t failed = 0;
-    int64_t nNow = GetTime();
-
-    try {
-        uint64_t version;
-        file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
-            return false;
-        }
-        uint64_t num;
-        file >> num;
-        double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
-            }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
+    for (unsigned int i = 0; i < vEntries.size(); i++) {
+        if (ShutdownRequested())
+            break;
+        const CTransaction& tx = *vEntries[i].tx;
+        std::vector<CTxOut> vSpent;
+        std::vector<uint256> vHashTxToUncache;
+        bool fHaveInputs = true;
+        {
+            LOCK(cs_main);
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                std::map<uint256, const CTransaction*>::const_iterator it = mapLoaded.find(txin.prevout.hash);
+                if (it != mapLoaded.end()) {
+                    fHaveInputs = txin.prevout.n < it->second->vout.size();
+                    if (!fHaveInputs)
+                        break;
+                    vSpent.push_back(it->second->vout[txin.prevout.n]);
+                    continue;
                 }
-            } else {
-                ++skipped;
+                if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
+                    vHashTxToUncache.push_back(txin.prevout.hash);
+                const CCoins* coins = pcoinsTip->AccessCoins(txin.prevout.hash);
+                fHaveInputs = coins && coins->IsAvailable(txin.prevout.n);
+                if (!fHaveInputs)
+                    break;
+                vSpent.push_back(coins->vout[txin.prevout.n]);
             }
-            if (ShutdownRequested())
-                return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+        if (!fHaveInputs || tx.IsCoinBase())
+            continue;
 
-        for (const auto& i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.first.ToString(), prioritydummy, i.second);
+        PrecomputedTransactionData txdata(tx);
+        vResults[i] = LOADED_SCRIPTS_VALID;
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            CScriptCheck check(vSpent[j], tx, j, flags, true, &txdata);
+            if (!check()) {
+                LogPrint("mempool", "%s: %s has invalid scripts: %s\n", __func__, tx.GetHash().ToString(), ScriptErrorString(check.GetScriptError()));
+                vResults[i] = LOADED_SCRIPTS_INVALID;
+                ++failed;
+                LOCK(cs_main);
+                BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+                    pcoinsTip->Uncache(hashTx);
+                break;
+            }
         }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
     }
-
-    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
-    return true;
+    LogPrintf("Verified scripts of mempool transactions from disk: %u read, %i failed\n", vEntries.size(), failed);
+    return vResults;
 }
 
-void DumpMempool(void)
+bool LoadMempool(void)
 {
-    int64_t start = GetTimeMicros();
-
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    std::vector<MempoolJournalEntry> vEntries;
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    bool fLoaded = mempoolJournal.Load(vEntries, mapDeltas);
 
-    {
-        LOCK(mempool.cs);
-        for (const auto &i : mempool.mapDeltas) {
-            mapDeltas[i.first] = i.second.second;
-        }
-        vinfo = mempool.infoAll();
+    // Journal the transactions restored below as well, so that those accepted
+    // from peers in the meantime are not lost in a crash either
+    mempoolJournal.Open(mempool);
+    if (!fLoaded) {
+        LogPrintf("Failed to read mempool from disk. Continuing anyway.\n");
+        return false;
     }
 
-    int64_t mid = GetTimeMicros();
+    // Expired transactions are not worth verifying
+    int64_t nNow = GetTime();
+    int64_t skipped = 0;
+    std::vector<MempoolJournalEntry> vCurrent;
+    vCurrent.reserve(vEntries.size());
+    BOOST_FOREACH(const MempoolJournalEntry& entry, vEntries) {
+        if (entry.nTime + nExpiryTimeout > nNow)
+            vCurrent.push_back(entry);
+        else
+            ++skipped;
+    }
+    std::vector<LoadedTxScripts> vScripts = VerifyLoadedMempoolScripts(vCurrent);
+    if (ShutdownRequested())
+        return false;
 
-    try {
-        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
-        if (!filestr) {
-            return;
+    int64_t count = 0;
+    int64_t failed = 0;
+
+    double prioritydummy = 0;
+    for (unsigned int i = 0; i < vCurrent.size(); i++) {
+        const MempoolJournalEntry& entry = vCurrent[i];
+        const CTransactionRef& tx = entry.tx;
+        if (entry.nFeeDelta) {
+            mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, entry.nFeeDelta);
+        }
+        if (vScripts[i] == LOADED_SCRIPTS_INVALID) {
+            ++failed;
+            continue;
+        }
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, entry.nTime, NULL, false, 0, vScripts[i] != LOADED_SCRIPTS_VALID);
+        }
+        if (state.IsValid()) {
+            ++count;
+        } else {
+            ++failed;
         }
+        if (ShutdownRequested())
+            return false;
+    }
 
-        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    for (const auto& i : mapDeltas) {
+        mempool.PrioritiseTransaction(i.first, i.first.ToString(), prioritydummy, i.second);
+    }
 
-        uint64_t version = MEMPOOL_DUMP_VERSION;
-        file << version;
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    return true;
+}
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
-        }
+void DumpMempool(void)
+{
+    if (mempoolJournal.IsOpen())
+        mempoolJournal.Close();
+    else
+        mempoolJournal.Compact(mempool);
+}
 
-        file << mapDeltas;
-        FileCommit(file.Get());
-        file.fclose();
-        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
-        int64_t last = GetTimeMicros();
-        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*0.000001, (last-mid)*0.000001);
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
-    }
+void FlushMempoolJournal()
+{
+    mempoolJournal.Flush();
+    if (mempoolJournal.NeedsCompaction(mempool))
+        mempoolJournal.Compact(mempool);
 }
 
 //! Guess how far we are in the verification process at the given block index
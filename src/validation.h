@@ -13,6 +13,7 @@
 #include "amount.h"
 #include "chain.h"
 #include "coins.h"
+#include "consensus/validation.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "script/script_error.h"
 #include "sync.h"
@@ -35,6 +36,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -81,8 +83,14 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Number of blocks that can be requested at any given time from a single peer, until its download speed is measured. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the adaptive number of blocks in flight from a single peer. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER = 128;
+/** How long (in microseconds) a block request should wait behind the others in flight from the same peer.
+ *  Each peer's number of blocks in flight is sized so that it stays busy for about this long. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_LATENCY = 2 * 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -133,6 +141,9 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_TXCOMMENTINDEX = false;
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -mempoolreplacement */
@@ -147,6 +158,7 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 
 struct BlockHasher
 {
@@ -319,16 +331,66 @@ void PruneAndFlush();
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nPruneUpToHeight);
 
+/**
+ * Script verification of a relayed transaction done ahead of
+ * AcceptToMemoryPool, so that its signatures can be checked without holding
+ * cs_main. PrepareTxScriptPrecheck runs every cheaper check
+ * AcceptToMemoryPool does first and collects the spent coins, then
+ * RunTxScriptPrecheck verifies the scripts against them without the lock. A
+ * result is only used while the chain tip it was made against is the tip.
+ * AcceptToMemoryPool takes over the coins it fetched into the coins cache;
+ * if it is never called, they are uncached when the precheck is destroyed.
+ */
+class CTxScriptPrecheck
+{
+public:
+    //! Whether the transaction passed every check that comes before its scripts
+    bool fPrepared;
+    //! Whether the scripts were verified, and the result
+    bool fVerified;
+    bool fValid;
+    //! Why the scripts failed, as AcceptToMemoryPool reports it
+    CValidationState state;
+    //! The coins spent by the transaction, detached from the chain state
+    CCoinsView dummy;
+    CCoinsViewCache view;
+    //! Coins fetched into the coins cache, to uncache if the transaction is rejected
+    std::vector<uint256> vHashTxToUncache;
+
+    CTxScriptPrecheck() : fPrepared(false), fVerified(false), fValid(false), view(&dummy) {}
+    ~CTxScriptPrecheck();
+};
+
 /** (try to) add transaction to memory pool
- * plTxnReplaced will be appended to with all transactions replaced from mempool **/
+ * plTxnReplaced will be appended to with all transactions replaced from mempool
+ * pPrecheck may hold the result of verifying the scripts beforehand **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced = NULL,
-                        bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+                        bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0, CTxScriptPrecheck* pPrecheck=NULL);
 
-/** (try to) add transaction to memory pool with a specified acceptance time **/
+/** (try to) add transaction to memory pool with a specified acceptance time.
+ * fCheckScripts=false skips script verification, for transactions whose
+ * scripts are known to be valid **/
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced = NULL,
-                        bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+                        bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0, bool fCheckScripts=true,
+                        CTxScriptPrecheck* pPrecheck=NULL);
+
+/**
+ * Run the checks AcceptToMemoryPool does before verifying scripts, without
+ * adding the transaction, and keep the coins it spends in precheck. Returns
+ * false if the transaction would be rejected before its scripts are verified,
+ * so that no signature is checked for transactions that are non-standard,
+ * pay too little or are otherwise unacceptable. Requires cs_main.
+ */
+bool PrepareTxScriptPrecheck(CTxMemPool& pool, const CTransactionRef& tx, bool fLimitFree, CTxScriptPrecheck& precheck);
+
+/**
+ * Verify the scripts of a transaction prepared by PrepareTxScriptPrecheck,
+ * the way AcceptToMemoryPool would. Valid signatures are stored in the
+ * signature cache. Does not need cs_main.
+ */
+void RunTxScriptPrecheck(const CTransaction& tx, CTxScriptPrecheck& precheck);
 
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
@@ -451,6 +513,9 @@ public:
     CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+    CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(outIn.scriptPubKey), amount(outIn.nValue),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
 
@@ -473,6 +538,7 @@ public:
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -571,12 +637,15 @@ static const unsigned int REJECT_CONFLICT = 0x102;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
-/** Dump the mempool to disk. */
+/** Persist the mempool: close its journal, or write a full snapshot if no journal is open. */
 void DumpMempool();
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk and start journaling changes to it. */
 bool LoadMempool();
 
+/** Flush the mempool journal, and fold it into a new snapshot once it has grown large. */
+void FlushMempoolJournal();
+
 /** 
  * Proof of Stake function declarations 
  */
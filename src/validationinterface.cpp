@@ -5,24 +5,206 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+#include "reverselock.h"
+#include "scheduler.h"
+
+#include <assert.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
 static CMainSignals g_signals;
 
+class CValidationInterfaceQueue;
+
+/** Protects g_scheduler and g_queues */
+static std::mutex g_csQueues;
+/** Scheduler delivering the notifications of asynchronous subscribers, or NULL */
+static CScheduler* g_scheduler = NULL;
+/** Notification queues of the asynchronous subscribers */
+static std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue> > g_queues;
+
+static bool AreBackgroundThreadsRunning()
+{
+    std::lock_guard<std::mutex> lock(g_csQueues);
+    return g_scheduler && g_scheduler->AreThreadsServicingQueue();
+}
+
+/**
+ * Queues the notifications of one asynchronous subscriber in the order they
+ * are signalled, and delivers them one at a time on the background scheduler.
+ * Each scheduler task delivers a single notification and reschedules the
+ * next, so that subscribers share the scheduler threads fairly while never
+ * seeing two of their own callbacks run concurrently. Without a running
+ * scheduler, notifications are delivered by the thread signalling them.
+ */
+class CValidationInterfaceQueue : public std::enable_shared_from_this<CValidationInterfaceQueue>
+{
+private:
+    CValidationInterface* pinterface;
+    //! The signals connected to this queue
+    std::vector<boost::signals2::connection> vConnections;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Notifications not yet delivered
+    std::deque<CScheduler::Function> queue;
+    //! Whether a scheduler task is pending to deliver the next notification
+    bool fScheduled;
+    //! Whether a notification is being delivered
+    bool fRunning;
+
+    /** Deliver the notification at the front of the queue */
+    void RunNext(std::unique_lock<std::mutex>& lock)
+    {
+        CScheduler::Function func = queue.front();
+        queue.pop_front();
+        fRunning = true;
+        {
+            reverse_lock<std::unique_lock<std::mutex> > rlock(lock);
+            func();
+        }
+        fRunning = false;
+        cond.notify_all();
+    }
+
+    void MaybeScheduleProcessQueue(CScheduler& scheduler)
+    {
+        if (fScheduled || fRunning || queue.empty())
+            return;
+        fScheduled = true;
+        scheduler.scheduleFromNow(boost::bind(&CValidationInterfaceQueue::ProcessQueue, shared_from_this()), 0);
+    }
+
+    void ProcessQueue()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        fScheduled = false;
+        if (fRunning || queue.empty())
+            return;
+        RunNext(lock);
+        std::lock_guard<std::mutex> lockScheduler(g_csQueues);
+        if (g_scheduler)
+            MaybeScheduleProcessQueue(*g_scheduler);
+    }
+
+    void Add(const CScheduler::Function& func)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        queue.push_back(func);
+        {
+            std::lock_guard<std::mutex> lockScheduler(g_csQueues);
+            if (g_scheduler && g_scheduler->AreThreadsServicingQueue()) {
+                MaybeScheduleProcessQueue(*g_scheduler);
+                return;
+            }
+        }
+        // Nothing services the scheduler: deliver now, unless another call
+        // on the stack or another thread is already delivering, in which case
+        // it picks this notification up after the ones queued before it.
+        while (!fRunning && !queue.empty())
+            RunNext(lock);
+    }
+
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+    {
+        Add(boost::bind(&CValidationInterface::UpdatedBlockTip, pinterface, pindexNew, pindexFork, fInitialDownload));
+    }
+    void SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pindex, int posInBlock)
+    {
+        Add(boost::bind(&CValidationInterface::SyncTransactionRef, pinterface, ptx, pindex, posInBlock));
+    }
+    void SetBestChain(const CBlockLocator& locator)
+    {
+        Add(boost::bind(&CValidationInterface::SetBestChain, pinterface, locator));
+    }
+    void UpdatedTransaction(const uint256& hash)
+    {
+        Add(boost::bind(&CValidationInterface::UpdatedTransaction, pinterface, hash));
+    }
+    void Inventory(const uint256& hash)
+    {
+        Add(boost::bind(&CValidationInterface::Inventory, pinterface, hash));
+    }
+    void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block)
+    {
+        Add(boost::bind(&CValidationInterface::NewPoWValidBlock, pinterface, pindex, block));
+    }
+
+public:
+    CValidationInterfaceQueue(CValidationInterface* pinterfaceIn) : pinterface(pinterfaceIn), fScheduled(false), fRunning(false) {}
+
+    void Connect()
+    {
+        vConnections.push_back(g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterfaceQueue::UpdatedBlockTip, this, _1, _2, _3)));
+        vConnections.push_back(g_signals.SyncTransaction.connect(boost::bind(&CValidationInterfaceQueue::SyncTransaction, this, _1, _2, _3)));
+        vConnections.push_back(g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterfaceQueue::UpdatedTransaction, this, _1)));
+        vConnections.push_back(g_signals.SetBestChain.connect(boost::bind(&CValidationInterfaceQueue::SetBestChain, this, _1)));
+        vConnections.push_back(g_signals.Inventory.connect(boost::bind(&CValidationInterfaceQueue::Inventory, this, _1)));
+        vConnections.push_back(g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterfaceQueue::NewPoWValidBlock, this, _1, _2)));
+    }
+
+    void Disconnect()
+    {
+        BOOST_FOREACH(boost::signals2::connection& conn, vConnections)
+            conn.disconnect();
+        vConnections.clear();
+    }
+
+    /**
+     * Wait until the queue holds at most nMaxSize notifications, and none is
+     * being delivered if nMaxSize is 0. Without a running scheduler the
+     * notifications are delivered by the calling thread.
+     */
+    void WaitForSize(size_t nMaxSize)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        while (queue.size() > nMaxSize || (nMaxSize == 0 && fRunning)) {
+            if (!AreBackgroundThreadsRunning()) {
+                if (nMaxSize > 0)
+                    return;
+                if (!fRunning) {
+                    RunNext(lock);
+                    continue;
+                }
+            }
+            // The scheduler may stop with our task still pending, so poll
+            cond.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+};
+
 CMainSignals& GetMainSignals()
 {
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
-    g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+void RegisterValidationInterface(CValidationInterface* pwalletIn, bool fAsync) {
+    if (fAsync) {
+        std::shared_ptr<CValidationInterfaceQueue> pqueue = std::make_shared<CValidationInterfaceQueue>(pwalletIn);
+        {
+            std::lock_guard<std::mutex> lock(g_csQueues);
+            g_queues[pwalletIn] = pqueue;
+        }
+        pqueue->Connect();
+    } else {
+        g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
+        g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransactionRef, pwalletIn, _1, _2, _3));
+        g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+        g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+        g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+        g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    }
     g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
     g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
@@ -33,9 +215,21 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
+    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransactionRef, pwalletIn, _1, _2, _3));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+
+    std::shared_ptr<CValidationInterfaceQueue> pqueue;
+    {
+        std::lock_guard<std::mutex> lock(g_csQueues);
+        std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue> >::iterator it = g_queues.find(pwalletIn);
+        if (it == g_queues.end())
+            return;
+        pqueue = it->second;
+        g_queues.erase(it);
+    }
+    pqueue->Disconnect();
+    pqueue->WaitForSize(0);
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -49,4 +243,47 @@ void UnregisterAllValidationInterfaces() {
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NewPoWValidBlock.disconnect_all_slots();
+
+    std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue> > queues;
+    {
+        std::lock_guard<std::mutex> lock(g_csQueues);
+        queues.swap(g_queues);
+    }
+    for (const auto& entry : queues)
+        entry.second->WaitForSize(0);
+}
+
+void RegisterBackgroundSignalScheduler(CScheduler& scheduler)
+{
+    std::lock_guard<std::mutex> lock(g_csQueues);
+    assert(!g_scheduler);
+    g_scheduler = &scheduler;
+}
+
+void UnregisterBackgroundSignalScheduler()
+{
+    std::lock_guard<std::mutex> lock(g_csQueues);
+    g_scheduler = NULL;
+}
+
+static void WaitForQueues(size_t nMaxSize)
+{
+    std::vector<std::shared_ptr<CValidationInterfaceQueue> > vQueues;
+    {
+        std::lock_guard<std::mutex> lock(g_csQueues);
+        for (const auto& entry : g_queues)
+            vQueues.push_back(entry.second);
+    }
+    for (const auto& pqueue : vQueues)
+        pqueue->WaitForSize(nMaxSize);
+}
+
+void SyncWithValidationInterfaceQueue()
+{
+    WaitForQueues(0);
+}
+
+void LimitValidationInterfaceQueue()
+{
+    WaitForQueues(MAX_VALIDATION_INTERFACE_QUEUE_SIZE);
 }
@@ -6,6 +6,8 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include "primitives/transaction.h" // CTransactionRef
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 #include <memory>
@@ -16,20 +18,52 @@ struct CBlockLocator;
 class CBlockIndex;
 class CConnman;
 class CReserveScript;
-class CTransaction;
+class CScheduler;
 class CValidationInterface;
 class CValidationState;
 class uint256;
 
+/** Notifications an asynchronous subscriber may have pending before block processing waits for it */
+static const size_t MAX_VALIDATION_INTERFACE_QUEUE_SIZE = 10000;
+
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/**
+ * Register a wallet to receive updates from core. With fAsync, the
+ * notifications that carry no reply (UpdatedBlockTip, SyncTransaction,
+ * SetBestChain, UpdatedTransaction, Inventory and NewPoWValidBlock) are
+ * queued and delivered in order on the background signal scheduler, so a slow
+ * subscriber does not hold up block connection while cs_main is held. The
+ * other callbacks are always delivered synchronously.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, bool fAsync = false);
+/** Unregister a wallet from core, delivering its pending notifications first */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
 
+/**
+ * Deliver the notifications of asynchronous subscribers on the threads
+ * servicing scheduler. Until this is called, or once they have stopped, those
+ * notifications are delivered synchronously.
+ */
+void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
+/** Deliver the notifications of asynchronous subscribers synchronously again */
+void UnregisterBackgroundSignalScheduler();
+
+/**
+ * Wait until every notification signalled so far has been delivered to the
+ * asynchronous subscribers. Must not be called with cs_main held, as
+ * subscribers take it.
+ */
+void SyncWithValidationInterfaceQueue();
+/**
+ * Wait until no asynchronous subscriber has more than
+ * MAX_VALIDATION_INTERFACE_QUEUE_SIZE notifications pending. Must not be
+ * called with cs_main held.
+ */
+void LimitValidationInterfaceQueue();
+
 class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {}
@@ -42,7 +76,10 @@ protected:
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {};
     virtual void ResetRequestCount(const uint256 &hash) {};
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+private:
+    void SyncTransactionRef(const CTransactionRef& ptx, const CBlockIndex *pindex, int posInBlock) { SyncTransaction(*ptx, pindex, posInBlock); }
+    friend class CValidationInterfaceQueue;
+    friend void ::RegisterValidationInterface(CValidationInterface*, bool);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
 };
@@ -60,7 +97,7 @@ struct CMainSignals {
      * transaction was accepted to mempool, removed from mempool (only when
      * removal was due to conflict from connected block), or appeared in a
      * disconnected block.*/
-    boost::signals2::signal<void (const CTransaction &, const CBlockIndex *pindex, int posInBlock)> SyncTransaction;
+    boost::signals2::signal<void (const CTransactionRef &, const CBlockIndex *pindex, int posInBlock)> SyncTransaction;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
@@ -10,6 +10,7 @@
 #include "core_io.h"
 #include "init.h"
 #include "validation.h"
+#include "validationinterface.h"
 #include "net.h"
 #include "policy/policy.h"
 #include "policy/rbf.h"
@@ -48,6 +49,9 @@ bool EnsureWalletIsAvailable(bool avoidException)
         else
             return false;
     }
+    // Let the wallet catch up with what earlier calls did, such as a
+    // transaction just relayed or a block just generated
+    SyncWithValidationInterfaceQueue();
     return true;
 }
 
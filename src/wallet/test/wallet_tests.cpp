@@ -9,10 +9,12 @@
 #include <utility>
 #include <vector>
 
+#include "random.h"
 #include "rpc/server.h"
 #include "test/test_bitcoin.h"
 #include "validation.h"
 #include "wallet/test/wallet_test_fixture.h"
+#include "wallet/walletdb.h"
 
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
@@ -490,4 +492,65 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
     ::pwalletMain = pwalletMainBackup;
 }
 
+BOOST_AUTO_TEST_CASE(load_wallet_parallel)
+{
+    // Several batches of keys, and some transactions in between
+    std::set<CKeyID> setKeyIDs;
+    std::set<uint256> setTxHashes;
+    {
+        LOCK(pwalletMain->cs_wallet);
+        for (unsigned int i = 0; i < 2 * WALLET_LOAD_BATCH_SIZE + 500; i++) {
+            CKey key;
+            key.MakeNewKey(i % 2 == 0);
+            CPubKey pubkey = key.GetPubKey();
+            BOOST_CHECK(pwalletMain->AddKeyPubKey(key, pubkey));
+            setKeyIDs.insert(pubkey.GetID());
+            if (i % 100 == 0) {
+                CMutableTransaction tx;
+                tx.vin.resize(1);
+                tx.vin[0].prevout.hash = GetRandHash();
+                tx.vin[0].prevout.n = i;
+                tx.vout.resize(1);
+                tx.vout[0].nValue = COIN;
+                tx.vout[0].scriptPubKey = GetScriptForDestination(pubkey.GetID());
+                CWalletTx wtx(pwalletMain, MakeTransactionRef(std::move(tx)));
+                BOOST_CHECK(pwalletMain->AddToWallet(wtx));
+                setTxHashes.insert(wtx.GetHash());
+            }
+        }
+    }
+
+    // Loading on one thread and on several gives the same wallet
+    ForceSetArg("-walletloadthreads", "1");
+    CWallet walletSequential(pwalletMain->strWalletFile);
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(walletSequential.LoadWallet(fFirstRun), DB_LOAD_OK);
+    ForceSetArg("-walletloadthreads", "4");
+    CWallet walletParallel(pwalletMain->strWalletFile);
+    BOOST_CHECK_EQUAL(walletParallel.LoadWallet(fFirstRun), DB_LOAD_OK);
+    ForceSetArg("-walletloadthreads", "0");
+
+    std::set<CKeyID> setSequential, setParallel;
+    walletSequential.GetKeys(setSequential);
+    walletParallel.GetKeys(setParallel);
+    BOOST_CHECK(setSequential == setParallel);
+    BOOST_FOREACH(const CKeyID& keyID, setKeyIDs) {
+        CKey keySequential, keyParallel;
+        BOOST_CHECK(walletSequential.GetKey(keyID, keySequential));
+        BOOST_CHECK(walletParallel.GetKey(keyID, keyParallel));
+        BOOST_CHECK(keySequential == keyParallel);
+        BOOST_CHECK(keyParallel.GetPubKey().GetID() == keyID);
+    }
+
+    LOCK2(walletSequential.cs_wallet, walletParallel.cs_wallet);
+    BOOST_CHECK_EQUAL(walletSequential.mapWallet.size(), walletParallel.mapWallet.size());
+    BOOST_FOREACH(const uint256& hash, setTxHashes) {
+        BOOST_CHECK(walletParallel.mapWallet.count(hash));
+        BOOST_CHECK(walletSequential.mapWallet.count(hash));
+        if (walletParallel.mapWallet.count(hash) && walletSequential.mapWallet.count(hash))
+            BOOST_CHECK_EQUAL(walletParallel.mapWallet[hash].nOrderPos, walletSequential.mapWallet[hash].nOrderPos);
+    }
+    BOOST_CHECK_EQUAL(walletSequential.wtxOrdered.size(), walletParallel.wtxOrdered.size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
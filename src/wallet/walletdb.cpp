@@ -6,6 +6,7 @@
 #include "wallet/walletdb.h"
 
 #include "base58.h"
+#include "checkqueue.h"
 #include "consensus/validation.h"
 #include "validation.h" // For CheckTransaction
 #include "protocol.h"
@@ -278,36 +279,47 @@ public:
     }
 };
 
-bool
-ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
-             CWalletScanState &wss, string& strType, string& strErr)
+/**
+ * The decoded value of a "tx", "key" or "wkey" record. Deserializing and
+ * checking these records dominates wallet load time, and does not touch the
+ * wallet, so LoadWallet does it on its load threads before merging the
+ * records into the wallet in cursor order.
+ */
+class CWalletDecodedRecord {
+public:
+    bool fValid;
+    string strErr;
+    uint256 hash;
+    std::unique_ptr<CWalletTx> pwtx;
+    bool fUpgraded;
+    CPubKey vchPubKey;
+    CKey key;
+
+    CWalletDecodedRecord() {
+        fValid = false;
+        fUpgraded = false;
+    }
+};
+
+static bool IsDecodedType(const string& strType)
+{
+    return (strType == "tx" || strType == "key" || strType == "wkey");
+}
+
+static void DecodeKeyValue(CDataStream& ssKey, CDataStream& ssValue,
+                           const string& strType, CWalletDecodedRecord& decoded)
 {
+    decoded.fValid = false;
     try {
-        // Unserialize
-        // Taking advantage of the fact that pair serialization
-        // is just the two items serialized one after the other
-        ssKey >> strType;
-        if (strType == "name")
-        {
-            string strAddress;
-            ssKey >> strAddress;
-            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].name;
-        }
-        else if (strType == "purpose")
+        if (strType == "tx")
         {
-            string strAddress;
-            ssKey >> strAddress;
-            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].purpose;
-        }
-        else if (strType == "tx")
-        {
-            uint256 hash;
-            ssKey >> hash;
-            CWalletTx wtx;
+            ssKey >> decoded.hash;
+            decoded.pwtx.reset(new CWalletTx());
+            CWalletTx& wtx = *decoded.pwtx;
             ssValue >> wtx;
             CValidationState state;
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
-                return false;
+            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == decoded.hash) && state.IsValid()))
+                return;
 
             // Undo serialize changes in 31600
             if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
@@ -317,66 +329,31 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
                     char fTmp;
                     char fUnused;
                     ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+                    decoded.strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, decoded.hash.ToString());
                     wtx.fTimeReceivedIsTxTime = fTmp;
                 }
                 else
                 {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+                    decoded.strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, decoded.hash.ToString());
                     wtx.fTimeReceivedIsTxTime = 0;
                 }
-                wss.vWalletUpgrade.push_back(hash);
+                decoded.fUpgraded = true;
             }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
-        }
-        else if (strType == "acentry")
-        {
-            string strAccount;
-            ssKey >> strAccount;
-            uint64_t nNumber;
-            ssKey >> nNumber;
-            if (nNumber > nAccountingEntryNumber)
-                nAccountingEntryNumber = nNumber;
-
-            if (!wss.fAnyUnordered)
-            {
-                CAccountingEntry acentry;
-                ssValue >> acentry;
-                if (acentry.nOrderPos == -1)
-                    wss.fAnyUnordered = true;
-            }
-        }
-        else if (strType == "watchs")
-        {
-            wss.nWatchKeys++;
-            CScript script;
-            ssKey >> *(CScriptBase*)(&script);
-            char fYes;
-            ssValue >> fYes;
-            if (fYes == '1')
-                pwallet->LoadWatchOnly(script);
         }
         else if (strType == "key" || strType == "wkey")
         {
-            CPubKey vchPubKey;
-            ssKey >> vchPubKey;
-            if (!vchPubKey.IsValid())
+            ssKey >> decoded.vchPubKey;
+            if (!decoded.vchPubKey.IsValid())
             {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
+                decoded.strErr = "Error reading wallet database: CPubKey corrupt";
+                return;
             }
-            CKey key;
             CPrivKey pkey;
             uint256 hash;
 
             if (strType == "key")
             {
-                wss.nKeys++;
                 ssValue >> pkey;
             } else {
                 CWalletKey wkey;
@@ -401,30 +378,111 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             {
                 // hash pubkey/privkey to accelerate wallet load
                 std::vector<unsigned char> vchKey;
-                vchKey.reserve(vchPubKey.size() + pkey.size());
-                vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
+                vchKey.reserve(decoded.vchPubKey.size() + pkey.size());
+                vchKey.insert(vchKey.end(), decoded.vchPubKey.begin(), decoded.vchPubKey.end());
                 vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
 
                 if (Hash(vchKey.begin(), vchKey.end()) != hash)
                 {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
+                    decoded.strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+                    return;
                 }
 
                 fSkipCheck = true;
             }
 
-            if (!key.Load(pkey, vchPubKey, fSkipCheck))
+            if (!decoded.key.Load(pkey, decoded.vchPubKey, fSkipCheck))
+            {
+                decoded.strErr = "Error reading wallet database: CPrivKey corrupt";
+                return;
+            }
+        }
+        else
+            return;
+    } catch (...)
+    {
+        return;
+    }
+    decoded.fValid = true;
+}
+
+static bool
+ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
+             CWalletScanState &wss, const string& strType, string& strErr,
+             CWalletDecodedRecord* pdecoded)
+{
+    try {
+        if (strType == "name")
+        {
+            string strAddress;
+            ssKey >> strAddress;
+            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].name;
+        }
+        else if (strType == "purpose")
+        {
+            string strAddress;
+            ssKey >> strAddress;
+            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].purpose;
+        }
+        else if (IsDecodedType(strType))
+        {
+            CWalletDecodedRecord decoded;
+            if (!pdecoded)
             {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
+                DecodeKeyValue(ssKey, ssValue, strType, decoded);
+                pdecoded = &decoded;
+            }
+            // Like a sequential load, count plaintext keys once their
+            // public key has been found valid
+            if (strType == "key" && pdecoded->vchPubKey.IsValid())
+                wss.nKeys++;
+            strErr = pdecoded->strErr;
+            if (!pdecoded->fValid)
                 return false;
+
+            if (strType == "tx")
+            {
+                if (pdecoded->fUpgraded)
+                    wss.vWalletUpgrade.push_back(pdecoded->hash);
+
+                if (pdecoded->pwtx->nOrderPos == -1)
+                    wss.fAnyUnordered = true;
+
+                pwallet->LoadToWallet(*pdecoded->pwtx);
             }
-            if (!pwallet->LoadKey(key, vchPubKey))
+            else if (!pwallet->LoadKey(pdecoded->key, pdecoded->vchPubKey))
             {
                 strErr = "Error reading wallet database: LoadKey failed";
                 return false;
             }
         }
+        else if (strType == "acentry")
+        {
+            string strAccount;
+            ssKey >> strAccount;
+            uint64_t nNumber;
+            ssKey >> nNumber;
+            if (nNumber > nAccountingEntryNumber)
+                nAccountingEntryNumber = nNumber;
+
+            if (!wss.fAnyUnordered)
+            {
+                CAccountingEntry acentry;
+                ssValue >> acentry;
+                if (acentry.nOrderPos == -1)
+                    wss.fAnyUnordered = true;
+            }
+        }
+        else if (strType == "watchs")
+        {
+            wss.nWatchKeys++;
+            CScript script;
+            ssKey >> *(CScriptBase*)(&script);
+            char fYes;
+            ssValue >> fYes;
+            if (fYes == '1')
+                pwallet->LoadWatchOnly(script);
+        }
         else if (strType == "mkey")
         {
             unsigned int nID;
@@ -546,12 +604,96 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
     return true;
 }
 
+bool
+ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
+             CWalletScanState &wss, string& strType, string& strErr)
+{
+    try {
+        // Unserialize
+        // Taking advantage of the fact that pair serialization
+        // is just the two items serialized one after the other
+        ssKey >> strType;
+    } catch (...)
+    {
+        return false;
+    }
+    return ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr, NULL);
+}
+
 static bool IsKeyType(string strType)
 {
     return (strType== "key" || strType == "wkey" ||
             strType == "mkey" || strType == "ckey");
 }
 
+/** A raw record read off the wallet database cursor by LoadWallet. */
+class CWalletRecord {
+public:
+    CDataStream ssKey;
+    CDataStream ssValue;
+    string strType;
+    bool fTypeRead;
+    CWalletDecodedRecord decoded;
+
+    CWalletRecord() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), fTypeRead(false) {}
+};
+
+/** Decodes a single wallet record on one of the wallet load threads. */
+class CWalletRecordCheck
+{
+private:
+    CWalletRecord* precord;
+
+public:
+    CWalletRecordCheck() : precord(NULL) {}
+    CWalletRecordCheck(CWalletRecord* precordIn) : precord(precordIn) {}
+
+    bool operator()()
+    {
+        DecodeKeyValue(precord->ssKey, precord->ssValue, precord->strType, precord->decoded);
+        // Bad records are reported one by one when they are merged
+        return true;
+    }
+
+    void swap(CWalletRecordCheck& check) { std::swap(precord, check.precord); }
+};
+
+/**
+ * The wallet load threads, and the queue feeding them. The calling thread
+ * joins the pool while waiting for the queue, so only nThreads-1 threads
+ * are started. Outstanding work is finished before the threads are
+ * stopped, so no worker outlives the records it was handed.
+ */
+class CWalletLoadThreads
+{
+public:
+    CCheckQueue<CWalletRecordCheck> queue;
+    boost::thread_group threadGroup;
+
+    CWalletLoadThreads(int nThreads) : queue(128)
+    {
+        for (int i = 0; i < nThreads - 1; i++)
+            threadGroup.create_thread(boost::bind(&CCheckQueue<CWalletRecordCheck>::Thread, &queue));
+    }
+
+    ~CWalletLoadThreads()
+    {
+        boost::this_thread::disable_interruption di;
+        queue.Wait();
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+};
+
+static int GetWalletLoadThreads()
+{
+    // -walletloadthreads=0 means one thread per core
+    int nThreads = GetArg("-walletloadthreads", DEFAULT_WALLET_LOAD_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    return std::max(1, std::min(nThreads, MAX_WALLET_LOAD_THREADS));
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
@@ -577,40 +719,79 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
-        while (true)
+        // Records are read off the cursor in batches. While the load threads
+        // deserialize and check the transactions and keys of one batch, the
+        // next batch is read and the previous one is merged into the wallet,
+        // in cursor order.
+        std::vector<CWalletRecord> vRecords[2];
+        vRecords[0].reserve(WALLET_LOAD_BATCH_SIZE);
+        vRecords[1].reserve(WALLET_LOAD_BATCH_SIZE);
+        CWalletLoadThreads loadThreads(GetWalletLoadThreads());
+        unsigned int nBatch = 0;
+        do
         {
-            // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
-                break;
-            else if (ret != 0)
+            // Read next batch of records
+            std::vector<CWalletRecord>& vRead = vRecords[(nBatch + 1) % 2];
+            vRead.clear();
+            while (vRead.size() < WALLET_LOAD_BATCH_SIZE)
             {
-                LogPrintf("Error reading next record from wallet database\n");
-                return DB_CORRUPT;
+                vRead.emplace_back();
+                CWalletRecord& record = vRead.back();
+                int ret = ReadAtCursor(pcursor, record.ssKey, record.ssValue);
+                if (ret == DB_NOTFOUND)
+                {
+                    vRead.pop_back();
+                    break;
+                }
+                else if (ret != 0)
+                {
+                    LogPrintf("Error reading next record from wallet database\n");
+                    return DB_CORRUPT;
+                }
+                try {
+                    record.ssKey >> record.strType;
+                    record.fTypeRead = true;
+                } catch (...) {}
             }
 
-            // Try to be tolerant of single corrupt records:
-            string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
-            {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType))
-                    result = DB_CORRUPT;
-                else
+            // Hand it to the load threads once they are done with the last one
+            loadThreads.queue.Wait();
+            std::vector<CWalletRecordCheck> vChecks;
+            BOOST_FOREACH(CWalletRecord& record, vRead) {
+                if (record.fTypeRead && IsDecodedType(record.strType))
+                    vChecks.push_back(CWalletRecordCheck(&record));
+            }
+            loadThreads.queue.Add(vChecks);
+
+            // Merging stays on this thread: LoadToWallet links each
+            // transaction into mapTxSpends and wtxOrdered, which depend on
+            // the records merged before. It overlaps with decoding the next
+            // batch, so the load threads are kept busy meanwhile.
+            BOOST_FOREACH(CWalletRecord& record, vRecords[nBatch % 2]) {
+                // Try to be tolerant of single corrupt records:
+                string strErr;
+                if (!record.fTypeRead ||
+                    !ReadKeyValue(pwallet, record.ssKey, record.ssValue, wss, record.strType, strErr,
+                                  IsDecodedType(record.strType) ? &record.decoded : NULL))
                 {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
-                    if (strType == "tx")
-                        // Rescan if there is a bad transaction record:
-                        SoftSetBoolArg("-rescan", true);
+                    // losing keys is considered a catastrophic error, anything else
+                    // we assume the user can live with:
+                    if (IsKeyType(record.strType))
+                        result = DB_CORRUPT;
+                    else
+                    {
+                        // Leave other errors alone, if we try to fix them we might make things worse.
+                        fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                        if (record.strType == "tx")
+                            // Rescan if there is a bad transaction record:
+                            SoftSetBoolArg("-rescan", true);
+                    }
                 }
+                if (!strErr.empty())
+                    LogPrintf("%s\n", strErr);
             }
-            if (!strErr.empty())
-                LogPrintf("%s\n", strErr);
-        }
+            nBatch++;
+        } while (!vRecords[nBatch % 2].empty());
         pcursor->close();
     }
     catch (const boost::thread_interrupted&) {
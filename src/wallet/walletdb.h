@@ -18,6 +18,12 @@
 #include <vector>
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! -walletloadthreads default (0 = one per core)
+static const int DEFAULT_WALLET_LOAD_THREADS = 0;
+//! Maximum number of threads used to decode wallet records at startup
+static const int MAX_WALLET_LOAD_THREADS = 16;
+//! Number of records LoadWallet reads off the cursor per decode batch
+static const unsigned int WALLET_LOAD_BATCH_SIZE = 1000;
 
 class CAccount;
 class CAccountingEntry;
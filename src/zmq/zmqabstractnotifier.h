@@ -7,15 +7,20 @@
 
 #include "zmqconfig.h"
 
+#include <memory>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+/** Default for -zmqpub<type>hwm, the number of messages queued per subscriber */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), outbound_message_high_water_mark(DEFAULT_ZMQ_SNDHWM) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,17 +33,25 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetOutboundMessageHighWaterMark() const { return outbound_message_high_water_mark; }
+    void SetOutboundMessageHighWaterMark(int hwm) { outbound_message_high_water_mark = hwm; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    /**
+     * Notify about a new tip. pblock is the block itself if validation still
+     * had it in memory, and NULL otherwise.
+     */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    //! Number of messages ZMQ queues per subscriber before dropping new ones
+    int outbound_message_high_water_mark;
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
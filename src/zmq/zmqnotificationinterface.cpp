@@ -15,7 +15,7 @@ void zmqError(const char *str)
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), pindexRecentBlock(NULL)
 {
 }
 
@@ -50,6 +50,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            notifier->SetOutboundMessageHighWaterMark(std::max(0, (int)GetArg(arg + "hwm", DEFAULT_ZMQ_SNDHWM)));
             notifiers.push_back(notifier);
         }
     }
@@ -124,15 +125,31 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
+void CZMQNotificationInterface::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock)
+{
+    LOCK(cs_recentBlock);
+    pindexRecentBlock = pindex;
+    recentBlock = pblock;
+}
+
 void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
 {
     if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
         return;
 
+    // Publish the block from memory if it is the one validation just
+    // announced, rather than reading it back from disk
+    std::shared_ptr<const CBlock> pblock;
+    {
+        LOCK(cs_recentBlock);
+        if (pindexRecentBlock == pindexNew)
+            pblock = recentBlock;
+    }
+
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew))
+        if (notifier->NotifyBlock(pindexNew, pblock))
         {
             i++;
         }
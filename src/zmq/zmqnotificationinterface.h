@@ -5,9 +5,12 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
-#include <string>
+#include <list>
 #include <map>
+#include <memory>
+#include <string>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
@@ -26,12 +29,18 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+    void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
 
 private:
     CZMQNotificationInterface();
 
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+
+    //! The last block announced by NewPoWValidBlock, published from memory once it becomes the tip
+    CCriticalSection cs_recentBlock;
+    const CBlockIndex* pindexRecentBlock;
+    std::shared_ptr<const CBlock> recentBlock;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
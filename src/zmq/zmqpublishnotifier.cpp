@@ -16,42 +16,59 @@ static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
+// Release ZMQ's reference to a payload once the message has been sent
+static void zmq_free_payload(void * /*data*/, void *hint)
 {
-    va_list args;
-    va_start(args, size);
+    delete static_cast<CZMQPayload*>(hint);
+}
 
-    while (1)
-    {
-        zmq_msg_t msg;
+// Internal function to send a three-part message. The first and last parts
+// are copied; the middle one is copied unless it is backed by a shared
+// payload, which ZMQ then references instead.
+static int zmq_send_multipart(void *sock, const char *command, const void* data, size_t size, const CZMQPayload* payload, const void* seq, size_t seqsize)
+{
+    zmq_msg_t msg[3];
+    const void* parts[3] = {command, data, seq};
+    size_t sizes[3] = {strlen(command), size, seqsize};
 
-        int rc = zmq_msg_init_size(&msg, size);
+    for (int i = 0; i < 3; i++)
+    {
+        int rc;
+        if (i == 1 && payload)
+        {
+            CZMQPayload* hint = new CZMQPayload(*payload);
+            rc = zmq_msg_init_data(&msg[i], const_cast<unsigned char*>(hint->get()->data()), hint->get()->size(), zmq_free_payload, hint);
+            if (rc != 0)
+                delete hint;
+        }
+        else
+        {
+            rc = zmq_msg_init_size(&msg[i], sizes[i]);
+            if (rc == 0)
+                memcpy(zmq_msg_data(&msg[i]), parts[i], sizes[i]);
+        }
         if (rc != 0)
         {
             zmqError("Unable to initialize ZMQ msg");
+            for (int j = 0; j < i; j++)
+                zmq_msg_close(&msg[j]);
             return -1;
         }
+    }
 
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
-
-        data = va_arg(args, const void*);
-
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
+    // A PUB socket never blocks: it silently drops the message for each
+    // subscriber whose queue is at the high water mark, so a failed send is
+    // an actual error.
+    for (int i = 0; i < 3; i++)
+    {
+        int rc = zmq_msg_send(&msg[i], sock, i < 2 ? ZMQ_SNDMORE : 0);
         if (rc == -1)
         {
             zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
+            for (int j = i; j < 3; j++)
+                zmq_msg_close(&msg[j]);
             return -1;
         }
-
-        zmq_msg_close(&msg);
-
-        if (!data)
-            break;
-
-        size = va_arg(args, size_t);
     }
     return 0;
 }
@@ -72,7 +89,17 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        LogPrint("zmq", "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, outbound_message_high_water_mark);
+
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &outbound_message_high_water_mark, sizeof(outbound_message_high_water_mark));
+        if (rc != 0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -125,24 +152,101 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = 0;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+bool CZMQAbstractPublishNotifier::SendParts(const char *command, const void* data, size_t size, const CZMQPayload* payload)
 {
     assert(psocket);
 
     /* send three parts, command & data & a LE 4byte sequence number */
     unsigned char msgseq[sizeof(uint32_t)];
     WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
+    int rc = zmq_send_multipart(psocket, command, data, size, payload, msgseq, (size_t)sizeof(uint32_t));
     if (rc == -1)
         return false;
 
-    /* increment memory only sequence number after sending */
+    /* increment memory only sequence number after sending; a message ZMQ
+       drops for a slow subscriber leaves a gap, so it can tell it missed it */
     nSequence++;
 
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+{
+    return SendParts(command, data, size, NULL);
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const CZMQPayload& payload)
+{
+    return SendParts(command, NULL, 0, &payload);
+}
+
+template <typename T>
+static CZMQPayload SerializePayload(const T& obj)
+{
+    std::shared_ptr<std::vector<unsigned char> > payload = std::make_shared<std::vector<unsigned char> >();
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), *payload, 0) << obj;
+    return payload;
+}
+
+// The last block and transaction serialized for publication, shared by every
+// notifier of the same kind
+static CCriticalSection cs_payloads;
+static uint256 hashBlockPayload;
+static CZMQPayload blockPayload;
+static uint256 hashTxPayload;
+static CZMQPayload txPayload;
+
+static CZMQPayload GetBlockPayload(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_payloads);
+        if (blockPayload && hashBlockPayload == hash)
+            return blockPayload;
+    }
+
+    CZMQPayload payload;
+    if (pblock)
+    {
+        payload = SerializePayload(*pblock);
+    }
+    else
+    {
+        // Only find the block's position under cs_main, reading it can take a while
+        CDiskBlockPos pos;
+        {
+            LOCK(cs_main);
+            pos = pindex->GetBlockPos();
+        }
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pos, Params().GetConsensus()))
+            return CZMQPayload();
+        payload = SerializePayload(block);
+    }
+
+    LOCK(cs_payloads);
+    hashBlockPayload = hash;
+    blockPayload = payload;
+    return payload;
+}
+
+static CZMQPayload GetTransactionPayload(const CTransaction &transaction)
+{
+    const uint256& hash = transaction.GetHash();
+    {
+        LOCK(cs_payloads);
+        if (txPayload && hashTxPayload == hash)
+            return txPayload;
+    }
+
+    CZMQPayload payload = SerializePayload(transaction);
+    LOCK(cs_payloads);
+    hashTxPayload = hash;
+    txPayload = payload;
+    return payload;
+}
+
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& /*pblock*/)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
@@ -162,32 +266,23 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    CZMQPayload payload = GetBlockPayload(pindex, pblock);
+    if (!payload)
     {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
+        zmqError("Can't read block from disk");
+        return false;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, payload);
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWTX, GetTransactionPayload(transaction));
 }
@@ -7,23 +7,39 @@
 
 #include "zmqabstractnotifier.h"
 
+#include <vector>
+
 class CBlockIndex;
 
+/** A serialized block or transaction, shared by every notifier publishing it */
+typedef std::shared_ptr<const std::vector<unsigned char> > CZMQPayload;
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
     uint32_t nSequence; //!< upcounting per message sequence number
 
+    bool SendParts(const char *command, const void* data, size_t size, const CZMQPayload* payload);
+
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) { }
 
     /* send zmq multipart message
        parts:
           * command
           * data
           * message sequence number
+       ZMQ drops the message for a subscriber that already has
+       outbound_message_high_water_mark messages pending, so a slow
+       subscriber never blocks the caller. Returns false on errors, after
+       which the notifier should be shut down.
     */
     bool SendMessage(const char *command, const void* data, size_t size);
 
+    /* as above, but hands the payload to ZMQ without copying it; ZMQ holds
+       a reference to it until the message has been sent */
+    bool SendMessage(const char *command, const CZMQPayload& payload);
+
     bool Initialize(void *pcontext);
     void Shutdown();
 };
@@ -31,7 +47,7 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -43,7 +59,7 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier